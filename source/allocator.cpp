@@ -0,0 +1,73 @@
+#include <cstdlib>
+#include <new>
+#include "memory.h"
+
+// Replaces the global allocation functions to report every block to memory.h.
+// Linked into the interpreter executable only.
+
+static inline void *allocate(size_t size)
+{
+    void *pointer = malloc(size > 0 ? size : 1);
+    heap_allocated(pointer);
+    return pointer;
+}
+
+static inline void release(void *pointer)
+{
+    heap_released(pointer);
+    free(pointer);
+}
+
+void *operator new(size_t size)
+{
+    void *pointer = allocate(size);
+    if (pointer == NULL) {
+        throw std::bad_alloc();
+    }
+    return pointer;
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept
+{
+    return allocate(size);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept
+{
+    return allocate(size);
+}
+
+void operator delete(void *pointer) noexcept
+{
+    release(pointer);
+}
+
+void operator delete[](void *pointer) noexcept
+{
+    release(pointer);
+}
+
+void operator delete(void *pointer, size_t) noexcept
+{
+    release(pointer);
+}
+
+void operator delete[](void *pointer, size_t) noexcept
+{
+    release(pointer);
+}
+
+void operator delete(void *pointer, const std::nothrow_t &) noexcept
+{
+    release(pointer);
+}
+
+void operator delete[](void *pointer, const std::nothrow_t &) noexcept
+{
+    release(pointer);
+}
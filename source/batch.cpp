@@ -0,0 +1,274 @@
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include "exceptions.h"
+#include "batch.h"
+#include "context.h"
+#include "pool.h"
+
+typedef std::chrono::steady_clock Clock;
+
+static double seconds_since(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+BatchRunner::BatchRunner(const Program &program, size_t jobs_count, bool lockstep):
+    program(program), jobs_count(std::max((size_t)1, jobs_count)), lockstep(lockstep),
+    track_heap(false), heap{ 0, 0, 0, 0 } {}
+
+bool BatchRunner::add_directory(const std::string &path)
+{
+    std::error_code error;
+    std::vector<std::string> paths;
+    for (std::filesystem::directory_iterator i(path, error), end; !error && i != end; i.increment(error)) {
+        if (i->is_regular_file()) {
+            paths.push_back(i->path().string());
+        }
+    }
+    if (error) {
+        return false;
+    }
+    // directory order is unspecified, sorting keeps merged output deterministic
+    std::sort(paths.begin(), paths.end());
+    for (size_t i = 0; i < paths.size(); i++) {
+        jobs.push_back({ paths[i], "", "", 0.0, false });
+    }
+    return true;
+}
+
+bool BatchRunner::add_manifest(const std::string &path)
+{
+    std::ifstream manifest(path);
+    if (!manifest.is_open()) {
+        return false;
+    }
+    std::string line;
+    while (std::getline(manifest, line)) {
+        if (line != "") {
+            jobs.push_back({ line, "", "", 0.0, false });
+        }
+    }
+    return true;
+}
+
+size_t BatchRunner::size() const
+{
+    return jobs.size();
+}
+
+std::ostream *BatchRunner::open_output(const Job &job, const std::string &output_dir,
+                                       std::ostringstream &buffer, std::ofstream &file) const
+{
+    if (output_dir == "") {
+        return &buffer;
+    }
+    file.open(std::filesystem::path(output_dir) / job.output_name);
+    return &file;
+}
+
+// <input name>.out, and <input name>.2.out and so on for inputs of other
+// directories with the same name
+void BatchRunner::name_outputs()
+{
+    std::set<std::string> used;
+    for (size_t i = 0; i < jobs.size(); i++) {
+        std::string name = std::filesystem::path(jobs[i].input_path).filename().string();
+        std::string result = name + ".out";
+        for (size_t copy = 2; used.count(result) > 0; copy++) {
+            result = name + "." + std::to_string(copy) + ".out";
+        }
+        used.insert(result);
+        jobs[i].output_name = result;
+    }
+}
+
+void BatchRunner::set_heap_tracking(bool enabled)
+{
+    track_heap = enabled;
+}
+
+HeapCounters BatchRunner::get_heap() const
+{
+    return heap;
+}
+
+// heap counters are per thread, so every job counts on its worker and the results are summed
+void BatchRunner::heap_job_start()
+{
+    if (track_heap) {
+        heap_tracking_start();
+    }
+}
+
+void BatchRunner::heap_job_stop()
+{
+    if (!track_heap) {
+        return;
+    }
+    HeapCounters counters = heap_counters();
+    heap_tracking_stop();
+    std::lock_guard<std::mutex> lock(heap_mutex);
+    heap.total += counters.total;
+    heap.allocations += counters.allocations;
+    heap.peak = std::max(heap.peak, counters.peak);
+}
+
+void BatchRunner::run_job(Job &job, const std::string &output_dir)
+{
+    Clock::time_point start = Clock::now();
+    std::ifstream input(job.input_path);
+    std::ostringstream buffer;
+    std::ofstream file;
+    std::ostream *out = open_output(job, output_dir, buffer, file);
+
+    if (!input.is_open()) {
+        *out << "Error: could not open file." << std::endl;
+    } else {
+        try {
+            ExecutionContext context(program, input, *out);
+            context.execute();
+        } catch (const std::exception &e) {
+            // a runtime_error from the VM fails this job, not the worker thread
+            *out << e.what() << std::endl;
+        }
+    }
+    job.output = buffer.str();
+    job.latency = seconds_since(start);
+}
+
+void BatchRunner::run_lanes(const LockstepEngine &engine, size_t first, size_t count,
+                            const std::string &output_dir)
+{
+    const size_t lanes = LockstepEngine::lanes;
+    Clock::time_point start = Clock::now();
+    std::ifstream inputs[lanes];
+    std::ostringstream buffers[lanes];
+    std::ofstream files[lanes];
+    std::istream *lane_inputs[lanes];
+    std::ostream *lane_outputs[lanes];
+    RuntimeStatus statuses[lanes];
+    size_t lane_jobs[lanes];
+    size_t lanes_count = 0;
+
+    for (size_t i = first; i < first + count; i++) {
+        std::ostream *out = open_output(jobs[i], output_dir, buffers[lanes_count], files[lanes_count]);
+        inputs[lanes_count].open(jobs[i].input_path);
+        if (!inputs[lanes_count].is_open()) {
+            *out << "Error: could not open file." << std::endl;
+            jobs[i].output = buffers[lanes_count].str();
+            jobs[i].latency = seconds_since(start);
+            buffers[lanes_count].str("");
+            files[lanes_count].close();
+            continue;
+        }
+        lane_inputs[lanes_count] = &inputs[lanes_count];
+        lane_outputs[lanes_count] = out;
+        lane_jobs[lanes_count] = i;
+        lanes_count++;
+    }
+    try {
+        engine.execute(lane_inputs, lane_outputs, lanes_count, statuses);
+    } catch (const std::exception &e) {
+        for (size_t lane = 0; lane < lanes_count; lane++) {
+            *lane_outputs[lane] << e.what() << std::endl;
+            statuses[lane] = rsOk;
+        }
+    }
+
+    // a lane finishes with the slowest of its group, which is what it is charged
+    double latency = seconds_since(start);
+    for (size_t lane = 0; lane < lanes_count; lane++) {
+        if (statuses[lane] != rsOk) {
+            *lane_outputs[lane] << runtime_status_message(statuses[lane]) << std::endl;
+        }
+        jobs[lane_jobs[lane]].output = buffers[lane].str();
+        jobs[lane_jobs[lane]].latency = latency;
+    }
+}
+
+void BatchRunner::run(const std::string &output_dir, std::ostream &out, std::ostream &report_stream)
+{
+    std::mutex mutex;
+    size_t flushed = 0;
+    Clock::time_point start = Clock::now();
+
+    if (output_dir != "") {
+        std::error_code error;
+        std::filesystem::create_directories(output_dir, error);
+        name_outputs();
+    }
+    // merged output is written as soon as every earlier job is complete
+    auto finish = [this, &output_dir, &out, &mutex, &flushed](size_t first, size_t count) {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (size_t i = first; i < first + count; i++) {
+            jobs[i].done = true;
+        }
+        while (flushed < jobs.size() && jobs[flushed].done) {
+            if (output_dir == "") {
+                out << "---- " << jobs[flushed].input_path << std::endl;
+                out << jobs[flushed].output;
+                jobs[flushed].output.clear();
+            }
+            flushed++;
+        }
+    };
+    {
+        LockstepEngine engine(program);
+        WorkStealingPool pool(jobs_count);
+        if (lockstep && engine.is_supported()) {
+            for (size_t i = 0; i < jobs.size(); i += LockstepEngine::lanes) {
+                size_t count = std::min(LockstepEngine::lanes, jobs.size() - i);
+                pool.submit([this, i, count, &engine, &output_dir, &finish] {
+                    heap_job_start();
+                    run_lanes(engine, i, count, output_dir);
+                    heap_job_stop();
+                    finish(i, count);
+                });
+            }
+        } else {
+            if (lockstep) {
+                report_stream << "Program is not eligible for lockstep execution." << std::endl;
+            }
+            for (size_t i = 0; i < jobs.size(); i++) {
+                pool.submit([this, i, &output_dir, &finish] {
+                    heap_job_start();
+                    run_job(jobs[i], output_dir);
+                    heap_job_stop();
+                    finish(i, 1);
+                });
+            }
+        }
+        pool.wait();
+    }
+    out.flush();
+    report(report_stream, seconds_since(start));
+}
+
+void BatchRunner::report(std::ostream &stream, double wall_time) const
+{
+    std::vector<double> latencies;
+    stream << std::fixed << std::setprecision(3);
+    stream << "Batch report:" << std::endl;
+    for (size_t i = 0; i < jobs.size(); i++) {
+        stream << jobs[i].latency * 1000 << " ms\t" << jobs[i].input_path << std::endl;
+        latencies.push_back(jobs[i].latency);
+    }
+    if (latencies.empty()) {
+        stream << "No inputs." << std::endl;
+        return;
+    }
+    std::sort(latencies.begin(), latencies.end());
+    stream << "Jobs: " << jobs.size() << ", threads: " << jobs_count << std::endl;
+    stream << "Latency (ms): min " << latencies.front() * 1000
+           << ", median " << latencies[latencies.size() / 2] * 1000
+           << ", p99 " << latencies[(latencies.size() - 1) * 99 / 100] * 1000
+           << ", max " << latencies.back() * 1000 << std::endl;
+    stream << "Total: " << wall_time << " s, " << jobs.size() / wall_time << " jobs/s" << std::endl;
+}
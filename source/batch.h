@@ -0,0 +1,59 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "lockstep.h"
+#include "memory.h"
+#include "program.h"
+
+// Runs one compiled program against many input files in parallel.
+// In lockstep mode eligible programs run LockstepEngine::lanes inputs per task.
+class BatchRunner {
+private:
+    struct Job {
+        std::string input_path;
+        // file name in the output directory
+        std::string output_name;
+        std::string output;
+        double latency;
+        bool done;
+    };
+
+    const Program &program;
+    size_t jobs_count;
+    bool lockstep;
+    std::vector<Job> jobs;
+    bool track_heap;
+    std::mutex heap_mutex;
+    HeapCounters heap;
+
+    void name_outputs();
+    void heap_job_start();
+    void heap_job_stop();
+    std::ostream *open_output(const Job &job, const std::string &output_dir,
+                              std::ostringstream &buffer, std::ofstream &file) const;
+    void run_job(Job &job, const std::string &output_dir);
+    void run_lanes(const LockstepEngine &engine, size_t first, size_t count,
+                   const std::string &output_dir);
+    void report(std::ostream &stream, double wall_time) const;
+public:
+    BatchRunner(const Program &program, size_t jobs_count, bool lockstep=false);
+    bool add_directory(const std::string &path);
+    bool add_manifest(const std::string &path);
+    size_t size() const;
+    // counts the heap of every job on its worker thread, see memory.h
+    void set_heap_tracking(bool enabled);
+    // totals of all jobs; the peak is that of the largest single job
+    HeapCounters get_heap() const;
+    // outputs go to <output_dir>/<input name>.out (<input name>.2.out and so on when names
+    // repeat), or are merged into out in input order
+    // when output_dir is empty; statistics are written to report_stream
+    void run(const std::string &output_dir, std::ostream &out, std::ostream &report_stream);
+};
+
+#endif // BATCH_H
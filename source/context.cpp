@@ -0,0 +1,567 @@
+#include <algorithm>
+#include "exceptions.h"
+#include "context.h"
+#include "profiler.h"
+#include "stats.h"
+#include "trace.h"
+#include "layout.h"
+#include "speculate.h"
+#include "probes.h"
+
+ExecutionContext::ExecutionContext(const Program &program, std::istream &in, std::ostream &out):
+    base(&program), program(&program), pos(0), in(&in), out(&out), input_offset(0), input_closed(false), input_lines(0),
+    usage(ResourceUsage{ 0, 0, 0 }), interrupted(lfNone)
+{
+    variables.resize(program.get_variables_count());
+}
+
+ExecutionContext::ExecutionContext(const Program &program, std::ostream &out):
+    base(&program), program(&program), pos(0), in(NULL), out(&out), input_offset(0), input_closed(false), input_lines(0),
+    usage(ResourceUsage{ 0, 0, 0 }), interrupted(lfNone)
+{
+    variables.resize(program.get_variables_count());
+}
+
+void ExecutionContext::clear_variables()
+{
+    for (size_t i = 0; i < variables.size(); i++) {
+        if (variables[i] != NULL) {
+            delete variables[i];
+            variables[i] = NULL;
+        }
+    }
+}
+
+void ExecutionContext::clear_stack()
+{
+    for (size_t i = 0; i < stack.size(); i++) {
+        delete stack[i];
+    }
+    stack.clear();
+}
+
+inline void ExecutionContext::push(Value *value)
+{
+    stack.push_back(value);
+}
+
+inline Value *ExecutionContext::top()
+{
+    if (stack.size() == 0) {
+        return NULL;
+    }
+    return stack.back();
+}
+
+inline Value *ExecutionContext::pop()
+{
+    if (stack.size() == 0) {
+        return NULL;
+    }
+    Value *result = stack.back();
+    stack.pop_back();
+    return result;
+}
+
+inline bool ExecutionContext::read_line(String &line)
+{
+    if (in != NULL) {
+        std::getline(*in, line);
+        input_lines++;
+        return true;
+    }
+    size_t end = input_buffer.find('\n', input_offset);
+    if (end == std::string::npos) {
+        if (!input_closed) {
+            return false;
+        }
+        end = input_buffer.size();
+    }
+    line.assign(input_buffer, input_offset, end - input_offset);
+    input_offset = std::min(end + 1, input_buffer.size());
+    input_lines++;
+    if (input_offset > 4096 && input_offset * 2 > input_buffer.size()) {
+        input_buffer.erase(0, input_offset);
+        input_offset = 0;
+    }
+    return true;
+}
+
+void ExecutionContext::feed_input(const char *data, size_t size)
+{
+    input_buffer.append(data, size);
+}
+
+void ExecutionContext::close_input()
+{
+    input_closed = true;
+}
+
+void ExecutionContext::reset()
+{
+    program = base;
+    pos = 0;
+    input_lines = 0;
+    clear_variables();
+    clear_stack();
+    usage = ResourceUsage{ 0, 0, 0 };
+    interrupted = lfNone;
+    meter.current = meter.peak = 0;
+}
+
+void ExecutionContext::set_limits(const ExecutionLimits &limits)
+{
+    this->limits = limits;
+}
+
+const ResourceUsage &ExecutionContext::get_usage() const
+{
+    return usage;
+}
+
+template <typename Hooks>
+RuntimeStatus ExecutionContext::dispatch(size_t &slice, Hooks &hooks)
+{
+    const ProgramNodes &nodes = program->get_nodes();
+    RuntimeStatus status = rsOk;
+    while (pos < nodes.size()) {
+        ProgramNode node = nodes[pos++];
+        hooks.on_node(pos - 1, node);
+        if (node.type == ntValue) {
+            push(node.data.value->clone());
+            continue;
+        }
+        Operation op = node.data.operation;
+
+        Integer id;
+        size_t target;
+        String read_data, write_data;
+        Value *left, *right, *result;
+        switch (op) {
+        case opClearStack:
+            clear_stack();
+            continue;
+        case opJump:
+            right = pop();
+            left = pop();
+            if (left == NULL || right == NULL) {
+                delete right;
+                return rsEmptyStack;
+            }
+            if (left->to_boolean()) {
+                delete left;
+                delete right;
+                continue;
+            }
+            target = right->to_integer();
+            delete left;
+            delete right;
+            PROBE3(jump, program, pos - 1, target);
+            // only loops can run for long, so the slice is charged on backward jumps
+            // with the length of the jumped-over code, and the limits are polled there
+            if (target < pos) {
+                if (pos - target >= slice || interrupted != lfNone) {
+                    pos = target;
+                    return rsPreempted;
+                }
+                slice -= pos - target;
+            }
+            pos = target;
+            continue;
+        case opLoadVariable:
+            left = pop();
+            if (left == NULL) {
+                return rsEmptyStack;
+            }
+            id = left->to_integer();
+            delete left;
+            if (variables[id] == NULL) {
+                return rsUninitializedVariable;
+            }
+            push(variables[id]->clone());
+            continue;
+        case opLoadVariableUnchecked:
+            left = pop();
+            if (left == NULL) {
+                return rsEmptyStack;
+            }
+            id = left->to_integer();
+            delete left;
+            push(variables[id]->clone());
+            continue;
+        case opSaveVariable:
+            right = pop();
+            left = top();
+            if (left == NULL || right == NULL) {
+                delete right;
+                return rsEmptyStack;
+            }
+            id = right->to_integer();
+            if (variables[id] != NULL) {
+                delete variables[id];
+            }
+            variables[id] = left->clone();
+            delete right;
+            continue;
+        case opWrite:
+            left = pop();
+            if (left == NULL) {
+                return rsEmptyStack;
+            }
+            write_data = left->to_string();
+            PROBE3(write, program, pos - 1, write_data.size());
+            *out << write_data;
+            delete left;
+            continue;
+        case opWriteLn:
+            PROBE3(write, program, pos - 1, 1);
+            *out << "\n";
+            continue;
+        case opReadLn:
+            PROBE2(read__start, program, pos - 1);
+            if (!read_line(read_data)) {
+                pos--;
+                return rsWaitingInput;
+            }
+            PROBE3(read__done, program, pos - 1, read_data.size());
+            push(new StringValue(read_data));
+            continue;
+        case opDup:
+            left = top();
+            if (left == NULL) {
+                return rsEmptyStack;
+            }
+            push(left->clone());
+            continue;
+        case opGuard:
+            right = pop();
+            left = pop();
+            result = pop();
+            if (result == NULL) {
+                delete left;
+                delete right;
+                return rsEmptyStack;
+            }
+            id = left->to_integer();
+            if (variables[id] == NULL || !values_equal(*variables[id], *result)) {
+                pos = right->to_integer();
+            }
+            delete left;
+            delete right;
+            delete result;
+            continue;
+        default:
+            if (operation_is_unary(op)) {
+                left = pop();
+                if (left == NULL) {
+                    return rsEmptyStack;
+                }
+                result = operation_execute(op, left, status);
+                delete left;
+            } else {
+                right = pop();
+                left = pop();
+                if (left == NULL || right == NULL) {
+                    delete right;
+                    return rsEmptyStack;
+                }
+                result = operation_execute(op, left, right, status);
+                delete left;
+                delete right;
+            }
+            if (result == NULL) {
+                return status;
+            }
+            push(result);
+        }
+    }
+    return rsOk;
+}
+
+RuntimeStatus ExecutionContext::begin_limits(size_t slice, size_t &budget)
+{
+    if (limits.max_steps != 0 && usage.steps >= limits.max_steps) {
+        return rsStepLimit;
+    }
+    if (limits.max_time > 0 && usage.time >= limits.max_time) {
+        return rsTimeLimit;
+    }
+    if (limits.max_memory != 0 && meter.peak > limits.max_memory) {
+        return rsMemoryLimit;
+    }
+    budget = slice;
+    if (limits.max_steps != 0) {
+        budget = std::min(slice, limits.max_steps - usage.steps);
+    }
+    interrupted = lfNone;
+    if (limits.max_memory != 0) {
+        meter.limit = limits.max_memory;
+        meter.flag = &interrupted;
+        meter.value = lfMemory;
+        heap_meter_attach(&meter);
+    }
+    if (limits.max_time > 0) {
+        timer.arm(limits.max_time - usage.time, &interrupted);
+    }
+    run_start = std::chrono::steady_clock::now();
+    return rsOk;
+}
+
+RuntimeStatus ExecutionContext::end_limits(RuntimeStatus status, size_t budget, size_t left)
+{
+    usage.time += std::chrono::duration<double>(std::chrono::steady_clock::now() - run_start).count();
+    timer.disarm();
+    if (limits.max_memory != 0) {
+        heap_meter_detach();
+        usage.memory = meter.peak;
+    }
+    if (status != rsPreempted) {
+        usage.steps += budget - left;
+        return status;
+    }
+    if (interrupted != lfNone) {
+        usage.steps += budget - left;
+        return interrupted == lfTime ? rsTimeLimit : rsMemoryLimit;
+    }
+    // the budget is spent: either the caller's slice or the steps left
+    if (limits.max_steps != 0 && budget == limits.max_steps - usage.steps) {
+        usage.steps = limits.max_steps;
+        return rsStepLimit;
+    }
+    usage.steps += budget - left;
+    return status;
+}
+
+template <typename Hooks>
+RuntimeStatus ExecutionContext::run_with(size_t &slice, Hooks &hooks)
+{
+    RuntimeStatus status;
+    PROBE2(run__start, program, pos);
+    if (!limits.any()) {
+        status = dispatch(slice, hooks);
+    } else {
+        size_t budget;
+        status = begin_limits(slice, budget);
+        if (status == rsOk) {
+            size_t left = budget;
+            status = dispatch(left, hooks);
+            status = end_limits(status, budget, left);
+            slice -= budget - left;
+        }
+    }
+    if (status >= rsDivideByZero) {
+        PROBE3(runtime__error, program, pos, status);
+    }
+    PROBE3(run__done, program, pos, status);
+    return status;
+}
+
+// the stack is sampled before every node, the last push is caught after the loop
+struct StatsHooks {
+    RuntimeStats &stats;
+    const std::vector<Value *> &stack;
+
+    inline void on_node(size_t, const ProgramNode &node)
+    {
+        stats.instructions++;
+        if (stack.size() > stats.peak_stack) {
+            stats.peak_stack = stack.size();
+        }
+        if (node.type == ntValue) {
+            stats.value_allocations++;
+            return;
+        }
+        switch (node.data.operation) {
+        case opClearStack:
+        case opJump:
+        case opWrite:
+        case opWriteLn:
+            break;
+        default:
+            // loads, saves, reads, dups and arithmetic create exactly one value
+            stats.value_allocations++;
+        }
+    }
+};
+
+struct SpeculationHooks {
+    SpeculativeTier &tier;
+    const std::vector<Value *> &stack;
+    const std::vector<Value *> &variables;
+
+    inline void on_node(size_t pos, const ProgramNode &node)
+    {
+        tier.on_node(pos, node, stack, variables);
+    }
+};
+
+struct MemoryHooks {
+    MemoryProfiler &profiler;
+    const std::vector<Value *> &stack;
+    const std::vector<Value *> &variables;
+
+    inline void on_node(size_t, const ProgramNode &node)
+    {
+        profiler.on_node(node, stack, variables);
+    }
+};
+
+RuntimeStatus ExecutionContext::run(size_t slice)
+{
+    NoHooks hooks;
+    return run_with(slice, hooks);
+}
+
+RuntimeStatus ExecutionContext::run(OperationProfiler &profiler, size_t slice)
+{
+    profiler.start();
+    RuntimeStatus status = run_with(slice, profiler);
+    profiler.stop();
+    return status;
+}
+
+RuntimeStatus ExecutionContext::run(LineProfiler &profiler, size_t slice)
+{
+    profiler.start();
+    RuntimeStatus status = run_with(slice, profiler);
+    profiler.stop();
+    return status;
+}
+
+RuntimeStatus ExecutionContext::run(RuntimeStats &stats, size_t slice)
+{
+    StatsHooks hooks = { stats, stack };
+    RuntimeStatus status = run_with(slice, hooks);
+    if (stack.size() > stats.peak_stack) {
+        stats.peak_stack = stack.size();
+    }
+    return status;
+}
+
+RuntimeStatus ExecutionContext::run(MemoryProfiler &profiler, size_t slice)
+{
+    MemoryHooks hooks = { profiler, stack, variables };
+    profiler.start();
+    RuntimeStatus status = run_with(slice, hooks);
+    profiler.stop(variables);
+    return status;
+}
+
+RuntimeStatus ExecutionContext::run(ExecutionTracer &tracer, size_t slice)
+{
+    tracer.start(pos);
+    RuntimeStatus status = run_with(slice, tracer);
+    tracer.stop(pos, status);
+    return status;
+}
+
+RuntimeStatus ExecutionContext::run(BlockProfile &profile, size_t slice)
+{
+    profile.start(pos);
+    RuntimeStatus status = run_with(slice, profile);
+    profile.stop(pos);
+    return status;
+}
+
+RuntimeStatus ExecutionContext::run(SpeculativeTier &tier, size_t slice)
+{
+    if (program == base && tier.is_profiling()) {
+        SpeculationHooks hooks = { tier, stack, variables };
+        size_t budget = std::min(slice, tier.get_warmup()), left = budget;
+        tier.start(pos);
+        RuntimeStatus status = run_with(left, hooks);
+        tier.stop(pos);
+        if (status != rsPreempted || budget == slice) {
+            tier.spend(budget - left);
+            return status;
+        }
+        // preempted at a backward jump once the warmup is spent, the image goes on from there
+        tier.spend(budget);
+        slice -= budget;
+    }
+    if (program == base && tier.get_image() != NULL) {
+        pos = tier.translate(pos);
+        program = tier.get_image();
+    }
+    NoHooks hooks;
+    return run_with(slice, hooks);
+}
+
+void ExecutionContext::execute()
+{
+    reset();
+    throw_status(run());
+}
+
+std::string ExecutionContext::status_message(RuntimeStatus status) const
+{
+    std::string message = runtime_status_message(status);
+    if (status == rsStepLimit || status == rsTimeLimit || status == rsMemoryLimit) {
+        message += " Consumed " + describe_usage(usage, limits) + ".";
+    }
+    return message;
+}
+
+void ExecutionContext::throw_status(RuntimeStatus status) const
+{
+    switch (status) {
+    case rsStepLimit:
+    case rsTimeLimit:
+    case rsMemoryLimit:
+        throw LimitExceeded(status_message(status));
+    default:
+        throw_runtime_status(status);
+    }
+}
+
+const Program &ExecutionContext::get_program() const
+{
+    return *program;
+}
+
+size_t ExecutionContext::get_pos() const
+{
+    return pos;
+}
+
+const std::vector<Value*> &ExecutionContext::get_variables() const
+{
+    return variables;
+}
+
+const std::vector<Value*> &ExecutionContext::get_stack() const
+{
+    return stack;
+}
+
+size_t ExecutionContext::get_input_lines() const
+{
+    return input_lines;
+}
+
+void ExecutionContext::restore(size_t pos, size_t input_lines, const std::vector<Value*> &variables,
+                               const std::vector<Value*> &stack)
+{
+    reset();
+    this->pos = pos;
+    this->input_lines = input_lines;
+    for (size_t i = 0; i < variables.size() && i < this->variables.size(); i++) {
+        if (variables[i] != NULL) {
+            this->variables[i] = variables[i]->clone();
+        }
+    }
+    for (size_t i = 0; i < stack.size(); i++) {
+        push(stack[i]->clone());
+    }
+}
+
+bool ExecutionContext::is_finished() const
+{
+    return pos >= program->get_nodes().size();
+}
+
+ExecutionContext::~ExecutionContext()
+{
+    clear_variables();
+    clear_stack();
+}
@@ -0,0 +1,119 @@
+#ifndef CONTEXT_H
+#define CONTEXT_H
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "program.h"
+#include "limits.h"
+#include "memory.h"
+
+class OperationProfiler;
+class LineProfiler;
+struct RuntimeStats;
+class ExecutionTracer;
+class BlockProfile;
+class SpeculativeTier;
+
+// Mutable state of a single program run: variables, stack, program counter
+// and I/O streams. The program image itself is shared and read-only.
+//
+// A context created without an input stream reads lines fed through
+// feed_input(); run() then returns rsWaitingInput instead of blocking when
+// no complete line is available, and may be called again later to resume.
+//
+// With limits set, run() returns rsStepLimit, rsTimeLimit or rsMemoryLimit
+// once the run since the last reset() has consumed more than allowed.
+//
+// run(SpeculativeTier &) may switch the context to a specialized image of
+// its program, see speculate.h; positions are those of the image then, and
+// reset() switches back.
+class ExecutionContext {
+private:
+    const Program *base;
+    const Program *program;
+    std::vector<Value *> variables;
+    std::vector<Value *> stack;
+    size_t pos;
+
+    std::istream *in;
+    std::ostream *out;
+    std::string input_buffer;
+    size_t input_offset;
+    bool input_closed;
+    size_t input_lines;
+
+    ExecutionLimits limits;
+    ResourceUsage usage;
+    // set to a LimitFlag by the timer signal and the heap counters, polled on backward jumps
+    volatile sig_atomic_t interrupted;
+    LimitTimer timer;
+    HeapMeter meter;
+    std::chrono::steady_clock::time_point run_start;
+
+    void clear_variables();
+    void clear_stack();
+
+    inline void push(Value *value);
+    inline Value *top();
+    inline Value *pop();
+    inline bool read_line(String &line);
+
+    // the dispatch loop is instantiated once per hooks type, so the plain
+    // run() pays nothing for instrumentation
+    struct NoHooks {
+        inline void on_node(size_t, const ProgramNode &) {}
+    };
+    template <typename Hooks>
+    RuntimeStatus dispatch(size_t &slice, Hooks &hooks);
+    // slice is decreased by the steps consumed
+    template <typename Hooks>
+    RuntimeStatus run_with(size_t &slice, Hooks &hooks);
+    RuntimeStatus begin_limits(size_t slice, size_t &budget);
+    RuntimeStatus end_limits(RuntimeStatus status, size_t budget, size_t left);
+public:
+    ExecutionContext(const Program &program, std::istream &in, std::ostream &out);
+    ExecutionContext(const Program &program, std::ostream &out);
+    ExecutionContext(const ExecutionContext &) = delete;
+    ExecutionContext &operator=(const ExecutionContext &) = delete;
+    void feed_input(const char *data, size_t size);
+    void close_input();
+    void reset();
+    // the limits bound the whole run since the last reset()
+    void set_limits(const ExecutionLimits &limits);
+    const ResourceUsage &get_usage() const;
+    // slice bounds the run in instructions; it is checked on backward jumps only,
+    // and rsPreempted is returned once it is spent
+    RuntimeStatus run(size_t slice=(size_t)-1);
+    // same as run(), every executed node is recorded by profiler
+    RuntimeStatus run(OperationProfiler &profiler, size_t slice=(size_t)-1);
+    RuntimeStatus run(LineProfiler &profiler, size_t slice=(size_t)-1);
+    // same as run(), counts instructions, stack depth and created values
+    RuntimeStatus run(RuntimeStats &stats, size_t slice=(size_t)-1);
+    // same as run(), allocations are attributed to the executed operations
+    RuntimeStatus run(MemoryProfiler &profiler, size_t slice=(size_t)-1);
+    // same as run(), taken jumps and I/O are recorded by tracer
+    RuntimeStatus run(ExecutionTracer &tracer, size_t slice=(size_t)-1);
+    // same as run(), node executions and taken jumps are counted by profile
+    RuntimeStatus run(BlockProfile &profile, size_t slice=(size_t)-1);
+    // same as run(), profiles the first steps with tier and then runs the image it compiles
+    RuntimeStatus run(SpeculativeTier &tier, size_t slice=(size_t)-1);
+    void execute();
+    // runtime_status_message(), the limit errors also tell the resources consumed
+    std::string status_message(RuntimeStatus status) const;
+    // same as throw_runtime_status(), with the message of status_message()
+    void throw_status(RuntimeStatus status) const;
+    const Program &get_program() const;
+    size_t get_pos() const;
+    const std::vector<Value*> &get_variables() const;
+    const std::vector<Value*> &get_stack() const;
+    size_t get_input_lines() const;
+    // replaces the whole state with copies of the given values, see snapshot.h
+    void restore(size_t pos, size_t input_lines, const std::vector<Value*> &variables,
+                 const std::vector<Value*> &stack);
+    bool is_finished() const;
+    ~ExecutionContext();
+};
+
+#endif // CONTEXT_H
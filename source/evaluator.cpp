@@ -0,0 +1,119 @@
+#include <sstream>
+#include <utility>
+#include "evaluator.h"
+#include "context.h"
+
+// memory is checked between slices, so a slice must not be able to grow
+// strings much past the budget
+static const size_t slice = 256;
+
+PrefixEvaluator::PrefixEvaluator(size_t max_steps, size_t max_memory):
+    max_steps(max_steps), max_memory(max_memory) {}
+
+size_t PrefixEvaluator::values_size(const std::vector<Value*> &values)
+{
+    size_t result = 0;
+    for (size_t i = 0; i < values.size(); i++) {
+        if (values[i] != NULL && values[i]->get_type() == vtString) {
+            result += values[i]->to_string().size();
+        }
+    }
+    return result;
+}
+
+void PrefixEvaluator::push_constant(ProgramNodes &program, Value *value)
+{
+    ProgramNode node;
+    node.type = ntValue;
+    node.data.value = value;
+    program.push_back(node);
+}
+
+void PrefixEvaluator::push_operation(ProgramNodes &program, Operation op)
+{
+    ProgramNode node;
+    node.type = ntOperation;
+    node.data.operation = op;
+    program.push_back(node);
+}
+
+Program *PrefixEvaluator::process(const Program &program) const
+{
+    const ProgramNodes &nodes = program.get_nodes();
+    std::ostringstream output;
+    ExecutionContext context(program, output);
+    RuntimeStatus status = rsPreempted;
+
+    for (size_t steps = 0; status == rsPreempted; steps += slice) {
+        if (steps >= max_steps) {
+            return NULL;
+        }
+        status = context.run(slice);
+        size_t memory = (size_t)output.tellp() + values_size(context.get_variables()) +
+                        values_size(context.get_stack());
+        if (memory > max_memory) {
+            return NULL;
+        }
+    }
+    if (status != rsOk && status != rsWaitingInput) {
+        return NULL;
+    }
+    size_t target = context.get_pos();
+    if (target == 0) {
+        // the very first statement reads, there is nothing to fold
+        return NULL;
+    }
+
+    ProgramNodes result;
+    if (output.tellp() > 0) {
+        push_constant(result, new StringValue(output.str()));
+        push_operation(result, opWrite);
+    }
+    if (status == rsOk) {
+        // variables are never read again once the program is over
+        return new Program(std::move(result), program.get_variables_count());
+    }
+
+    const std::vector<Value*> &variables = context.get_variables();
+    for (size_t id = 0; id < variables.size(); id++) {
+        if (variables[id] != NULL) {
+            push_constant(result, variables[id]->clone());
+            push_constant(result, new IntegerValue((Integer)id));
+            push_operation(result, opSaveVariable);
+            push_operation(result, opClearStack);
+        }
+    }
+    const std::vector<Value*> &stack = context.get_stack();
+    for (size_t i = 0; i < stack.size(); i++) {
+        push_constant(result, stack[i]->clone());
+    }
+
+    // the original code follows the prelude, every jump address moves by its length
+    size_t shift = result.size() + 3;
+    push_constant(result, new BooleanValue(false));
+    push_constant(result, new IntegerValue((Integer)(target + shift)));
+    push_operation(result, opJump);
+    for (size_t i = 0; i < nodes.size(); i++) {
+        ProgramNode node = nodes[i];
+        if (node.type == ntValue) {
+            if (i + 1 < nodes.size() && nodes[i + 1].type == ntOperation &&
+                    nodes[i + 1].data.operation == opJump) {
+                node.data.value = new IntegerValue(node.data.value->to_integer() + (Integer)shift);
+            } else {
+                node.data.value = node.data.value->clone();
+            }
+        }
+        result.push_back(node);
+    }
+    return new Program(std::move(result), program.get_variables_count(), program.get_lines().shifted(shift));
+}
+
+Program *precompute_program(Program *program)
+{
+    Program *result = PrefixEvaluator().process(*program);
+    if (result == NULL) {
+        return program;
+    }
+    delete program;
+    return result;
+}
@@ -0,0 +1,33 @@
+#ifndef EVALUATOR_H
+#define EVALUATOR_H
+
+#include <vector>
+#include "program.h"
+
+// Runs the input-free prefix of a program at compile time, i.e. everything
+// executed before the first read(). The prefix is replaced with a prelude
+// that writes its output as one literal, restores the variables and the
+// stack it left behind and jumps to the read, which keeps the original code
+// reachable for backward jumps. A program that never reads is reduced to
+// its output. Nothing is folded if the prefix fails or exceeds the budget,
+// so runtime errors are still reported at runtime.
+class PrefixEvaluator {
+private:
+    size_t max_steps;
+    size_t max_memory;
+
+    static size_t values_size(const std::vector<Value*> &values);
+    static void push_constant(ProgramNodes &program, Value *value);
+    static void push_operation(ProgramNodes &program, Operation op);
+public:
+    // steps are counted like ExecutionContext::run slices, memory covers
+    // the output and the strings held in variables and on the stack
+    explicit PrefixEvaluator(size_t max_steps=10000000, size_t max_memory=1 << 24);
+    // returns a new image, or NULL when the program is left as it is
+    Program *process(const Program &program) const;
+};
+
+// takes ownership of program and returns either it or its folded replacement
+Program *precompute_program(Program *program);
+
+#endif // EVALUATOR_H
@@ -33,4 +33,10 @@ public:
         Exception(message) {}
 };
 
+class LimitExceeded: public InterpretationError {
+public:
+    explicit LimitExceeded(const std::string &message):
+        InterpretationError(message) {}
+};
+
 #endif //EXCEPTIONS_H
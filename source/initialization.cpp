@@ -0,0 +1,169 @@
+#include <algorithm>
+#include "initialization.h"
+
+InitializationAnalyzer::InitializationAnalyzer(VariableID variables_count):
+    variables_count(variables_count) {}
+
+bool InitializationAnalyzer::get_constant_id(const ProgramNodes &program, size_t idx, VariableID &id)
+{
+    if (idx >= program.size() || program[idx].type != ntValue) {
+        return false;
+    }
+    id = program[idx].data.value->to_integer();
+    return true;
+}
+
+void InitializationAnalyzer::split_blocks(const ProgramNodes &program)
+{
+    size_t length = program.size();
+    std::vector<bool> leaders(length + 1, false);
+    VariableID target;
+
+    leaders[0] = true;
+    for (size_t i = 1; i < length; i++) {
+        if (program[i].type != ntOperation || program[i].data.operation != opJump) {
+            continue;
+        }
+        if (get_constant_id(program, i - 1, target) &&
+            target >= 0 && (size_t)target <= length) {
+            leaders[target] = true;
+        }
+        leaders[i + 1] = true;
+    }
+
+    blocks.clear();
+    blocks.reserve(std::count(leaders.begin(), leaders.begin() + length, true));
+    block_index.assign(length + 1, 0);
+    for (size_t i = 0; i < length; i++) {
+        if (leaders[i]) {
+            blocks.push_back({ i, i, { 0, 0 }, 0 });
+        }
+        block_index[i] = blocks.size() - 1;
+        blocks.back().end = i + 1;
+    }
+    // program end is a virtual exit block without successors
+    block_index[length] = blocks.size();
+}
+
+void InitializationAnalyzer::link_blocks(const ProgramNodes &program)
+{
+    for (size_t i = 0; i < blocks.size(); i++) {
+        BlockInfo &block = blocks[i];
+        size_t last = block.end - 1;
+        bool jumps = false, falls = true;
+        VariableID target = 0;
+
+        if (program[last].type == ntOperation && program[last].data.operation == opJump &&
+            last >= 2 && get_constant_id(program, last - 1, target)) {
+            jumps = true;
+            // the node before the address pushes the condition; a constant one decides the
+            // branch at compile time (unconditional jumps are generated this way)
+            const ProgramNode &condition = program[last - 2];
+            if (last - 2 >= block.start && condition.type == ntValue) {
+                if (condition.data.value->to_boolean()) {
+                    jumps = false;
+                } else {
+                    falls = false;
+                }
+            }
+        }
+        if (jumps && (size_t)target < program.size()) {
+            block.successors[block.successors_count++] = block_index[target];
+        }
+        if (falls && block.end < program.size()) {
+            block.successors[block.successors_count++] = block_index[block.end];
+        }
+    }
+}
+
+void InitializationAnalyzer::load_input(size_t block, VariablesSet &set) const
+{
+    size_t input = block * variables_count;
+    for (VariableID id = 0; id < variables_count; id++) {
+        set[id] = inputs[input + id];
+    }
+}
+
+void InitializationAnalyzer::transfer(const ProgramNodes &program, const BlockInfo &block,
+                                      VariablesSet &set) const
+{
+    VariableID id;
+    for (size_t i = block.start; i < block.end; i++) {
+        if (program[i].type == ntOperation && program[i].data.operation == opSaveVariable &&
+            i > 0 && get_constant_id(program, i - 1, id)) {
+            set[id] = true;
+        }
+    }
+}
+
+void InitializationAnalyzer::solve(const ProgramNodes &program)
+{
+    // unreachable blocks keep the full set, so loads inside them are never checked
+    inputs.assign(blocks.size() * variables_count, true);
+    for (VariableID id = 0; id < variables_count; id++) {
+        inputs[id] = false;
+    }
+
+    // a block is queued at most once at a time
+    std::vector<size_t> worklist;
+    worklist.reserve(blocks.size());
+    std::vector<bool> queued(blocks.size(), true);
+    for (size_t i = blocks.size(); i > 0; i--) {
+        worklist.push_back(i - 1);
+    }
+
+    VariablesSet output(variables_count);
+    while (!worklist.empty()) {
+        size_t current = worklist.back();
+        worklist.pop_back();
+        queued[current] = false;
+
+        load_input(current, output);
+        transfer(program, blocks[current], output);
+        for (size_t j = 0; j < blocks[current].successors_count; j++) {
+            size_t next = blocks[current].successors[j];
+            size_t input = next * variables_count;
+            bool changed = false;
+            for (VariableID id = 0; id < variables_count; id++) {
+                if (inputs[input + id] && !output[id]) {
+                    inputs[input + id] = false;
+                    changed = true;
+                }
+            }
+            if (changed && !queued[next]) {
+                queued[next] = true;
+                worklist.push_back(next);
+            }
+        }
+    }
+}
+
+void InitializationAnalyzer::mark_loads(ProgramNodes &program) const
+{
+    VariablesSet set(variables_count);
+    VariableID id;
+    for (size_t i = 0; i < blocks.size(); i++) {
+        load_input(i, set);
+        for (size_t j = blocks[i].start; j < blocks[i].end; j++) {
+            if (program[j].type != ntOperation || j == 0 || !get_constant_id(program, j - 1, id)) {
+                continue;
+            }
+            if (program[j].data.operation == opSaveVariable) {
+                set[id] = true;
+            } else if (program[j].data.operation == opLoadVariable && set[id]) {
+                program[j].data.operation = opLoadVariableUnchecked;
+            }
+        }
+    }
+}
+
+void InitializationAnalyzer::process(ProgramNodes &program)
+{
+    if (program.empty()) {
+        return;
+    }
+    split_blocks(program);
+    link_blocks(program);
+    solve(program);
+    mark_loads(program);
+}
@@ -0,0 +1,38 @@
+#ifndef INITIALIZATION_H
+#define INITIALIZATION_H
+
+#include <vector>
+#include "program.h"
+
+class InitializationAnalyzer {
+private:
+    typedef std::vector<bool> VariablesSet;
+
+    // a block ends with at most one jump, so it has at most two successors
+    struct BlockInfo {
+        size_t start;
+        size_t end;
+        size_t successors[2];
+        size_t successors_count;
+    };
+
+    VariableID variables_count;
+    std::vector<BlockInfo> blocks;
+    std::vector<size_t> block_index;
+    // the input sets of all blocks, variables_count bits each
+    VariablesSet inputs;
+
+    static bool get_constant_id(const ProgramNodes &program, size_t idx, VariableID &id);
+
+    void split_blocks(const ProgramNodes &program);
+    void link_blocks(const ProgramNodes &program);
+    void load_input(size_t block, VariablesSet &set) const;
+    void transfer(const ProgramNodes &program, const BlockInfo &block, VariablesSet &set) const;
+    void solve(const ProgramNodes &program);
+    void mark_loads(ProgramNodes &program) const;
+public:
+    explicit InitializationAnalyzer(VariableID variables_count);
+    void process(ProgramNodes &program);
+};
+
+#endif // INITIALIZATION_H
@@ -0,0 +1,155 @@
+#include <sstream>
+#include "exceptions.h"
+#include "lexical.h"
+#include "syntax.h"
+#include "context.h"
+#include "evaluator.h"
+#include "interpreter.h"
+
+// Passes everything written into it to an output callback.
+class CallbackOutputBuffer: public std::streambuf {
+private:
+    const OutputCallback &callback;
+    char data[4096];
+
+    void send()
+    {
+        if (pptr() != pbase()) {
+            callback(pbase(), pptr() - pbase());
+        }
+        setp(data, data + sizeof(data));
+    }
+protected:
+    int overflow(int ch) override
+    {
+        send();
+        if (ch != traits_type::eof()) {
+            *pptr() = ch;
+            pbump(1);
+        }
+        return traits_type::not_eof(ch);
+    }
+
+    int sync() override
+    {
+        send();
+        return 0;
+    }
+public:
+    explicit CallbackOutputBuffer(const OutputCallback &callback): callback(callback)
+    {
+        setp(data, data + sizeof(data));
+    }
+};
+
+static bool set_runtime_error(const ExecutionContext &context, RuntimeStatus status, ErrorInfo &error)
+{
+    switch (status) {
+    case rsOk:
+        error.code = ecOk;
+        break;
+    case rsDivideByZero:
+        error.code = ecDivideByZero;
+        break;
+    case rsUninitializedVariable:
+        error.code = ecUninitializedVariable;
+        break;
+    case rsStepLimit:
+    case rsTimeLimit:
+    case rsMemoryLimit:
+        error.code = ecLimitExceeded;
+        break;
+    default:
+        error.code = ecInternal;
+        break;
+    }
+    error.message = context.status_message(status);
+    return status == rsOk;
+}
+
+static bool check_handle(const ProgramHandle &program, ErrorInfo &error)
+{
+    if (!program) {
+        error.code = ecInternal;
+        error.message = "Program handle is empty.";
+        return false;
+    }
+    return true;
+}
+
+CompileOptions::CompileOptions():
+    case_insensetive(false), alternative_names(false),
+    comparison_chains(true), lazy_evaluations(false), precompute(false) {}
+
+ProgramHandle compile_program(const char *source, size_t size, const CompileOptions &options,
+                              ErrorInfo &error)
+{
+    LexicalAnalyzer lexical(options.case_insensetive, options.alternative_names);
+    SyntaxAnalyzer syntax(options.comparison_chains, options.lazy_evaluations);
+    error.code = ecOk;
+    error.message = "";
+    try {
+        lexical.parse_string(std::string(source, size));
+        Program *program = syntax.parse(lexical.get_lexemes());
+        if (options.precompute) {
+            program = precompute_program(program);
+        }
+        return ProgramHandle(program);
+    } catch (const LexicalError &e) {
+        error.code = ecLexical;
+        error.message = e.what();
+    } catch (const SyntaxError &e) {
+        error.code = ecSyntax;
+        error.message = e.what();
+    } catch (const SemanticError &e) {
+        error.code = ecSemantic;
+        error.message = e.what();
+    } catch (const std::exception &e) {
+        error.code = ecInternal;
+        error.message = e.what();
+    }
+    return ProgramHandle();
+}
+
+bool execute_program(const ProgramHandle &program, const InputCallback &input,
+                     const OutputCallback &output, ErrorInfo &error, const ExecutionLimits &limits)
+{
+    if (!check_handle(program, error)) {
+        return false;
+    }
+    CallbackOutputBuffer buffer(output);
+    std::ostream out(&buffer);
+    ExecutionContext context(*program, out);
+    context.set_limits(limits);
+    std::string line;
+
+    RuntimeStatus status;
+    while ((status = context.run()) == rsWaitingInput) {
+        if (input(line)) {
+            line += '\n';
+            context.feed_input(line.data(), line.size());
+        } else {
+            context.close_input();
+        }
+    }
+    out.flush();
+    return set_runtime_error(context, status, error);
+}
+
+bool execute_program(const ProgramHandle &program, const char *input, size_t input_size,
+                     std::string &output, ErrorInfo &error, const ExecutionLimits &limits)
+{
+    if (!check_handle(program, error)) {
+        output = "";
+        return false;
+    }
+    std::ostringstream out;
+    ExecutionContext context(*program, out);
+    context.set_limits(limits);
+    context.feed_input(input, input_size);
+    context.close_input();
+
+    RuntimeStatus status = context.run();
+    output = out.str();
+    return set_runtime_error(context, status, error);
+}
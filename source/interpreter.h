@@ -0,0 +1,63 @@
+#ifndef INTERPRETER_H
+#define INTERPRETER_H
+
+/*
+ * Embedding interface of the interpreter library. A program is compiled
+ * once into an immutable handle which may then be executed any number of
+ * times, concurrently from several threads, with caller-supplied I/O.
+ */
+
+#include <functional>
+#include <memory>
+#include <string>
+#include "limits.h"
+
+class Program;
+
+enum ErrorCode {
+    ecOk,
+    ecLexical,
+    ecSyntax,
+    ecSemantic,
+    ecDivideByZero,
+    ecUninitializedVariable,
+    ecInternal,
+    // one of ExecutionLimits is exceeded, the message tells the resources consumed
+    ecLimitExceeded
+};
+
+struct ErrorInfo {
+    ErrorCode code;
+    std::string message;
+};
+
+struct CompileOptions {
+    bool case_insensetive;
+    bool alternative_names;
+    bool comparison_chains;
+    bool lazy_evaluations;
+    // run the part of the program preceding the first read() at compile time
+    bool precompute;
+
+    CompileOptions();
+};
+
+typedef std::shared_ptr<const Program> ProgramHandle;
+// stores the next input line without the line break; returns false at end of input
+typedef std::function<bool(std::string &line)> InputCallback;
+typedef std::function<void(const char *data, size_t size)> OutputCallback;
+
+// returns an empty handle and fills error if the source is not a valid program
+ProgramHandle compile_program(const char *source, size_t size, const CompileOptions &options,
+                              ErrorInfo &error);
+// both return false and fill error if the program fails at run time or
+// exceeds limits, or if the handle is empty (ecInternal); the memory limit
+// needs the host to report its allocations, see memory.h
+bool execute_program(const ProgramHandle &program, const InputCallback &input,
+                     const OutputCallback &output, ErrorInfo &error,
+                     const ExecutionLimits &limits=ExecutionLimits());
+bool execute_program(const ProgramHandle &program, const char *input, size_t input_size,
+                     std::string &output, ErrorInfo &error,
+                     const ExecutionLimits &limits=ExecutionLimits());
+
+#endif // INTERPRETER_H
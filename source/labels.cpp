@@ -1,42 +1,44 @@
 #include "exceptions.h"
 #include "labels.h"
 
-LabelInfo::LabelInfo(const std::string &name): name(name), value(NULL) {}
+LabelInfo::LabelInfo(const std::string &name): name(name), defined(false), referenced(false), address(0) {}
 
-void LabelInfo::set_value(Value *value)
+void LabelInfo::set_address(size_t address)
 {
-    if (this->value != NULL) {
+    if (defined) {
         throw SemanticError("Semantic error: label " + name + " defined twice.");
     }
-    this->value = value;
+    defined = true;
+    this->address = address;
 }
 
-void LabelInfo::add_node(size_t idx)
+void LabelInfo::add_reference()
 {
-    node_indexes.push_back(idx);
+    referenced = true;
 }
 
-void LabelInfo::propagate(ProgramNodes &program)
+void LabelInfo::check() const
 {
-    size_t length = node_indexes.size();
-    if (length == 0) {
-        if (value != NULL) {
-            delete value;
-        }
-        return;
-    }
-    if (value == NULL) {
+    if (referenced && !defined) {
         throw SemanticError("Semantic error: no label " + name + " found.");
     }
-    program[node_indexes[0]].data.value = value;
-    for (size_t i = 1; i < length; i++) {
-        program[node_indexes[i]].data.value = value->clone();
-    }
+}
+
+size_t LabelInfo::get_address() const
+{
+    return address;
 }
 
 void LabelsTable::clear()
 {
     labels.clear();
+    references.clear();
+}
+
+void LabelsTable::reserve(size_t labels_count, size_t references_count)
+{
+    labels.reserve(labels_count);
+    references.reserve(references_count);
 }
 
 LabelID LabelsTable::new_label()
@@ -46,20 +48,25 @@ LabelID LabelsTable::new_label()
     return result;
 }
 
-void LabelsTable::set_value(LabelID label, Value *value)
+void LabelsTable::set_address(LabelID label, size_t address)
 {
-    labels[label].set_value(value);
+    labels[label].set_address(address);
 }
 
 void LabelsTable::add_node(LabelID label, size_t idx)
 {
-    labels[label].add_node(idx);
+    labels[label].add_reference();
+    references.push_back(Reference{ label, idx });
 }
 
 void LabelsTable::propagate(ProgramNodes &program)
 {
     for (size_t i = 0; i < labels.size(); i++) {
-        labels[i].propagate(program);
+        labels[i].check();
+    }
+    for (size_t i = 0; i < references.size(); i++) {
+        const Reference &reference = references[i];
+        program[reference.node].data.value = new IntegerValue((Integer)labels[reference.label].get_address());
     }
     clear();
 }
@@ -11,22 +11,34 @@ const LabelID undefined_label = (size_t)-1;
 class LabelInfo {
 private:
     std::string name;
-    Value *value;
-    std::vector<size_t> node_indexes;
+    bool defined;
+    bool referenced;
+    size_t address;
 public:
     explicit LabelInfo(const std::string &name="<Anonymous>");
-    void set_value(Value *value);
-    void add_node(size_t idx);
-    void propagate(ProgramNodes &program);
+    void set_address(size_t address);
+    void add_reference();
+    // throws if the label is used but never defined
+    void check() const;
+    size_t get_address() const;
 };
 
+// Every reference is an address node left empty by the parser; propagate()
+// gives each one its own IntegerValue, as every node owns its value.
 class LabelsTable {
 private:
+    struct Reference {
+        LabelID label;
+        size_t node;
+    };
+
     std::vector<LabelInfo> labels;
+    std::vector<Reference> references;
 public:
     void clear();
+    void reserve(size_t labels_count, size_t references_count);
     LabelID new_label();
-    void set_value(LabelID label, Value *value);
+    void set_address(LabelID label, size_t address);
     void add_node(LabelID label, size_t idx);
     void propagate(ProgramNodes &program);
 };
@@ -0,0 +1,373 @@
+#include <algorithm>
+#include <utility>
+#include "layout.h"
+#include "snapshot.h"
+
+BlockProfile::BlockProfile(): expected(0), previous(no_node) {}
+
+BlockProfile::BlockProfile(const Program &program):
+    program_hash(Snapshot::hash(program)), executions(program.get_nodes().size(), 0),
+    taken(program.get_nodes().size(), 0), expected(0), previous(no_node) {}
+
+void BlockProfile::start(size_t pos)
+{
+    expected = pos;
+    previous = no_node;
+}
+
+void BlockProfile::stop(size_t pos)
+{
+    if (previous == no_node) {
+        return;
+    }
+    if (pos == previous) {
+        // a read waiting for input is executed again on resume
+        executions[previous]--;
+    } else if (pos != expected) {
+        // the last jump, taken out of the program or preempted
+        taken[previous]++;
+    }
+}
+
+bool BlockProfile::matches(const Program &program) const
+{
+    return executions.size() == program.get_nodes().size() && program_hash == Snapshot::hash(program);
+}
+
+uint64_t BlockProfile::get_executions(size_t pos) const
+{
+    return executions[pos];
+}
+
+uint64_t BlockProfile::get_taken(size_t pos) const
+{
+    return taken[pos];
+}
+
+bool BlockProfile::save(std::ostream &stream) const
+{
+    stream << "RPNPROF1\n" << program_hash << "\n" << executions.size() << "\n";
+    for (size_t i = 0; i < executions.size(); i++) {
+        if (executions[i] > 0) {
+            stream << i << " " << executions[i] << " " << taken[i] << "\n";
+        }
+    }
+    return stream.good();
+}
+
+bool BlockProfile::load(std::istream &stream)
+{
+    std::string magic;
+    size_t size;
+    if (!(stream >> magic >> program_hash >> size) || magic != "RPNPROF1") {
+        return false;
+    }
+    executions.assign(size, 0);
+    taken.assign(size, 0);
+    size_t pos;
+    uint64_t count, jumps;
+    while (stream >> pos >> count >> jumps) {
+        if (pos >= size || jumps > count) {
+            return false;
+        }
+        executions[pos] = count;
+        taken[pos] = jumps;
+    }
+    return stream.eof();
+}
+
+BlockLayout::BlockLayout(const Program &program, const BlockProfile &profile):
+    program(program), profile(profile) {}
+
+static bool is_jump(const ProgramNode &node)
+{
+    return node.type == ntOperation && node.data.operation == opJump;
+}
+
+bool BlockLayout::split()
+{
+    const ProgramNodes &nodes = program.get_nodes();
+    size_t size = nodes.size();
+    if (size == 0) {
+        return false;
+    }
+    // every jump is "condition; address; opJump", see SyntaxAnalyzer::gen_jump
+    std::vector<bool> leader(size + 1, false);
+    leader[0] = true;
+    for (size_t i = 0; i < size; i++) {
+        if (!is_jump(nodes[i])) {
+            continue;
+        }
+        if (i == 0 || nodes[i - 1].type != ntValue) {
+            return false;
+        }
+        Integer target = nodes[i - 1].data.value->to_integer();
+        if (target < 0 || (size_t)target > size) {
+            return false;
+        }
+        leader[target] = true;
+        leader[i + 1] = true;
+    }
+    for (size_t i = 1; i < size; i++) {
+        // a jump into the middle of another one cannot be moved apart from it
+        if (is_jump(nodes[i]) && (leader[i] || leader[i - 1])) {
+            return false;
+        }
+    }
+
+    std::vector<size_t> index(size + 1, 0);
+    std::vector<size_t> starts;
+    for (size_t i = 0; i < size; i++) {
+        if (leader[i]) {
+            index[i] = starts.size();
+            starts.push_back(i);
+        }
+    }
+    size_t exit = starts.size();
+    index[size] = exit;
+
+    blocks.clear();
+    for (size_t i = 0; i < starts.size(); i++) {
+        size_t start = starts[i], finish = i + 1 < starts.size() ? starts[i + 1] : size;
+        Block block = { start, finish, finish, btFall, index[finish], exit, profile.get_executions(start), 0, 0 };
+        size_t jump = finish - 1;
+        if (is_jump(nodes[jump])) {
+            size_t target = index[nodes[jump - 1].data.value->to_integer()];
+            if (jump >= start + 2 && nodes[jump - 2].type == ntValue &&
+                    nodes[jump - 2].data.value->get_type() == vtBoolean && !nodes[jump - 2].data.value->to_boolean()) {
+                block.terminator = btJump;
+                block.end = jump - 2;
+                block.next = target;
+            } else {
+                uint64_t executed = profile.get_executions(jump), jumped = profile.get_taken(jump);
+                block.terminator = btBranch;
+                block.end = jump - 1;
+                if (block.end > start && nodes[block.end - 1].type == ntOperation &&
+                        nodes[block.end - 1].data.operation == opBoolNot) {
+                    // the negation is folded into the choice of the successor
+                    block.end--;
+                    block.next = target;
+                    block.next_count = jumped;
+                    block.other = index[finish];
+                    block.other_count = executed - jumped;
+                } else {
+                    block.other = target;
+                    block.other_count = jumped;
+                    block.next_count = executed - jumped;
+                }
+            }
+        }
+        blocks.push_back(block);
+    }
+    return true;
+}
+
+// dispatched terminator nodes of a block followed by the given one:
+// "false; address; opJump" for a jump, "address; opJump" for a branch,
+// with opBoolNot before it when the false successor follows
+uint64_t BlockLayout::cost(const Block &block, size_t following)
+{
+    if (block.terminator != btBranch) {
+        return following == block.next ? 0 : 3 * block.count;
+    }
+    uint64_t total = block.next_count + block.other_count;
+    if (following == block.next) {
+        return 2 * total;
+    } else if (following == block.other) {
+        return 3 * total;
+    }
+    return 2 * total + 3 * block.next_count;
+}
+
+std::vector<size_t> BlockLayout::order() const
+{
+    size_t count = blocks.size(), exit = count, none = (size_t)-1;
+    // the weight of an edge is what making it a fall through saves, see cost()
+    std::vector<Edge> edges;
+    for (size_t i = 0; i < count; i++) {
+        const Block &block = blocks[i];
+        if (block.terminator != btBranch) {
+            if (block.next != exit && block.count > 0) {
+                edges.push_back(Edge{ i, block.next, 3 * block.count });
+            }
+            continue;
+        }
+        if (block.next != exit && block.next_count > 0) {
+            edges.push_back(Edge{ i, block.next, 3 * block.next_count });
+        }
+        if (block.other != exit && 2 * block.next_count > block.other_count) {
+            edges.push_back(Edge{ i, block.other, 2 * block.next_count - block.other_count });
+        }
+    }
+    // on a tie a jump goes first: a branch may still fall through to its other successor,
+    // which is what rotates a loop to test at the bottom
+    std::stable_sort(edges.begin(), edges.end(), [this](const Edge &a, const Edge &b) {
+        if (a.weight != b.weight) {
+            return a.weight > b.weight;
+        }
+        return blocks[a.from].terminator != btBranch && blocks[b.from].terminator == btBranch;
+    });
+    // code never executed keeps its original fall throughs
+    for (size_t i = 0; i + 1 < count; i++) {
+        if (blocks[i].next == i + 1 || (blocks[i].terminator == btBranch && blocks[i].other == i + 1)) {
+            edges.push_back(Edge{ i, i + 1, 0 });
+        }
+    }
+
+    std::vector<size_t> successor(count, none), predecessor(count, none), chain(count);
+    for (size_t i = 0; i < count; i++) {
+        chain[i] = i;
+    }
+    auto find = [&chain](size_t block) {
+        while (chain[block] != block) {
+            block = chain[block] = chain[chain[block]];
+        }
+        return block;
+    };
+    for (size_t i = 0; i < edges.size(); i++) {
+        size_t from = edges[i].from, to = edges[i].to;
+        if (successor[from] != none || predecessor[to] != none || find(from) == find(to)) {
+            continue;
+        }
+        successor[from] = to;
+        predecessor[to] = from;
+        chain[find(to)] = find(from);
+    }
+
+    // the chain of the entry first, then the executed ones and the cold ones last,
+    // both in their original order
+    std::vector<size_t> heads;
+    std::vector<bool> hot(count, false);
+    for (size_t i = 0; i < count; i++) {
+        if (blocks[i].count > 0) {
+            hot[find(i)] = true;
+        }
+    }
+    size_t entry = find(0);
+    for (size_t pass = 0; pass < 2; pass++) {
+        for (size_t i = 0; i < count; i++) {
+            if (predecessor[i] == none && hot[find(i)] == (pass == 0) && find(i) != entry) {
+                heads.push_back(i);
+            }
+        }
+    }
+    size_t entry_head = 0;
+    while (predecessor[entry_head] != none) {
+        entry_head = predecessor[entry_head];
+    }
+    heads.insert(heads.begin(), entry_head);
+
+    std::vector<size_t> result;
+    for (size_t i = 0; i < heads.size(); i++) {
+        for (size_t block = heads[i]; block != none; block = successor[block]) {
+            result.push_back(block);
+        }
+    }
+    return result;
+}
+
+Program *BlockLayout::emit(const std::vector<size_t> &order) const
+{
+    const ProgramNodes &nodes = program.get_nodes();
+    const LineTable &source = program.get_lines();
+    size_t exit = blocks.size();
+    ProgramNodes result;
+    LineTable lines;
+    std::vector<size_t> address(blocks.size() + 1, 0);
+    // address nodes and the blocks they are going to point to
+    std::vector<std::pair<size_t, size_t> > fixups;
+
+    auto add = [&](const ProgramNode &node, size_t original) {
+        SourcePosition position = source.find(original);
+        lines.add(result.size(), position.line, position.column);
+        result.push_back(node);
+    };
+    auto add_operation = [&](Operation op, size_t original) {
+        ProgramNode node;
+        node.type = ntOperation;
+        node.data.operation = op;
+        add(node, original);
+    };
+    auto add_jump = [&](size_t target, bool unconditional, size_t original) {
+        ProgramNode node;
+        node.type = ntValue;
+        if (unconditional) {
+            node.data.value = new BooleanValue(false);
+            add(node, original);
+        }
+        node.data.value = NULL;
+        fixups.push_back(std::make_pair(result.size(), target));
+        add(node, original);
+        add_operation(opJump, original);
+    };
+
+    if (order[0] != 0) {
+        add_jump(0, true, 0);
+    }
+    for (size_t i = 0; i < order.size(); i++) {
+        const Block &block = blocks[order[i]];
+        size_t following = i + 1 < order.size() ? order[i + 1] : exit;
+        address[order[i]] = result.size();
+        for (size_t pos = block.start; pos < block.end; pos++) {
+            ProgramNode node = nodes[pos];
+            if (node.type == ntValue) {
+                node.data.value = node.data.value->clone();
+            }
+            add(node, pos);
+        }
+        size_t last = block.finish - 1;
+        if (block.terminator != btBranch) {
+            if (following != block.next) {
+                add_jump(block.next, true, last);
+            }
+        } else if (following == block.next) {
+            add_jump(block.other, false, last);
+        } else if (following == block.other) {
+            add_operation(opBoolNot, last);
+            add_jump(block.next, false, last);
+        } else {
+            add_jump(block.other, false, last);
+            add_jump(block.next, true, last);
+        }
+    }
+    address[exit] = result.size();
+    for (size_t i = 0; i < fixups.size(); i++) {
+        result[fixups[i].first].data.value = new IntegerValue((Integer)address[fixups[i].second]);
+    }
+    return new Program(std::move(result), program.get_variables_count(), std::move(lines));
+}
+
+Program *BlockLayout::process()
+{
+    if (!profile.matches(program) || !split()) {
+        return NULL;
+    }
+    std::vector<size_t> original(blocks.size()), reordered = order();
+    for (size_t i = 0; i < original.size(); i++) {
+        original[i] = i;
+    }
+    // the greedy layout is not always better than the source order
+    uint64_t costs[2] = { reordered[0] != 0 ? (uint64_t)3 : 0, 0 };
+    const std::vector<size_t> *orders[2] = { &reordered, &original };
+    for (size_t k = 0; k < 2; k++) {
+        const std::vector<size_t> &current = *orders[k];
+        for (size_t i = 0; i < current.size(); i++) {
+            size_t following = i + 1 < current.size() ? current[i + 1] : blocks.size();
+            costs[k] += cost(blocks[current[i]], following);
+        }
+    }
+    if (costs[0] >= costs[1]) {
+        return NULL;
+    }
+    return emit(reordered);
+}
+
+Program *layout_program(Program *program, const BlockProfile &profile)
+{
+    Program *result = BlockLayout(*program, profile).process();
+    if (result == NULL) {
+        return program;
+    }
+    delete program;
+    return result;
+}
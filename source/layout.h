@@ -0,0 +1,104 @@
+#ifndef LAYOUT_H
+#define LAYOUT_H
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "program.h"
+
+// Execution counts of every node and taken counts of every jump, recorded
+// by ExecutionContext::run(BlockProfile &) over any number of runs.
+//
+// Text format: the line "RPNPROF1", the program hash (see Snapshot::hash),
+// the number of nodes, then one line "pos executions taken" per executed
+// node.
+class BlockProfile {
+private:
+    static const size_t no_node = (size_t)-1;
+
+    std::string program_hash;
+    std::vector<uint64_t> executions;
+    std::vector<uint64_t> taken;
+    size_t expected;
+    size_t previous;
+public:
+    BlockProfile();
+    explicit BlockProfile(const Program &program);
+    void start(size_t pos);
+    void stop(size_t pos);
+
+    inline void on_node(size_t pos, const ProgramNode &)
+    {
+        if (pos != expected && previous != no_node) {
+            taken[previous]++;
+        }
+        previous = pos;
+        expected = pos + 1;
+        executions[pos]++;
+    }
+
+    // false if the profile was recorded for a different program
+    bool matches(const Program &program) const;
+    uint64_t get_executions(size_t pos) const;
+    uint64_t get_taken(size_t pos) const;
+    bool save(std::ostream &stream) const;
+    bool load(std::istream &stream);
+};
+
+// Reorders the basic blocks of a program after a profile, so that hot
+// successors fall through, loops are rotated to test their condition at
+// the bottom with a single branch, and code never executed in training
+// moves to the end. Jumps are rewritten to their new addresses, a
+// conditional branch is inverted with opBoolNot when its hot successor
+// is the jump target (a trailing opBoolNot is removed instead), and
+// unconditional jumps to the following block disappear. The control flow
+// graph is unchanged, so the unchecked loads stay valid, and every node
+// keeps the source position of the node it was copied from.
+class BlockLayout {
+private:
+    enum Terminator {
+        btFall,
+        btJump,
+        btBranch
+    };
+
+    struct Block {
+        size_t start;
+        // the body ends before the terminator nodes, the block at finish
+        size_t end;
+        size_t finish;
+        Terminator terminator;
+        // the successor on a true condition, or the only one
+        size_t next;
+        // the successor on a false condition
+        size_t other;
+        uint64_t count;
+        uint64_t next_count;
+        uint64_t other_count;
+    };
+
+    struct Edge {
+        size_t from;
+        size_t to;
+        uint64_t weight;
+    };
+
+    const Program &program;
+    const BlockProfile &profile;
+    std::vector<Block> blocks;
+
+    static uint64_t cost(const Block &block, size_t following);
+    bool split();
+    std::vector<size_t> order() const;
+    Program *emit(const std::vector<size_t> &order) const;
+public:
+    BlockLayout(const Program &program, const BlockProfile &profile);
+    // returns a new image, or NULL when the program is left as it is
+    Program *process();
+};
+
+// takes ownership of program and returns either it or its reordered replacement
+Program *layout_program(Program *program, const BlockProfile &profile);
+
+#endif // LAYOUT_H
@@ -13,6 +13,16 @@ const std::string &Lexeme::get_value() const
     return value;
 }
 
+unsigned Lexeme::get_line() const
+{
+    return line;
+}
+
+unsigned Lexeme::get_pos() const
+{
+    return pos;
+}
+
 inline std::string Lexeme::stringify_type() const
 {
     if (type >= ltKeywordsStart && type <= ltKeywordsEnd) {
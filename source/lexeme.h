@@ -87,6 +87,8 @@ public:
     Lexeme(LexemeType type, const std::string &value, unsigned line, unsigned pos);
     LexemeType get_type() const;
     const std::string &get_value() const;
+    unsigned get_line() const;
+    unsigned get_pos() const;
     void print(std::ostream &stream) const;
 };
 
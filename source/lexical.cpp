@@ -1,6 +1,9 @@
 #include <sstream>
+#include <utility>
 #include "exceptions.h"
 #include "lexical.h"
+#include "memory.h"
+#include "probes.h"
 
 LexicalAnalyzer::LexicalAnalyzer(bool case_insensetive, bool alternative_names):
     case_insensetive(case_insensetive), alternative_names(alternative_names),
@@ -12,7 +15,7 @@ LexicalAnalyzer::LexicalAnalyzer(bool case_insensetive, bool alternative_names):
 
 void LexicalAnalyzer::get_next_char()
 {
-    if (!(*input >> std::noskipws >> cur_char)) {
+    if (!input->get(cur_char)) {
         cur_char = '\0';
     }
     if (case_insensetive &&
@@ -41,6 +44,7 @@ void LexicalAnalyzer::buff_char()
 
 void LexicalAnalyzer::push_lexeme(LexemeType type)
 {
+    PROBE4(lexeme, type, lexeme_line, lexeme_column, buff.c_str());
     result.push_back(Lexeme(type, buff, lexeme_line, lexeme_column));
     buff = "";
 }
@@ -416,14 +420,27 @@ void LexicalAnalyzer::process()
 
 void LexicalAnalyzer::parse_stream(std::istream &stream)
 {
+    AllocationScope scope(msLexer);
     input = &stream;
     process();
     input = NULL;
 }
 
+// reads a string in place, where std::istringstream would copy it
+class StringViewBuffer: public std::streambuf {
+public:
+    explicit StringViewBuffer(const std::string &str)
+    {
+        char *data = const_cast<char *>(str.data());
+        setg(data, data, data + str.size());
+    }
+};
+
 void LexicalAnalyzer::parse_string(const std::string &str)
 {
-    std::istringstream stream(str);
+    AllocationScope scope(msLexer);
+    StringViewBuffer buffer(str);
+    std::istream stream(&buffer);
     parse_stream(stream);
 }
 
@@ -434,3 +451,12 @@ const LexemeArray &LexicalAnalyzer::get_lexemes() const
     }
     return result;
 }
+
+LexemeArray LexicalAnalyzer::take_lexemes()
+{
+    if (!ready) {
+        throw std::runtime_error("Attempt to get lexems from analyzer in error state");
+    }
+    ready = false;
+    return std::move(result);
+}
@@ -62,6 +62,8 @@ public:
     void parse_stream(std::istream &stream);
     void parse_string(const std::string &str);
     const LexemeArray &get_lexemes() const;
+    // moves the lexemes out, the analyzer has none until the next parse
+    LexemeArray take_lexemes();
 };
 
 #endif // LEXICAL_H
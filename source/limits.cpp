@@ -0,0 +1,106 @@
+#include <mutex>
+#include <sstream>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include "limits.h"
+
+ExecutionLimits::ExecutionLimits(): max_steps(0), max_time(0), max_memory(0) {}
+
+bool ExecutionLimits::any() const
+{
+    return max_steps != 0 || max_time > 0 || max_memory != 0;
+}
+
+// the SIGALRM action of the host, in effect while no timer is armed
+static std::mutex handler_mutex;
+static size_t handler_users = 0;
+static struct sigaction previous_action;
+
+static void on_timer(int signal, siginfo_t *info, void *context)
+{
+    if (info->si_code == SI_TIMER && info->si_value.sival_ptr != NULL) {
+        *(volatile sig_atomic_t *)info->si_value.sival_ptr = lfTime;
+        return;
+    }
+    // alarms that are not ours carry no flag and go to the host's handler
+    if (previous_action.sa_flags & SA_SIGINFO) {
+        previous_action.sa_sigaction(signal, info, context);
+    } else if (previous_action.sa_handler != SIG_DFL && previous_action.sa_handler != SIG_IGN) {
+        previous_action.sa_handler(signal);
+    }
+}
+
+// the handler is installed while any timer is armed
+static void acquire_handler()
+{
+    std::lock_guard<std::mutex> lock(handler_mutex);
+    if (handler_users++ == 0) {
+        struct sigaction action = {};
+        action.sa_sigaction = on_timer;
+        action.sa_flags = SA_SIGINFO | SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGALRM, &action, &previous_action);
+    }
+}
+
+static void release_handler()
+{
+    std::lock_guard<std::mutex> lock(handler_mutex);
+    if (--handler_users == 0) {
+        sigaction(SIGALRM, &previous_action, NULL);
+    }
+}
+
+LimitTimer::LimitTimer(): armed(false) {}
+
+bool LimitTimer::arm(double seconds, volatile sig_atomic_t *flag)
+{
+    disarm();
+    acquire_handler();
+    sigevent event = {};
+    event.sigev_signo = SIGALRM;
+    event.sigev_value.sival_ptr = (void *)flag;
+#ifdef SIGEV_THREAD_ID
+    event.sigev_notify = SIGEV_THREAD_ID;
+    event._sigev_un._tid = syscall(SYS_gettid);
+#else
+    event.sigev_notify = SIGEV_SIGNAL;
+#endif
+    if (timer_create(CLOCK_MONOTONIC, &event, &timer) != 0) {
+        release_handler();
+        return false;
+    }
+    armed = true;
+    itimerspec spec = {};
+    spec.it_value.tv_sec = (time_t)seconds;
+    spec.it_value.tv_nsec = (long)((seconds - (double)spec.it_value.tv_sec) * 1e9);
+    if (spec.it_value.tv_sec == 0 && spec.it_value.tv_nsec == 0) {
+        spec.it_value.tv_nsec = 1;
+    }
+    return timer_settime(timer, 0, &spec, NULL) == 0;
+}
+
+void LimitTimer::disarm()
+{
+    if (armed) {
+        // a signal already sent to this thread is delivered before timer_delete returns
+        timer_delete(timer);
+        armed = false;
+        release_handler();
+    }
+}
+
+LimitTimer::~LimitTimer()
+{
+    disarm();
+}
+
+std::string describe_usage(const ResourceUsage &usage, const ExecutionLimits &limits)
+{
+    std::ostringstream result;
+    result << "steps " << usage.steps << ", time " << usage.time << " s";
+    if (limits.max_memory != 0) {
+        result << ", memory " << usage.memory << " bytes";
+    }
+    return result.str();
+}
@@ -0,0 +1,62 @@
+#ifndef LIMITS_H
+#define LIMITS_H
+
+#include <csignal>
+#include <cstddef>
+#include <ctime>
+#include <string>
+
+// Resource limits of one run of ExecutionContext, zero means unlimited.
+// Steps are charged on backward jumps only, with the length of the jumped
+// over code, like the run() slice. Time is the wall time spent inside
+// run(), so a context waiting for feed_input() is not charged; a context
+// reading an input stream is charged for a blocking read, but the read is
+// not interrupted and the limit stops the program only after it. Memory is
+// the peak of the heap allocated inside run(), and is only counted when
+// the executable reports its allocations to memory.h (see allocator.cpp).
+struct ExecutionLimits {
+    size_t max_steps;
+    double max_time;
+    size_t max_memory;
+
+    ExecutionLimits();
+    bool any() const;
+};
+
+// resources consumed since the last reset of a context; the heap costs a
+// malloc_usable_size() per allocation, so memory is metered only when limited
+struct ResourceUsage {
+    size_t steps;
+    double time;
+    size_t memory;
+};
+
+// what the signal handler and the heap counters report through the flag polled on backward jumps
+enum LimitFlag {
+    lfNone,
+    lfTime,
+    lfMemory
+};
+
+// Stores lfTime to a flag when a thread has run for the given time. The
+// expiration signal is sent to the thread that armed the timer, so it is
+// delivered before disarm() returns and never reaches a dead flag. The
+// SIGALRM handler is installed while any timer is armed, passes other
+// alarms to the previous action and restores it after the last disarm().
+class LimitTimer {
+private:
+    timer_t timer;
+    bool armed;
+public:
+    LimitTimer();
+    LimitTimer(const LimitTimer &) = delete;
+    LimitTimer &operator=(const LimitTimer &) = delete;
+    bool arm(double seconds, volatile sig_atomic_t *flag);
+    void disarm();
+    ~LimitTimer();
+};
+
+// "steps N, time T s, memory M bytes", without memory when it is not limited
+std::string describe_usage(const ResourceUsage &usage, const ExecutionLimits &limits);
+
+#endif // LIMITS_H
@@ -0,0 +1,49 @@
+#include <algorithm>
+#include "lines.h"
+
+void LineTable::add(size_t node, unsigned line, unsigned column)
+{
+    if (!entries.empty()) {
+        Entry &last = entries.back();
+        if (last.position.line == line && last.position.column == column) {
+            return;
+        }
+        if (last.node == node) {
+            last.position = { line, column };
+            return;
+        }
+    }
+    entries.push_back({ node, { line, column } });
+}
+
+void LineTable::reserve(size_t count)
+{
+    entries.reserve(count);
+}
+
+SourcePosition LineTable::find(size_t node) const
+{
+    std::vector<Entry>::const_iterator entry = std::upper_bound(entries.begin(), entries.end(), node,
+        [](size_t node, const Entry &entry) {
+            return node < entry.node;
+        });
+    if (entry == entries.begin()) {
+        return { 0, 0 };
+    }
+    return (entry - 1)->position;
+}
+
+LineTable LineTable::shifted(size_t offset) const
+{
+    LineTable result;
+    result.add(0, 0, 0);
+    for (size_t i = 0; i < entries.size(); i++) {
+        result.add(entries[i].node + offset, entries[i].position.line, entries[i].position.column);
+    }
+    return result;
+}
+
+size_t LineTable::size() const
+{
+    return entries.size();
+}
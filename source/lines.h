@@ -0,0 +1,33 @@
+#ifndef LINES_H
+#define LINES_H
+
+#include <vector>
+
+struct SourcePosition {
+    // line 0 means the node has no source, e.g. it was generated by an optimization
+    unsigned line;
+    unsigned column;
+};
+
+// Maps node indices of a compiled program to the source position of the
+// statement they were generated for. Nodes of one statement are consecutive,
+// so only the first node of every run is stored.
+class LineTable {
+private:
+    struct Entry {
+        size_t node;
+        SourcePosition position;
+    };
+
+    std::vector<Entry> entries;
+public:
+    // nodes must be added in increasing order
+    void add(size_t node, unsigned line, unsigned column);
+    void reserve(size_t count);
+    SourcePosition find(size_t node) const;
+    // the same table for a program with offset nodes without source inserted at its start
+    LineTable shifted(size_t offset) const;
+    size_t size() const;
+};
+
+#endif // LINES_H
@@ -0,0 +1,464 @@
+#include <cstdlib>
+#include "lockstep.h"
+
+const size_t LockstepEngine::lanes;
+
+static const size_t unknown_depth = (size_t)-1;
+
+static inline bool is_operation(const ProgramNode &node, Operation op)
+{
+    return node.type == ntOperation && node.data.operation == op;
+}
+
+static const size_t lanes = LockstepEngine::lanes;
+
+struct LaneValues {
+    // integers and booleans share ints, the type tells them apart
+    Integer ints[lanes];
+    Real reals[lanes];
+    ValueType types[lanes];
+};
+
+template <typename T>
+static inline T lane_get(const LaneValues &values, size_t lane);
+
+template <>
+inline Integer lane_get<Integer>(const LaneValues &values, size_t lane)
+{
+    return values.types[lane] == vtReal ? (Integer)values.reals[lane] : values.ints[lane];
+}
+
+template <>
+inline Real lane_get<Real>(const LaneValues &values, size_t lane)
+{
+    return values.types[lane] == vtReal ? values.reals[lane] : (Real)values.ints[lane];
+}
+
+template <>
+inline Boolean lane_get<Boolean>(const LaneValues &values, size_t lane)
+{
+    return values.types[lane] == vtReal ? values.reals[lane] != 0 : values.ints[lane] != 0;
+}
+
+// writes are blended with the old contents instead of branching on the mask,
+// since lanes outside of it keep their own values in the same stack slots
+static inline void lane_set(LaneValues &values, size_t lane, bool mask, ValueType type, Integer value)
+{
+    values.ints[lane] = mask ? value : values.ints[lane];
+    values.types[lane] = mask ? type : values.types[lane];
+}
+
+static inline void lane_set(LaneValues &values, size_t lane, bool mask, ValueType type, Real value)
+{
+    values.reals[lane] = mask ? value : values.reals[lane];
+    values.types[lane] = mask ? type : values.types[lane];
+}
+
+static inline void lane_copy(LaneValues &to, const LaneValues &from, size_t lane, bool mask)
+{
+    to.ints[lane] = mask ? from.ints[lane] : to.ints[lane];
+    to.reals[lane] = mask ? from.reals[lane] : to.reals[lane];
+    to.types[lane] = mask ? from.types[lane] : to.types[lane];
+}
+
+template <typename Operand, typename Function>
+static inline void lanes_unary(LaneValues &values, const bool *mask, ValueType type, Function function)
+{
+    for (size_t lane = 0; lane < lanes; lane++) {
+        lane_set(values, lane, mask[lane], type, function(lane_get<Operand>(values, lane)));
+    }
+}
+
+template <typename Operand, typename Function>
+static inline void lanes_binary(LaneValues &left, const LaneValues &right, const bool *mask,
+                                ValueType type, Function function)
+{
+    for (size_t lane = 0; lane < lanes; lane++) {
+        lane_set(left, lane, mask[lane], type,
+                 function(lane_get<Operand>(left, lane), lane_get<Operand>(right, lane)));
+    }
+}
+
+LockstepEngine::LockstepEngine(const Program &program):
+    program(program.get_nodes()), variables_count(program.get_variables_count()), max_depth(0)
+{
+    supported = analyze();
+}
+
+bool LockstepEngine::is_supported() const
+{
+    return supported;
+}
+
+bool LockstepEngine::analyze()
+{
+    // lanes advanced together share one stack pointer, so the stack depth
+    // has to be a function of the program counter
+    size_t length = program.size();
+    depths.assign(length + 1, unknown_depth);
+    std::vector<size_t> worklist(1, 0);
+    depths[0] = 0;
+
+    while (!worklist.empty()) {
+        size_t pos = worklist.back();
+        worklist.pop_back();
+        if (pos == length) {
+            continue;
+        }
+        const ProgramNode &node = program[pos];
+        size_t depth = depths[pos];
+        size_t next_depth;
+        size_t successors[2] = { pos + 1, unknown_depth };
+
+        if (depth > max_depth) {
+            max_depth = depth;
+        }
+        if (node.type == ntValue) {
+            ValueType type = node.data.value->get_type();
+            if (type == vtString && (pos + 1 == length || !is_operation(program[pos + 1], opWrite))) {
+                return false;
+            }
+            next_depth = depth + 1;
+        } else {
+            size_t pops;
+            size_t pushes = 1;
+            switch (node.data.operation) {
+            case opClearStack:
+                pops = depth;
+                pushes = 0;
+                break;
+            case opJump:
+                if (pos == 0 || program[pos - 1].type != ntValue) {
+                    return false;
+                }
+                successors[1] = program[pos - 1].data.value->to_integer();
+                if (successors[1] > length) {
+                    return false;
+                }
+                pops = 2;
+                pushes = 0;
+                break;
+            case opSaveVariable:
+                pops = 2;
+                break;
+            case opWrite:
+                pops = 1;
+                pushes = 0;
+                break;
+            case opWriteLn:
+                pops = 0;
+                pushes = 0;
+                break;
+            case opReadLn:
+                if (pos + 1 == length || !(is_operation(program[pos + 1], opIntPlusUn) ||
+                                           is_operation(program[pos + 1], opRealPlusUn))) {
+                    return false;
+                }
+                pops = 0;
+                break;
+            case opDup:
+                pops = 1;
+                pushes = 2;
+                break;
+            case opLoadVariable:
+            case opLoadVariableUnchecked:
+                pops = 1;
+                break;
+            case opStrPlus:
+            case opStrPlusUn:
+            case opStrSm:
+            case opStrGr:
+            case opStrEq:
+            case opStrNotEq:
+                return false;
+            default:
+                pops = operation_is_unary(node.data.operation) ? 1 : 2;
+                break;
+            }
+            if (depth < pops) {
+                return false;
+            }
+            next_depth = depth - pops + pushes;
+        }
+
+        for (size_t i = 0; i < 2 && successors[i] != unknown_depth; i++) {
+            size_t next = successors[i];
+            if (depths[next] == unknown_depth) {
+                depths[next] = next_depth;
+                worklist.push_back(next);
+            } else if (depths[next] != next_depth) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void LockstepEngine::execute(std::istream *const *inputs, std::ostream *const *outputs,
+                             size_t count, RuntimeStatus *statuses) const
+{
+    std::vector<LaneValues> stack(max_depth + 1);
+    std::vector<LaneValues> variables(variables_count);
+    size_t pcs[lanes];
+    bool alive[lanes];
+    bool mask[lanes];
+    size_t length = program.size();
+    String lines[lanes];
+
+    for (VariableID id = 0; id < variables_count; id++) {
+        for (size_t lane = 0; lane < lanes; lane++) {
+            variables[id].types[lane] = vtNone;
+        }
+    }
+    for (size_t lane = 0; lane < lanes; lane++) {
+        pcs[lane] = 0;
+        alive[lane] = lane < count && length > 0;
+        if (lane < count) {
+            statuses[lane] = rsOk;
+        }
+    }
+
+    while (true) {
+        // the lanes at the lowest program counter go first, so the ones
+        // that took a forward jump wait for the others to catch up
+        size_t pos = length;
+        for (size_t lane = 0; lane < lanes; lane++) {
+            if (alive[lane] && pcs[lane] < pos) {
+                pos = pcs[lane];
+            }
+        }
+        if (pos == length) {
+            break;
+        }
+        for (size_t lane = 0; lane < lanes; lane++) {
+            mask[lane] = alive[lane] && pcs[lane] == pos;
+        }
+
+        const ProgramNode &node = program[pos];
+        size_t depth = depths[pos];
+        size_t next = pos + 1;
+
+        if (node.type == ntValue) {
+            ValueType type = node.data.value->get_type();
+            if (type == vtString) {
+                // fused with the following opWrite, see analyze()
+                String data = node.data.value->to_string();
+                for (size_t lane = 0; lane < lanes; lane++) {
+                    if (mask[lane]) {
+                        *outputs[lane] << data;
+                    }
+                }
+                next = pos + 2;
+            } else {
+                LaneValues &top = stack[depth];
+                if (type == vtReal) {
+                    Real value = node.data.value->to_real();
+                    for (size_t lane = 0; lane < lanes; lane++) {
+                        lane_set(top, lane, mask[lane], type, value);
+                    }
+                } else {
+                    Integer value = node.data.value->to_integer();
+                    for (size_t lane = 0; lane < lanes; lane++) {
+                        lane_set(top, lane, mask[lane], type, value);
+                    }
+                }
+            }
+        } else {
+            Operation op = node.data.operation;
+            LaneValues *a = depth >= 2 ? &stack[depth - 2] : NULL;
+            LaneValues *b = depth >= 1 ? &stack[depth - 1] : NULL;
+            VariableID id;
+            size_t target;
+
+            switch (op) {
+            case opClearStack:
+            case opWriteLn:
+                if (op == opWriteLn) {
+                    for (size_t lane = 0; lane < lanes; lane++) {
+                        if (mask[lane]) {
+                            *outputs[lane] << "\n";
+                        }
+                    }
+                }
+                break;
+            case opJump:
+                target = program[pos - 1].data.value->to_integer();
+                for (size_t lane = 0; lane < lanes; lane++) {
+                    if (mask[lane]) {
+                        pcs[lane] = lane_get<Boolean>(*a, lane) ? pos + 1 : target;
+                    }
+                }
+                continue;
+            case opLoadVariable:
+            case opLoadVariableUnchecked:
+                id = program[pos - 1].data.value->to_integer();
+                for (size_t lane = 0; lane < lanes; lane++) {
+                    if (!mask[lane]) {
+                        continue;
+                    }
+                    if (variables[id].types[lane] == vtNone) {
+                        statuses[lane] = rsUninitializedVariable;
+                        alive[lane] = false;
+                        mask[lane] = false;
+                        continue;
+                    }
+                    lane_copy(*b, variables[id], lane, true);
+                }
+                break;
+            case opSaveVariable:
+                id = program[pos - 1].data.value->to_integer();
+                for (size_t lane = 0; lane < lanes; lane++) {
+                    lane_copy(variables[id], *a, lane, mask[lane]);
+                }
+                break;
+            case opWrite:
+                for (size_t lane = 0; lane < lanes; lane++) {
+                    if (!mask[lane]) {
+                        continue;
+                    }
+                    switch (b->types[lane]) {
+                    case vtReal:
+                        *outputs[lane] << RealValue(b->reals[lane]).to_string();
+                        break;
+                    case vtBoolean:
+                        *outputs[lane] << BooleanValue(b->ints[lane] != 0).to_string();
+                        break;
+                    default:
+                        *outputs[lane] << IntegerValue(b->ints[lane]).to_string();
+                        break;
+                    }
+                }
+                break;
+            case opReadLn:
+                // fused with the following conversion, see analyze()
+                b = &stack[depth];
+                for (size_t lane = 0; lane < lanes; lane++) {
+                    if (!mask[lane]) {
+                        continue;
+                    }
+                    std::getline(*inputs[lane], lines[lane]);
+                    if (is_operation(program[pos + 1], opIntPlusUn)) {
+                        lane_set(*b, lane, true, vtInteger, (Integer)atoll(lines[lane].c_str()));
+                    } else {
+                        lane_set(*b, lane, true, vtReal, (Real)atof(lines[lane].c_str()));
+                    }
+                }
+                next = pos + 2;
+                break;
+            case opDup:
+                for (size_t lane = 0; lane < lanes; lane++) {
+                    lane_copy(stack[depth], *b, lane, mask[lane]);
+                }
+                break;
+            case opIntPlusUn:
+                lanes_unary<Integer>(*b, mask, vtInteger, [](Integer x) { return x; });
+                break;
+            case opIntMinusUn:
+                lanes_unary<Integer>(*b, mask, vtInteger, [](Integer x) { return -x; });
+                break;
+            case opRealPlusUn:
+                lanes_unary<Real>(*b, mask, vtReal, [](Real x) { return x; });
+                break;
+            case opRealMinusUn:
+                lanes_unary<Real>(*b, mask, vtReal, [](Real x) { return -x; });
+                break;
+            case opBoolPlusUn:
+                lanes_unary<Boolean>(*b, mask, vtBoolean, [](Boolean x) { return (Integer)x; });
+                break;
+            case opBoolNot:
+                lanes_unary<Boolean>(*b, mask, vtBoolean, [](Boolean x) { return (Integer)!x; });
+                break;
+            case opIntPlus:
+                lanes_binary<Integer>(*a, *b, mask, vtInteger, [](Integer x, Integer y) { return x + y; });
+                break;
+            case opIntMinus:
+                lanes_binary<Integer>(*a, *b, mask, vtInteger, [](Integer x, Integer y) { return x - y; });
+                break;
+            case opIntMul:
+                lanes_binary<Integer>(*a, *b, mask, vtInteger, [](Integer x, Integer y) { return x * y; });
+                break;
+            case opIntDiv:
+            case opIntMod:
+                // may fail on a single lane, so handled one lane at a time
+                for (size_t lane = 0; lane < lanes; lane++) {
+                    if (!mask[lane]) {
+                        continue;
+                    }
+                    Integer left = lane_get<Integer>(*a, lane);
+                    Integer right = lane_get<Integer>(*b, lane);
+                    if (right == 0) {
+                        statuses[lane] = rsDivideByZero;
+                        alive[lane] = false;
+                        mask[lane] = false;
+                        continue;
+                    }
+                    lane_set(*a, lane, true, vtInteger, op == opIntDiv ? left / right : left % right);
+                }
+                break;
+            case opIntSm:
+                lanes_binary<Integer>(*a, *b, mask, vtBoolean, [](Integer x, Integer y) { return (Integer)(x < y); });
+                break;
+            case opIntGr:
+                lanes_binary<Integer>(*a, *b, mask, vtBoolean, [](Integer x, Integer y) { return (Integer)(x > y); });
+                break;
+            case opIntSmEq:
+                lanes_binary<Integer>(*a, *b, mask, vtBoolean, [](Integer x, Integer y) { return (Integer)(x <= y); });
+                break;
+            case opIntGrEq:
+                lanes_binary<Integer>(*a, *b, mask, vtBoolean, [](Integer x, Integer y) { return (Integer)(x >= y); });
+                break;
+            case opIntEq:
+                lanes_binary<Integer>(*a, *b, mask, vtBoolean, [](Integer x, Integer y) { return (Integer)(x == y); });
+                break;
+            case opIntNotEq:
+                lanes_binary<Integer>(*a, *b, mask, vtBoolean, [](Integer x, Integer y) { return (Integer)(x != y); });
+                break;
+            case opBoolAnd:
+                lanes_binary<Boolean>(*a, *b, mask, vtBoolean, [](Boolean x, Boolean y) { return (Integer)(x && y); });
+                break;
+            case opBoolOr:
+                lanes_binary<Boolean>(*a, *b, mask, vtBoolean, [](Boolean x, Boolean y) { return (Integer)(x || y); });
+                break;
+            case opRealPlus:
+                lanes_binary<Real>(*a, *b, mask, vtReal, [](Real x, Real y) { return x + y; });
+                break;
+            case opRealMinus:
+                lanes_binary<Real>(*a, *b, mask, vtReal, [](Real x, Real y) { return x - y; });
+                break;
+            case opRealMul:
+                lanes_binary<Real>(*a, *b, mask, vtReal, [](Real x, Real y) { return x * y; });
+                break;
+            case opRealDiv:
+                lanes_binary<Real>(*a, *b, mask, vtReal, [](Real x, Real y) { return x / y; });
+                break;
+            case opRealSm:
+                lanes_binary<Real>(*a, *b, mask, vtBoolean, [](Real x, Real y) { return (Integer)(x < y); });
+                break;
+            case opRealGr:
+                lanes_binary<Real>(*a, *b, mask, vtBoolean, [](Real x, Real y) { return (Integer)(x > y); });
+                break;
+            case opRealSmEq:
+                lanes_binary<Real>(*a, *b, mask, vtBoolean, [](Real x, Real y) { return (Integer)(x <= y); });
+                break;
+            case opRealGrEq:
+                lanes_binary<Real>(*a, *b, mask, vtBoolean, [](Real x, Real y) { return (Integer)(x >= y); });
+                break;
+            case opRealEq:
+                lanes_binary<Real>(*a, *b, mask, vtBoolean, [](Real x, Real y) { return (Integer)(x == y); });
+                break;
+            case opRealNotEq:
+                lanes_binary<Real>(*a, *b, mask, vtBoolean, [](Real x, Real y) { return (Integer)(x != y); });
+                break;
+            default:
+                // string operations are rejected by analyze()
+                break;
+            }
+        }
+
+        for (size_t lane = 0; lane < lanes; lane++) {
+            if (mask[lane]) {
+                pcs[lane] = next;
+            }
+        }
+    }
+}
@@ -0,0 +1,37 @@
+#ifndef LOCKSTEP_H
+#define LOCKSTEP_H
+
+#include <iostream>
+#include <vector>
+#include "program.h"
+
+// Executes up to `lanes` instances of one numeric program side by side.
+// Values are kept unboxed in structure-of-arrays form, one element per
+// lane, so every instruction is dispatched once for all the lanes that
+// reached it. Lanes that diverge at a jump get their own program counters;
+// the lanes at the lowest one are advanced together under a mask, which
+// lets them reconverge where the branches meet.
+//
+// Only programs without string processing are supported: string constants
+// may only be written directly and read() may only target numeric
+// variables. Check is_supported() before executing.
+class LockstepEngine {
+public:
+    static const size_t lanes = 8;
+private:
+    const ProgramNodes &program;
+    VariableID variables_count;
+    bool supported;
+    std::vector<size_t> depths;
+    size_t max_depth;
+
+    bool analyze();
+public:
+    explicit LockstepEngine(const Program &program);
+    bool is_supported() const;
+    // runs count <= lanes instances; statuses receives the result of every lane
+    void execute(std::istream *const *inputs, std::ostream *const *outputs, size_t count,
+                 RuntimeStatus *statuses) const;
+};
+
+#endif // LOCKSTEP_H
@@ -1,19 +1,69 @@
+#include <algorithm>
 #include <iostream>
+#include <cstdlib>
 #include <sstream>
 #include <fstream>
+#include <filesystem>
+#include <iterator>
+#include <thread>
 #include "exceptions.h"
 #include "lexical.h"
 #include "syntax.h"
 #include "program.h"
+#include "context.h"
+#include "batch.h"
+#include "evaluator.h"
+#include "snapshot.h"
+#include "profiler.h"
+#include "stats.h"
+#include "perf.h"
+#include "memory.h"
+#include "trace.h"
+#include "layout.h"
+#include "speculate.h"
+#include "server.h"
 
 static bool dump_lexemes = false;
 static bool dump_rpn = false;
 static bool infinite = false;
 
+static std::string batch_path = "";
+static std::string batch_output = "";
+// hardware_concurrency() is 0 when it is unknown
+static size_t jobs = std::max(1u, std::thread::hardware_concurrency());
+static bool lockstep = false;
+
+static std::string serve_path = "";
+
+static std::string snapshot_path = "";
+static std::string restore_path = "";
+
+static bool profile_ops = false;
+static std::string profile_ops_json = "";
+static bool profile_lines = false;
+static LineProfiler::Mode profile_lines_mode = LineProfiler::pmExact;
+static std::string profile_collapsed = "";
+
+static bool profile_memory = false;
+static std::string profile_memory_timeline = "";
+
+static std::string trace_path = "";
+
+static std::string profile_generate_path = "";
+static std::string profile_use_path = "";
+
+static ExecutionLimits limits;
+
+static bool stats = false;
+static bool stats_json = false;
+static bool stats_counters = false;
+
 static bool case_insensetive = false;
 static bool alternative_names = false;
 static bool comparison_chains = true;
 static bool lazy_evaluations = false;
+static bool precompute = false;
+static bool speculate = false;
 
 inline void hr()
 {
@@ -30,6 +80,55 @@ void show_help()
     std::cout << "--dump-lexemes - display tokenized program" << std::endl;
     std::cout << "--dump-rpn     - display RPN representation of a program" << std::endl;
     std::cout << "--infinite     - interpretate program over and over again" << std::endl;
+    std::cout << "--batch PATH   - run program for every file in directory PATH (or every " \
+        "file listed in manifest PATH) and report latencies to stderr" << std::endl;
+    std::cout << "--batch-output DIR - write output of every batch input to DIR/NAME.out " \
+        "instead of merging them into console output" << std::endl;
+    std::cout << "--jobs N       - number of threads for --batch and --serve" << std::endl;
+    std::cout << "--lockstep     - run --batch inputs of a numeric program side by side, " \
+        "several inputs per thread" << std::endl;
+    std::cout << "--serve SOCKET - run as a daemon executing programs sent over unix " \
+        "socket SOCKET (see tools/client.cpp)" << std::endl;
+    std::cout << "--precompute   - execute the part of a program preceding the first " \
+        "read at compile time" << std::endl;
+    std::cout << "--speculate    - profile the first steps of a run, then specialize hot loops " \
+        "for the values their variables keep, with guards falling back to generic code; " \
+        "not available with --stats, profiling, tracing, --batch and --serve" << std::endl;
+    std::cout << "--snapshot-at-read FILE - save execution state to FILE when the program " \
+        "first reads input, then continue" << std::endl;
+    std::cout << "--restore FILE - start execution (every one with --infinite) from " \
+        "the snapshot in FILE" << std::endl;
+    std::cout << "--profile-ops  - count executed operations, their cycles and most frequent " \
+        "sequences, report to stderr" << std::endl;
+    std::cout << "--profile-ops-json FILE - same as --profile-ops, also export the profile " \
+        "to FILE as JSON" << std::endl;
+    std::cout << "--profile-lines - count executions and cycles of every source line and " \
+        "loop, report annotated source to stderr" << std::endl;
+    std::cout << "--profile-lines-sampling - same as --profile-lines, but sample the " \
+        "running line every millisecond of CPU time instead" << std::endl;
+    std::cout << "--profile-collapsed FILE - write the line profile to FILE in collapsed " \
+        "stack format for flame graphs" << std::endl;
+    std::cout << "--profile-memory - attribute heap allocations to subsystems, operations " \
+        "and value types, report the peak breakdown and largest variables to stderr" << std::endl;
+    std::cout << "--profile-memory-timeline FILE - same as --profile-memory, also write " \
+        "the heap size sampled every 10 ms of execution to FILE as CSV" << std::endl;
+    std::cout << "--profile-generate FILE - count executions of every basic block and " \
+        "branch direction, write them to FILE" << std::endl;
+    std::cout << "--profile-use FILE - reorder basic blocks after the counts in FILE so " \
+        "that hot paths fall through and loops test at the bottom" << std::endl;
+    std::cout << "--trace FILE   - record executed instructions and I/O timings to FILE " \
+        "(see tools/trace.cpp); not available with profiling" << std::endl;
+    std::cout << "--max-steps N  - stop the program once its loops have executed N " \
+        "instructions" << std::endl;
+    std::cout << "--max-time SECONDS - stop the program once it has run for SECONDS; " \
+        "a blocking read() is not interrupted, the program stops after it returns" << std::endl;
+    std::cout << "--max-memory BYTES - stop the program once its heap has grown by BYTES" << std::endl;
+    std::cout << "--stats        - report time of every phase, program size, executed " \
+        "instructions, memory and I/O to stderr; not available with profiling " \
+        "and tracing" << std::endl;
+    std::cout << "--stats-json   - same as --stats, in JSON" << std::endl;
+    std::cout << "--stats-counters - same as --stats, also count cycles, instructions, " \
+        "branch and cache misses of every phase with hardware performance counters" << std::endl;
     std::cout << "--case-insensetive" << std::endl;
     std::cout << "--case-sensetive [default]" << std::endl;
     std::cout << "--lazy-evaluations" << std::endl;
@@ -51,16 +150,227 @@ std::string read_program()
     return result;
 }
 
+// with heap, the heap counters of all jobs are added to it
+void execute_batch(const Program &program, HeapCounters *heap)
+{
+    BatchRunner runner(program, jobs, lockstep);
+    runner.set_heap_tracking(heap != NULL);
+    bool loaded;
+    if (std::filesystem::is_directory(batch_path)) {
+        loaded = runner.add_directory(batch_path);
+    } else {
+        loaded = runner.add_manifest(batch_path);
+    }
+    if (!loaded) {
+        std::cout << "Error: could not open batch inputs." << std::endl;
+        return;
+    }
+    runner.run(batch_output, std::cout, std::cerr);
+    if (heap) {
+        HeapCounters jobs_heap = runner.get_heap();
+        heap->total += jobs_heap.total;
+        heap->allocations += jobs_heap.allocations;
+        heap->peak = std::max(heap->peak, jobs_heap.peak);
+    }
+}
+
+// runs the program up to its first read and saves the state to snapshot_path
+bool take_snapshot(const Program &program, Snapshot &snapshot)
+{
+    std::ostringstream output;
+    ExecutionContext context(program, output);
+    RuntimeStatus status = context.run();
+    if (status != rsOk && status != rsWaitingInput) {
+        std::cout << output.str();
+        throw_runtime_status(status);
+    }
+    snapshot.capture(context, output.str());
+    std::ofstream file(snapshot_path, std::ios::binary);
+    if (!file.is_open() || !snapshot.save(file)) {
+        std::cout << "Error: could not write snapshot." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool load_snapshot(const Program &program, Snapshot &snapshot)
+{
+    std::ifstream file(restore_path, std::ios::binary);
+    if (!file.is_open() || !snapshot.load(file)) {
+        std::cout << "Error: could not read snapshot." << std::endl;
+        return false;
+    }
+    if (!snapshot.matches(program)) {
+        std::cout << "Error: snapshot was taken from another program." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// reorders program after the profile in profile_use_path
+Program *use_profile(Program *program)
+{
+    std::ifstream file(profile_use_path);
+    BlockProfile profile;
+    if (!file.is_open() || !profile.load(file)) {
+        std::cout << "Error: could not read profile." << std::endl;
+        return program;
+    }
+    if (!profile.matches(*program)) {
+        std::cout << "Error: profile was recorded for another program." << std::endl;
+        return program;
+    }
+    return layout_program(program, profile);
+}
+
+// counts the bytes passing through a standard stream while in scope
+class StreamCounter {
+private:
+    std::ios &stream;
+    CountingBuffer buffer;
+public:
+    explicit StreamCounter(std::ios &stream): stream(stream), buffer(stream.rdbuf())
+    {
+        stream.rdbuf(&buffer);
+    }
+
+    size_t get_bytes() const
+    {
+        return buffer.get_bytes();
+    }
+
+    ~StreamCounter()
+    {
+        stream.rdbuf(buffer.get_source());
+    }
+};
+
+void run_once(ExecutionContext &context, const Snapshot *snapshot, OperationProfiler *profiler,
+              LineProfiler *line_profiler, MemoryProfiler *memory_profiler, ExecutionTracer *tracer,
+              BlockProfile *block_profile, RuntimeStats *runtime, SpeculativeTier *tier)
+{
+    RuntimeStatus status;
+    if (snapshot == NULL) {
+        context.reset();
+    } else {
+        snapshot->restore(context, std::cout);
+    }
+    if (line_profiler != NULL) {
+        status = context.run(*line_profiler);
+    } else if (profiler != NULL) {
+        status = context.run(*profiler);
+    } else if (memory_profiler != NULL) {
+        status = context.run(*memory_profiler);
+    } else if (tracer != NULL) {
+        status = context.run(*tracer);
+    } else if (block_profile != NULL) {
+        status = context.run(*block_profile);
+    } else if (runtime != NULL) {
+        status = context.run(*runtime);
+    } else if (tier != NULL) {
+        status = context.run(*tier);
+    } else {
+        status = context.run();
+    }
+    context.throw_status(status);
+}
+
+void report_profile(const OperationProfiler &profiler)
+{
+    std::cout.flush();
+    profiler.print(std::cerr);
+    if (profile_ops_json != "") {
+        std::ofstream file(profile_ops_json);
+        if (!file.is_open()) {
+            std::cerr << "Error: could not write profile." << std::endl;
+            return;
+        }
+        profiler.print_json(file);
+    }
+}
+
+void report_lines(const LineProfiler &profiler, const std::string &source)
+{
+    std::cout.flush();
+    profiler.print(std::cerr, source);
+    if (profile_collapsed != "") {
+        std::ofstream file(profile_collapsed);
+        if (!file.is_open()) {
+            std::cerr << "Error: could not write profile." << std::endl;
+            return;
+        }
+        profiler.print_collapsed(file);
+    }
+}
+
+void report_memory(const MemoryProfiler &profiler, const VariablesTable &variables)
+{
+    std::vector<std::string> names;
+    for (VariableID i = 0; i < variables.size(); i++) {
+        names.push_back(variables.get_name(i));
+    }
+    std::cout.flush();
+    profiler.print(std::cerr, names);
+    if (profile_memory_timeline != "") {
+        std::ofstream file(profile_memory_timeline);
+        if (!file.is_open()) {
+            std::cerr << "Error: could not write profile." << std::endl;
+            return;
+        }
+        profiler.print_timeline(file);
+    }
+}
+
+void report_stats(const StatsReport &report)
+{
+    std::cout.flush();
+    if (stats_json) {
+        report.print_json(std::cerr);
+    } else {
+        report.print(std::cerr);
+    }
+}
+
 void execute(std::istream &stream)
 {
     LexicalAnalyzer lexical(case_insensetive, alternative_names);
     SyntaxAnalyzer syntax(comparison_chains, lazy_evaluations);
     Program *program = NULL;
     LexemeArray lexemes;
+    OperationProfiler *profiler = profile_ops ? new OperationProfiler() : NULL;
+    LineProfiler *line_profiler = NULL;
+    MemoryProfiler *memory_profiler = profile_memory ? new MemoryProfiler() : NULL;
+    ExecutionTracer *tracer = NULL;
+    BlockProfile *block_profile = NULL;
+    SpeculativeTier *tier = NULL;
+    StatsReport *report = stats ? new StatsReport() : NULL;
+    StreamCounter *input = NULL, *output = NULL;
+    PerfCounters *counters = NULL;
+    if (report && stats_counters) {
+        counters = new PerfCounters();
+        report->counters = counters->open();
+        if (!counters->hardware()) {
+            report->counters_note = counters->get_error();
+        }
+        perf_counters_install(counters);
+    }
+    PhaseTimer timer;
+    // kept for the annotated line profile
+    std::string source((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
 
+    // --batch jobs run on worker threads and are counted separately
+    HeapCounters batch_heap = { 0, 0, 0, 0 };
+    if (report || memory_profiler) {
+        heap_tracking_start(memory_profiler);
+    }
     try {
-        lexical.parse_stream(stream);
-        lexemes = lexical.get_lexemes();
+        timer.restart();
+        lexical.parse_string(source);
+        lexemes = lexical.take_lexemes();
+        if (report) {
+            report->phases[spLex] = timer.elapsed();
+            report->lexemes = lexemes.size();
+        }
         if (dump_lexemes) {
             std::cout << "Lexemes:" << std::endl;
             for (size_t i = 0; i < lexemes.size(); i++) {
@@ -69,23 +379,155 @@ void execute(std::istream &stream)
             }
             hr();
         }
+        timer.restart();
         program = syntax.parse(lexemes);
+        if (report) {
+            report->phases[spLabels] = syntax.get_propagation_time();
+            report->phases[spParse] = timer.elapsed() - report->phases[spLabels];
+        }
+        if (precompute) {
+            timer.restart();
+            program = precompute_program(program);
+            if (report) {
+                report->phases[spPrecompute] = timer.elapsed();
+            }
+        }
+        if (profile_use_path != "") {
+            program = use_profile(program);
+        }
+        if (report) {
+            report->nodes = program->get_nodes().size();
+            report->variables = program->get_variables_count();
+        }
         if (dump_rpn) {
             program->print(std::cout);
             hr();
         }
-        program->execute(std::cin, std::cout);
-        while (infinite) {
-            hr();
-            program->execute(std::cin, std::cout);
+        if (profile_lines) {
+            line_profiler = new LineProfiler(*program, profile_lines_mode);
         }
-        delete program;
-    } catch (const Exception &e) {
-        if (program) {
-            delete program;
+        if (profile_generate_path != "") {
+            block_profile = new BlockProfile(*program);
+        }
+        if (speculate) {
+            tier = new SpeculativeTier(*program);
+        }
+        if (trace_path != "") {
+            tracer = new ExecutionTracer();
+            if (!tracer->open(trace_path)) {
+                std::cout << "Error: could not write trace." << std::endl;
+                delete tracer;
+                tracer = NULL;
+            }
+        }
+        if (report) {
+            input = new StreamCounter(std::cin);
+            output = new StreamCounter(std::cout);
         }
+        timer.restart();
+        if (batch_path != "") {
+            execute_batch(*program, report ? &batch_heap : NULL);
+        } else {
+            Snapshot snapshot;
+            const Snapshot *start = NULL;
+            bool ready = true;
+            RuntimeStats *runtime = report ? &report->runtime : NULL;
+            if (snapshot_path != "") {
+                ready = take_snapshot(*program, snapshot);
+                start = &snapshot;
+            } else if (restore_path != "") {
+                ready = load_snapshot(*program, snapshot);
+                start = &snapshot;
+            }
+            if (ready) {
+                ExecutionContext context(*program, std::cin, std::cout);
+                context.set_limits(limits);
+                run_once(context, start, profiler, line_profiler, memory_profiler, tracer, block_profile,
+                         runtime, tier);
+                while (infinite) {
+                    hr();
+                    run_once(context, start, profiler, line_profiler, memory_profiler, tracer, block_profile,
+                             runtime, tier);
+                }
+            }
+        }
+    } catch (const Exception &e) {
         std::cout << e.what() << std::endl;
     }
+    // the execution phase ends with its error message, if any
+    if (output) {
+        report->phases[spExecute] = timer.elapsed();
+        report->bytes_read = input->get_bytes();
+        report->bytes_written = output->get_bytes();
+        delete input;
+        delete output;
+    }
+    // live blocks are reported as of the end of execution
+    HeapCounters heap = heap_counters();
+    heap_tracking_stop();
+    if (memory_profiler) {
+        report_memory(*memory_profiler, syntax.get_variables());
+        delete memory_profiler;
+    }
+    if (tracer) {
+        if (!tracer->close()) {
+            std::cerr << "Error: could not write trace." << std::endl;
+        }
+        delete tracer;
+    }
+    if (block_profile) {
+        std::ofstream file(profile_generate_path);
+        if (!file.is_open() || !block_profile->save(file)) {
+            std::cerr << "Error: could not write profile." << std::endl;
+        }
+        delete block_profile;
+    }
+    if (tier) {
+        delete tier;
+    }
+    if (line_profiler) {
+        report_lines(*line_profiler, source);
+        delete line_profiler;
+    }
+    if (program) {
+        delete program;
+    }
+    if (profiler) {
+        report_profile(*profiler);
+        delete profiler;
+    }
+    if (report) {
+        report->heap_peak = std::max(heap.peak, batch_heap.peak);
+        report->heap_total = heap.total + batch_heap.total;
+        report->heap_allocations = heap.allocations + batch_heap.allocations;
+        report_stats(*report);
+        delete report;
+    }
+    if (counters) {
+        perf_counters_install(NULL);
+        delete counters;
+    }
+}
+
+void serve()
+{
+    ServerOptions options;
+    options.jobs = jobs;
+    options.max_programs = 256;
+    options.max_program_size = 16 << 20;
+    options.max_input_size = 16 << 20;
+    options.max_output_size = 64 << 20;
+    options.case_insensetive = case_insensetive;
+    options.alternative_names = alternative_names;
+    options.comparison_chains = comparison_chains;
+    options.lazy_evaluations = lazy_evaluations;
+    options.precompute = precompute;
+    options.limits = limits;
+
+    Server server(serve_path, options);
+    if (!server.serve()) {
+        std::cout << "Error: could not listen on " << serve_path << "." << std::endl;
+    }
 }
 
 int main(int argc, char **argv)
@@ -106,6 +548,58 @@ int main(int argc, char **argv)
                 dump_rpn = true;
             } else if (current == "--infinite") {
                 infinite = true;
+            } else if (current == "--batch" && i + 1 < argc) {
+                batch_path = argv[++i];
+            } else if (current == "--batch-output" && i + 1 < argc) {
+                batch_output = argv[++i];
+            } else if (current == "--serve" && i + 1 < argc) {
+                serve_path = argv[++i];
+            } else if (current == "--snapshot-at-read" && i + 1 < argc) {
+                snapshot_path = argv[++i];
+            } else if (current == "--restore" && i + 1 < argc) {
+                restore_path = argv[++i];
+            } else if (current == "--profile-ops") {
+                profile_ops = true;
+            } else if (current == "--profile-ops-json" && i + 1 < argc) {
+                profile_ops = true;
+                profile_ops_json = argv[++i];
+            } else if (current == "--profile-lines") {
+                profile_lines = true;
+            } else if (current == "--profile-lines-sampling") {
+                profile_lines = true;
+                profile_lines_mode = LineProfiler::pmSampling;
+            } else if (current == "--profile-collapsed" && i + 1 < argc) {
+                profile_lines = true;
+                profile_collapsed = argv[++i];
+            } else if (current == "--profile-memory") {
+                profile_memory = true;
+            } else if (current == "--profile-memory-timeline" && i + 1 < argc) {
+                profile_memory = true;
+                profile_memory_timeline = argv[++i];
+            } else if (current == "--profile-generate" && i + 1 < argc) {
+                profile_generate_path = argv[++i];
+            } else if (current == "--profile-use" && i + 1 < argc) {
+                profile_use_path = argv[++i];
+            } else if (current == "--trace" && i + 1 < argc) {
+                trace_path = argv[++i];
+            } else if (current == "--max-steps" && i + 1 < argc) {
+                limits.max_steps = strtoull(argv[++i], NULL, 10);
+            } else if (current == "--max-time" && i + 1 < argc) {
+                limits.max_time = atof(argv[++i]);
+            } else if (current == "--max-memory" && i + 1 < argc) {
+                limits.max_memory = strtoull(argv[++i], NULL, 10);
+            } else if (current == "--stats") {
+                stats = true;
+            } else if (current == "--stats-json") {
+                stats = true;
+                stats_json = true;
+            } else if (current == "--stats-counters") {
+                stats = true;
+                stats_counters = true;
+            } else if (current == "--jobs" && i + 1 < argc) {
+                jobs = std::max(1ul, strtoul(argv[++i], NULL, 10));
+            } else if (current == "--lockstep") {
+                lockstep = true;
             } else if (current == "--case-insensetive") {
                 case_insensetive = true;
             } else if (current == "--case-sensetive") {
@@ -118,6 +612,10 @@ int main(int argc, char **argv)
                 comparison_chains = true;
             } else if (current == "--disallow-cmpchains") {
                 comparison_chains = false;
+            } else if (current == "--precompute") {
+                precompute = true;
+            } else if (current == "--speculate") {
+                speculate = true;
             } else if (current == "--lazy-evaluations") {
                 lazy_evaluations = true;
             } else if (current == "--greed-evaluations") {
@@ -131,7 +629,28 @@ int main(int argc, char **argv)
             }
         }
     }
-    if (program_specified) {
+    // the tier runs its own loop, which has no hooks for the others
+    if (speculate && (stats || profile_ops || profile_lines || profile_memory || trace_path != "" ||
+                      profile_generate_path != "" || batch_path != "" || serve_path != "")) {
+        std::cout << "Error: --speculate cannot be combined with --stats, profiling, tracing, " \
+            "--batch or --serve." << std::endl;
+        return 1;
+    }
+    // run_once drives one hooked loop, so the statistics would count nothing
+    if (stats && (profile_ops || profile_lines || profile_memory || trace_path != "" ||
+                  profile_generate_path != "")) {
+        std::cout << "Error: --stats cannot be combined with profiling or tracing." << std::endl;
+        return 1;
+    }
+    // the profilers take precedence in run_once and would leave the trace empty
+    if (trace_path != "" && (profile_ops || profile_lines || profile_memory ||
+                             profile_generate_path != "")) {
+        std::cout << "Error: --trace cannot be combined with profiling." << std::endl;
+        return 1;
+    }
+    if (serve_path != "") {
+        serve();
+    } else if (program_specified) {
         std::ifstream stream(argv[1]);
         if (stream.is_open()) {
             execute(stream);
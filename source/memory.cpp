@@ -0,0 +1,320 @@
+#include <algorithm>
+#include <iomanip>
+#include <malloc.h>
+#include "memory.h"
+
+thread_local AllocationTag allocation_tag = { msOther, 0, vtNone };
+
+// counting is on while either started or metered
+static thread_local bool tracking = false;
+static thread_local bool started = false;
+static thread_local HeapCounters counters = { 0, 0, 0, 0 };
+static thread_local MemoryProfiler *tracker = NULL;
+static thread_local HeapMeter *meter = NULL;
+
+static const char *subsystem_names[msCount] = { "other", "lexer", "parser", "labels", "runtime" };
+static const char *type_names[MemoryProfiler::types_count] = { "none", "integer", "string", "boolean", "real" };
+
+AllocationScope::AllocationScope(MemorySubsystem subsystem): saved(allocation_tag)
+{
+    allocation_tag.subsystem = subsystem;
+}
+
+AllocationScope::~AllocationScope()
+{
+    allocation_tag = saved;
+}
+
+void heap_tracking_start(MemoryProfiler *profiler)
+{
+    counters = HeapCounters{ 0, 0, 0, 0 };
+    tracker = profiler;
+    started = true;
+    tracking = true;
+}
+
+void heap_tracking_stop()
+{
+    started = false;
+    tracking = meter != NULL;
+    tracker = NULL;
+}
+
+HeapCounters heap_counters()
+{
+    return counters;
+}
+
+HeapMeter::HeapMeter(): current(0), peak(0), limit((size_t)-1), flag(NULL), value(0) {}
+
+void heap_meter_attach(HeapMeter *attached)
+{
+    meter = attached;
+    tracking = true;
+    if (meter->current > meter->limit) {
+        *meter->flag = meter->value;
+    }
+}
+
+void heap_meter_detach()
+{
+    meter = NULL;
+    tracking = started;
+}
+
+void heap_allocated(void *pointer)
+{
+    if (!tracking || pointer == NULL) {
+        return;
+    }
+    size_t usable = malloc_usable_size(pointer);
+    counters.current += usable;
+    counters.total += usable;
+    counters.allocations++;
+    if (counters.current > counters.peak) {
+        counters.peak = counters.current;
+    }
+    if (meter != NULL) {
+        meter->current += usable;
+        if (meter->current > meter->peak) {
+            meter->peak = meter->current;
+            if (meter->peak > meter->limit) {
+                *meter->flag = meter->value;
+            }
+        }
+    }
+    if (tracker != NULL) {
+        tracker->record(pointer, usable, counters);
+    }
+}
+
+void heap_released(void *pointer)
+{
+    if (!tracking || pointer == NULL) {
+        return;
+    }
+    size_t usable = malloc_usable_size(pointer);
+    // blocks allocated before the tracking started are not subtracted below zero
+    counters.current -= std::min(usable, counters.current);
+    if (meter != NULL) {
+        meter->current -= std::min(usable, meter->current);
+    }
+    if (tracker != NULL) {
+        tracker->forget(pointer);
+    }
+}
+
+// size of a value with the heap it owns
+static size_t value_size(const Value *value)
+{
+    return value == NULL ? 0 : malloc_usable_size((void *)value) + value->heap_size();
+}
+
+MemoryProfiler::MemoryProfiler(double interval):
+    usage(keys_count, Usage{ 0, 0, 0 }), peak_live(keys_count, 0), peak(0), interval(interval),
+    started(false), next_sample(0), instructions(0), largest_sample(0), saved_tag(allocation_tag)
+{
+    blocks.reserve(1024);
+    timeline.reserve(1024);
+}
+
+size_t MemoryProfiler::tag_key(const AllocationTag &tag)
+{
+    if (tag.subsystem != msRuntime) {
+        return tag.subsystem;
+    }
+    return msCount + tag.operation * types_count + tag.type;
+}
+
+ValueType MemoryProfiler::created_type(const ProgramNode &node, const std::vector<Value *> &stack,
+                                       const std::vector<Value *> &variables)
+{
+    if (node.type == ntValue) {
+        return node.data.value->get_type();
+    }
+    Operation op = node.data.operation;
+    size_t id;
+    switch (op) {
+    case opLoadVariable:
+    case opLoadVariableUnchecked:
+        if (stack.empty()) {
+            return vtNone;
+        }
+        id = stack.back()->to_integer();
+        return id < variables.size() && variables[id] != NULL ? variables[id]->get_type() : vtNone;
+    case opSaveVariable:
+        return stack.size() >= 2 ? stack[stack.size() - 2]->get_type() : vtNone;
+    case opWrite:
+    case opDup:
+        return stack.empty() ? vtNone : stack.back()->get_type();
+    case opReadLn:
+    case opStrPlus:
+    case opStrPlusUn:
+        return vtString;
+    case opClearStack:
+    case opJump:
+    case opWriteLn:
+        return vtNone;
+    default:
+        break;
+    }
+    if ((op >= opIntSm && op <= opIntNotEq) || (op >= opStrSm && op <= opStrNotEq) ||
+        (op >= opBoolPlusUn && op <= opBoolOr) || (op >= opRealSm && op <= opRealNotEq)) {
+        return vtBoolean;
+    }
+    return op < opStrPlus ? vtInteger : vtReal;
+}
+
+void MemoryProfiler::record(void *pointer, size_t size, const HeapCounters &counters)
+{
+    size_t key = tag_key(allocation_tag);
+    Usage &entry = usage[key];
+    entry.allocations++;
+    entry.total += size;
+    entry.live += size;
+    blocks[pointer] = Block{ size, key };
+    if (counters.current > peak) {
+        peak = counters.current;
+        for (size_t i = 0; i < keys_count; i++) {
+            peak_live[i] = usage[i].live;
+        }
+    }
+}
+
+void MemoryProfiler::forget(void *pointer)
+{
+    auto block = blocks.find(pointer);
+    if (block == blocks.end()) {
+        return;
+    }
+    Usage &entry = usage[block->second.key];
+    entry.live -= std::min(entry.live, block->second.size);
+    blocks.erase(block);
+}
+
+void MemoryProfiler::start()
+{
+    if (!started) {
+        started = true;
+        start_time = Clock::now();
+    }
+    saved_tag = allocation_tag;
+    allocation_tag.subsystem = msRuntime;
+}
+
+void MemoryProfiler::stop(const std::vector<Value *> &variables)
+{
+    sample(variables);
+    allocation_tag = saved_tag;
+}
+
+void MemoryProfiler::sample(const std::vector<Value *> &variables)
+{
+    double time = std::chrono::duration<double>(Clock::now() - start_time).count();
+    if (time < next_sample && !timeline.empty()) {
+        return;
+    }
+    next_sample = time + interval;
+    Sample current = { time, instructions, heap_counters().current };
+    if (timeline.empty() || current.heap > timeline[largest_sample].heap) {
+        largest_sample = timeline.size();
+        variables_at_largest.resize(variables.size());
+        for (size_t i = 0; i < variables.size(); i++) {
+            variables_at_largest[i] = value_size(variables[i]);
+        }
+    }
+    timeline.push_back(current);
+}
+
+void MemoryProfiler::print_usage(std::ostream &stream, const char *name, const Usage &total, size_t at_peak) const
+{
+    stream << std::left << std::setw(24) << name << std::right << std::setw(14) << total.allocations
+           << std::setw(16) << total.total << std::setw(14) << at_peak << std::setw(14) << total.live << std::endl;
+}
+
+void MemoryProfiler::print(std::ostream &stream, const std::vector<std::string> &names, size_t limit) const
+{
+    std::vector<Usage> by_operation(operations_count + 1, Usage{ 0, 0, 0 });
+    std::vector<size_t> operation_peak(operations_count + 1, 0);
+    Usage by_type[types_count] = {}, runtime = { 0, 0, 0 };
+    size_t type_peak[types_count] = {}, runtime_peak = 0;
+    for (size_t key = msCount; key < keys_count; key++) {
+        size_t operation = (key - msCount) / types_count, type = (key - msCount) % types_count;
+        Usage *targets[] = { &by_operation[operation], &by_type[type], &runtime };
+        size_t *peaks[] = { &operation_peak[operation], &type_peak[type], &runtime_peak };
+        for (size_t i = 0; i < 3; i++) {
+            targets[i]->allocations += usage[key].allocations;
+            targets[i]->total += usage[key].total;
+            targets[i]->live += usage[key].live;
+            *peaks[i] += peak_live[key];
+        }
+    }
+
+    stream << "Memory profile: heap peak " << peak << " bytes" << std::endl;
+    stream << std::left << std::setw(24) << "subsystem" << std::right << std::setw(14) << "allocations"
+           << std::setw(16) << "total bytes" << std::setw(14) << "at peak" << std::setw(14) << "at exit" << std::endl;
+    for (size_t i = 0; i < msCount; i++) {
+        if (i == msRuntime) {
+            print_usage(stream, subsystem_names[i], runtime, runtime_peak);
+        } else {
+            print_usage(stream, subsystem_names[i], usage[i], peak_live[i]);
+        }
+    }
+
+    stream << "Runtime allocations by value type:" << std::endl;
+    for (size_t i = 0; i < types_count; i++) {
+        if (by_type[i].allocations > 0) {
+            print_usage(stream, type_names[i], by_type[i], type_peak[i]);
+        }
+    }
+
+    std::vector<size_t> order;
+    for (size_t i = 0; i <= operations_count; i++) {
+        if (by_operation[i].allocations > 0) {
+            order.push_back(i);
+        }
+    }
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return by_operation[a].total > by_operation[b].total;
+    });
+    stream << "Runtime allocations by operation:" << std::endl;
+    for (size_t i = 0; i < order.size() && i < limit; i++) {
+        size_t key = order[i];
+        print_usage(stream, key == push_key ? "Push" : operation_name((Operation)key),
+                    by_operation[key], operation_peak[key]);
+    }
+
+    if (timeline.empty()) {
+        return;
+    }
+    const Sample &largest = timeline[largest_sample];
+    stream << "Timeline: " << timeline.size() << " samples, largest heap " << largest.heap
+           << " bytes at " << std::fixed << std::setprecision(1) << largest.time * 1000 << " ms" << std::endl;
+    stream.unsetf(std::ios::floatfield);
+    order.clear();
+    for (size_t i = 0; i < variables_at_largest.size(); i++) {
+        if (variables_at_largest[i] > 0) {
+            order.push_back(i);
+        }
+    }
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return variables_at_largest[a] > variables_at_largest[b];
+    });
+    stream << "Largest variables at that moment:" << std::endl;
+    for (size_t i = 0; i < order.size() && i < limit; i++) {
+        size_t id = order[i];
+        std::string name = id < names.size() && names[id] != "" ? names[id] : "#" + std::to_string(id);
+        stream << std::left << std::setw(24) << name << std::right << std::setw(14)
+               << variables_at_largest[id] << std::endl;
+    }
+}
+
+void MemoryProfiler::print_timeline(std::ostream &stream) const
+{
+    stream << "ms,instructions,heap_bytes" << std::endl;
+    stream << std::fixed << std::setprecision(3);
+    for (size_t i = 0; i < timeline.size(); i++) {
+        stream << timeline[i].time * 1000 << "," << timeline[i].instructions << "," << timeline[i].heap << std::endl;
+    }
+    stream.unsetf(std::ios::floatfield);
+}
@@ -0,0 +1,196 @@
+#ifndef MEMORY_H
+#define MEMORY_H
+
+#include <chrono>
+#include <csignal>
+#include <cstddef>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "program.h"
+
+// Heap usage of the calling thread, in bytes as reported by
+// malloc_usable_size. allocator.cpp replaces the global operator new and
+// delete to report every block here, so it is linked into executables only
+// (the interpreter and the stress tool), never into the library: nothing
+// is counted until heap_tracking_start() is called.
+struct HeapCounters {
+    size_t current;
+    size_t peak;
+    size_t total;
+    size_t allocations;
+};
+
+enum MemorySubsystem {
+    msOther,
+    msLexer,
+    msParser,
+    msLabels,
+    msRuntime,
+    msCount
+};
+
+// what the allocations of the calling thread are currently made for;
+// operation and type are set during execution only
+struct AllocationTag {
+    MemorySubsystem subsystem;
+    size_t operation;
+    ValueType type;
+};
+
+extern thread_local AllocationTag allocation_tag;
+
+// attributes the allocations of the calling thread to subsystem while in scope
+class AllocationScope {
+private:
+    AllocationTag saved;
+public:
+    explicit AllocationScope(MemorySubsystem subsystem);
+    AllocationScope(const AllocationScope &) = delete;
+    AllocationScope &operator=(const AllocationScope &) = delete;
+    ~AllocationScope();
+};
+
+// the profiler's own bookkeeping must not be counted, so it bypasses operator new
+template <typename T>
+struct MallocAllocator {
+    typedef T value_type;
+
+    MallocAllocator() = default;
+    template <typename U>
+    MallocAllocator(const MallocAllocator<U> &) {}
+
+    T *allocate(size_t count)
+    {
+        T *result = (T *)malloc(count * sizeof(T));
+        if (result == NULL) {
+            throw std::bad_alloc();
+        }
+        return result;
+    }
+
+    void deallocate(T *pointer, size_t)
+    {
+        free(pointer);
+    }
+
+    template <typename U>
+    bool operator==(const MallocAllocator<U> &) const
+    {
+        return true;
+    }
+
+    template <typename U>
+    bool operator!=(const MallocAllocator<U> &) const
+    {
+        return false;
+    }
+};
+
+// Attributes every heap block to the subsystem that allocated it and, for
+// runtime values, to the executed operation and the type of the created
+// value. Keeps a timeline of the heap size sampled during execution, the
+// breakdown at the heap peak and the sizes of the variables at the largest
+// sample. Installed with heap_tracking_start(), its on_node is called by
+// ExecutionContext::run(MemoryProfiler &).
+class MemoryProfiler {
+public:
+    static const size_t push_key = operations_count;
+    static const size_t types_count = vtReal + 1;
+    static const size_t keys_count = msCount + (operations_count + 1) * types_count;
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Usage {
+        size_t allocations;
+        size_t total;
+        size_t live;
+    };
+
+    struct Block {
+        size_t size;
+        size_t key;
+    };
+
+    struct Sample {
+        double time;
+        size_t instructions;
+        size_t heap;
+    };
+
+    std::vector<Usage> usage;
+    std::vector<size_t> peak_live;
+    size_t peak;
+    std::unordered_map<void *, Block, std::hash<void *>, std::equal_to<void *>,
+                       MallocAllocator<std::pair<void * const, Block> > > blocks;
+
+    double interval;
+    bool started;
+    Clock::time_point start_time;
+    double next_sample;
+    size_t instructions;
+    std::vector<Sample, MallocAllocator<Sample> > timeline;
+    size_t largest_sample;
+    std::vector<size_t, MallocAllocator<size_t> > variables_at_largest;
+    AllocationTag saved_tag;
+
+    static size_t tag_key(const AllocationTag &tag);
+    static ValueType created_type(const ProgramNode &node, const std::vector<Value *> &stack,
+                                  const std::vector<Value *> &variables);
+    void sample(const std::vector<Value *> &variables);
+    void print_usage(std::ostream &stream, const char *name, const Usage &total, size_t at_peak) const;
+public:
+    // interval is the period of the timeline, in seconds
+    explicit MemoryProfiler(double interval=0.01);
+    void record(void *pointer, size_t size, const HeapCounters &counters);
+    void forget(void *pointer);
+    void start();
+    void stop(const std::vector<Value *> &variables);
+
+    inline void on_node(const ProgramNode &node, const std::vector<Value *> &stack,
+                        const std::vector<Value *> &variables)
+    {
+        allocation_tag.operation = node.type == ntValue ? push_key : node.data.operation;
+        allocation_tag.type = created_type(node, stack, variables);
+        // the clock is read on every 256th node only
+        if (++instructions % 256 == 0) {
+            sample(variables);
+        }
+    }
+
+    // names are indexed by variable id, see SyntaxAnalyzer::get_variables()
+    void print(std::ostream &stream, const std::vector<std::string> &names, size_t limit=20) const;
+    // one sample per line: milliseconds, executed nodes, heap bytes
+    void print_timeline(std::ostream &stream) const;
+};
+
+// resets the counters of the calling thread and starts counting; with
+// a profiler, every block is also reported to it
+void heap_tracking_start(MemoryProfiler *profiler=NULL);
+void heap_tracking_stop();
+HeapCounters heap_counters();
+
+// Heap of one owner, counted only while attached to the calling thread, so
+// that an owner running in slices among others is charged for its own
+// blocks alone. Once current exceeds limit, value is stored to *flag.
+struct HeapMeter {
+    size_t current;
+    size_t peak;
+    size_t limit;
+    volatile sig_atomic_t *flag;
+    sig_atomic_t value;
+
+    HeapMeter();
+};
+
+// counting is on while a meter is attached, even without heap_tracking_start()
+void heap_meter_attach(HeapMeter *meter);
+void heap_meter_detach();
+
+// called by the replaced operator new and delete
+void heap_allocated(void *pointer);
+void heap_released(void *pointer);
+
+#endif // MEMORY_H
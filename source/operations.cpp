@@ -10,7 +10,7 @@ bool operation_is_unary(Operation op)
         op == opBoolNot;
 }
 
-Value *operation_execute(Operation op, Value *left)
+Value *operation_execute(Operation op, Value *left, RuntimeStatus &status)
 {
     switch (op) {
     case opIntPlusUn:
@@ -28,11 +28,12 @@ Value *operation_execute(Operation op, Value *left)
     case opBoolNot:
         return new BooleanValue(not left->to_boolean());;
     default:
-        throw std::runtime_error("Unknown unary operation");
+        status = rsUnknownUnaryOperation;
+        return NULL;
     }
 }
 
-Value *operation_execute(Operation op, Value *left, Value *right)
+Value *operation_execute(Operation op, Value *left, Value *right, RuntimeStatus &status)
 {
     switch (op) {
     case opIntPlus:
@@ -43,12 +44,14 @@ Value *operation_execute(Operation op, Value *left, Value *right)
         return new IntegerValue(left->to_integer() * right->to_integer());
     case opIntDiv:
         if (right->to_integer() == 0) {
-            throw InterpretationError("Divide by zero.");
+            status = rsDivideByZero;
+            return NULL;
         }
         return new IntegerValue(left->to_integer() / right->to_integer());
     case opIntMod:
         if (right->to_integer() == 0) {
-            throw InterpretationError("Divide by zero.");
+            status = rsDivideByZero;
+            return NULL;
         }
         return new IntegerValue(left->to_integer() % right->to_integer());
     case opIntSm:
@@ -98,6 +101,69 @@ Value *operation_execute(Operation op, Value *left, Value *right)
     case opRealNotEq:
         return new BooleanValue(left->to_real() != right->to_real());
     default:
-        throw std::runtime_error("Unknown binary operation");
+        status = rsUnknownBinaryOperation;
+        return NULL;
+    }
+}
+
+const char *operation_name(Operation op)
+{
+    static const char *names[operations_count] = {
+        "ClearStack", "Jump", "LoadVariable", "LoadVariableUnchecked",
+        "SaveVariable", "Write", "WriteLn", "ReadLn",
+        "Dup", "IntPlus", "IntPlusUn", "IntMinus",
+        "IntMinusUn", "IntMul", "IntDiv", "IntMod",
+        "IntSm", "IntGr", "IntSmEq", "IntGrEq",
+        "IntEq", "IntNotEq", "StrPlus", "StrPlusUn",
+        "StrSm", "StrGr", "StrEq", "StrNotEq",
+        "BoolPlusUn", "BoolNot", "BoolAnd", "BoolOr",
+        "RealPlus", "RealPlusUn", "RealMinus", "RealMinusUn",
+        "RealMul", "RealDiv", "RealSm", "RealGr",
+        "RealSmEq", "RealGrEq", "RealEq", "RealNotEq",
+        "Guard"
+    };
+    return (size_t)op < operations_count ? names[op] : "Unknown";
+}
+
+const char *runtime_status_message(RuntimeStatus status)
+{
+    switch (status) {
+    case rsDivideByZero:
+        return "Divide by zero.";
+    case rsUninitializedVariable:
+        return "Uninitialized variable used.";
+    case rsEmptyStack:
+        return "The stack is empty";
+    case rsUnknownUnaryOperation:
+        return "Unknown unary operation";
+    case rsUnknownBinaryOperation:
+        return "Unknown binary operation";
+    case rsStepLimit:
+        return "Step limit exceeded.";
+    case rsTimeLimit:
+        return "Time limit exceeded.";
+    case rsMemoryLimit:
+        return "Memory limit exceeded.";
+    default:
+        return "";
+    }
+}
+
+void throw_runtime_status(RuntimeStatus status)
+{
+    switch (status) {
+    case rsOk:
+    case rsWaitingInput:
+    case rsPreempted:
+        return;
+    case rsDivideByZero:
+    case rsUninitializedVariable:
+        throw InterpretationError(runtime_status_message(status));
+    case rsStepLimit:
+    case rsTimeLimit:
+    case rsMemoryLimit:
+        throw LimitExceeded(runtime_status_message(status));
+    default:
+        throw std::runtime_error(runtime_status_message(status));
     }
 }
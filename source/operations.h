@@ -7,6 +7,7 @@ enum Operation {
     opClearStack,
     opJump,
     opLoadVariable,
+    opLoadVariableUnchecked,
     opSaveVariable,
     opWrite,
     opWriteLn,
@@ -50,11 +51,39 @@ enum Operation {
     opRealSmEq,
     opRealGrEq,
     opRealEq,
-    opRealNotEq
+    opRealNotEq,
+
+    // "value; variable; address; opGuard" jumps to address unless the variable
+    // holds value, only emitted by SpeculativeTier (see speculate.h)
+    opGuard
+};
+
+// number of operations, keep in sync with the last one
+const size_t operations_count = opGuard + 1;
+
+enum RuntimeStatus {
+    rsOk,
+    // the run is not finished but can be resumed
+    rsWaitingInput,
+    rsPreempted,
+    // errors
+    rsDivideByZero,
+    rsUninitializedVariable,
+    rsEmptyStack,
+    rsUnknownUnaryOperation,
+    rsUnknownBinaryOperation,
+    // a limit set with ExecutionContext::set_limits() is exceeded
+    rsStepLimit,
+    rsTimeLimit,
+    rsMemoryLimit
 };
 
 bool operation_is_unary(Operation op);
-Value *operation_execute(Operation op, Value *left);
-Value *operation_execute(Operation op, Value *left, Value *right);
+// both return NULL and set status if the operation fails
+Value *operation_execute(Operation op, Value *left, RuntimeStatus &status);
+Value *operation_execute(Operation op, Value *left, Value *right, RuntimeStatus &status);
+const char *operation_name(Operation op);
+const char *runtime_status_message(RuntimeStatus status);
+void throw_runtime_status(RuntimeStatus status);
 
 #endif // OPERATIONS_H
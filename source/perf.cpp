@@ -0,0 +1,148 @@
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+#include "perf.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif
+
+static const char *event_names[peCount] = {
+    "cycles", "instructions", "branch-misses", "L1d-misses", "LLC-misses", "task-clock"
+};
+
+static std::atomic<const PerfCounters *> installed(NULL);
+
+PerfValues operator+(const PerfValues &left, const PerfValues &right)
+{
+    PerfValues result;
+    for (size_t i = 0; i < peCount; i++) {
+        result.counts[i] = left.counts[i] + right.counts[i];
+        result.valid[i] = left.valid[i] && right.valid[i];
+    }
+    return result;
+}
+
+PerfValues operator-(const PerfValues &left, const PerfValues &right)
+{
+    PerfValues result;
+    for (size_t i = 0; i < peCount; i++) {
+        result.counts[i] = left.counts[i] - right.counts[i];
+        result.valid[i] = left.valid[i] && right.valid[i];
+    }
+    return result;
+}
+
+const char *perf_event_name(PerfEvent event)
+{
+    return event_names[event];
+}
+
+PerfCounters::PerfCounters()
+{
+    for (size_t i = 0; i < peCount; i++) {
+        fds[i] = -1;
+    }
+}
+
+#ifdef __linux__
+static uint64_t cache_miss(uint64_t cache)
+{
+    return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+}
+
+bool PerfCounters::open()
+{
+    const uint32_t types[peCount] = {
+        PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE,
+        PERF_TYPE_HW_CACHE, PERF_TYPE_HW_CACHE, PERF_TYPE_SOFTWARE
+    };
+    const uint64_t configs[peCount] = {
+        PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_BRANCH_MISSES,
+        cache_miss(PERF_COUNT_HW_CACHE_L1D), cache_miss(PERF_COUNT_HW_CACHE_LL), PERF_COUNT_SW_TASK_CLOCK
+    };
+    for (size_t i = 0; i < peCount; i++) {
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = types[i];
+        attr.config = configs[i];
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        attr.inherit = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fds[i] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+        if (fds[i] < 0 && error == "") {
+            error = std::string(event_names[i]) + ": " + strerror(errno);
+        }
+    }
+    return fds[peTaskClock] >= 0;
+}
+#else
+bool PerfCounters::open()
+{
+    error = "perf_event_open is not supported on this system";
+    return false;
+}
+#endif
+
+bool PerfCounters::hardware() const
+{
+    for (size_t i = 0; i < peTaskClock; i++) {
+        if (fds[i] >= 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+const std::string &PerfCounters::get_error() const
+{
+    return error;
+}
+
+PerfValues PerfCounters::read() const
+{
+    PerfValues result;
+    for (size_t i = 0; i < peCount; i++) {
+        // value, time enabled, time running
+        uint64_t data[3];
+        result.counts[i] = 0;
+        result.valid[i] = fds[i] >= 0 && ::read(fds[i], data, sizeof(data)) == sizeof(data);
+        if (result.valid[i]) {
+            result.counts[i] = data[2] == 0 ? 0 :
+                               data[2] < data[1] ? (uint64_t)((double)data[0] * data[1] / data[2]) : data[0];
+        }
+    }
+    return result;
+}
+
+PerfCounters::~PerfCounters()
+{
+    for (size_t i = 0; i < peCount; i++) {
+        if (fds[i] >= 0) {
+            close(fds[i]);
+        }
+    }
+}
+
+void perf_counters_install(const PerfCounters *counters)
+{
+    installed = counters;
+}
+
+PerfValues perf_counters_read()
+{
+    const PerfCounters *counters = installed;
+    if (counters != NULL) {
+        return counters->read();
+    }
+    PerfValues result;
+    for (size_t i = 0; i < peCount; i++) {
+        result.counts[i] = 0;
+        result.valid[i] = false;
+    }
+    return result;
+}
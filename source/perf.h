@@ -0,0 +1,58 @@
+#ifndef PERF_H
+#define PERF_H
+
+#include <cstdint>
+#include <string>
+
+enum PerfEvent {
+    peCycles,
+    peInstructions,
+    peBranchMisses,
+    peL1dMisses,
+    peLLCMisses,
+    // software, in nanoseconds; counted even where the hardware ones are not
+    peTaskClock,
+    peCount
+};
+
+// counts since the counters were opened, or of a phase once subtracted;
+// events the kernel refused are not valid
+struct PerfValues {
+    uint64_t counts[peCount];
+    bool valid[peCount];
+};
+
+PerfValues operator+(const PerfValues &left, const PerfValues &right);
+PerfValues operator-(const PerfValues &left, const PerfValues &right);
+
+const char *perf_event_name(PerfEvent event);
+
+// Linux perf_event_open counters of the calling thread and the threads it
+// starts afterwards, user space only. Every event is opened on its own, so
+// one missing in a virtual machine does not take the others with it; if the
+// kernel multiplexes them, the counts are scaled to the whole time enabled.
+class PerfCounters {
+private:
+    int fds[peCount];
+    std::string error;
+public:
+    PerfCounters();
+    PerfCounters(const PerfCounters &) = delete;
+    PerfCounters &operator=(const PerfCounters &) = delete;
+    // returns false if not even the task clock could be opened
+    bool open();
+    // whether any hardware event is counted
+    bool hardware() const;
+    // why the first refused event was refused
+    const std::string &get_error() const;
+    PerfValues read() const;
+    ~PerfCounters();
+};
+
+// Counters read by every PhaseTimer (see stats.h) while installed; reading
+// costs a system call per event, so they are meant for phase boundaries.
+void perf_counters_install(const PerfCounters *counters);
+// all invalid when nothing is installed
+PerfValues perf_counters_read();
+
+#endif // PERF_H
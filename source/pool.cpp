@@ -0,0 +1,108 @@
+#include "pool.h"
+
+WorkStealingPool::WorkStealingPool(size_t threads):
+    queued(0), unfinished(0), sleeping(0), next_queue(0), stopping(false)
+{
+    if (threads == 0) {
+        threads = 1;
+    }
+    for (size_t i = 0; i < threads; i++) {
+        queues.push_back(new WorkerQueue());
+    }
+    for (size_t i = 0; i < threads; i++) {
+        workers.push_back(std::thread(&WorkStealingPool::worker_loop, this, i));
+    }
+}
+
+size_t WorkStealingPool::size() const
+{
+    return workers.size();
+}
+
+bool WorkStealingPool::take_own(size_t worker, Task &task)
+{
+    WorkerQueue &queue = *queues[worker];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tasks.empty()) {
+        return false;
+    }
+    task = std::move(queue.tasks.back());
+    queue.tasks.pop_back();
+    return true;
+}
+
+bool WorkStealingPool::steal(size_t worker, Task &task)
+{
+    for (size_t i = 1; i < queues.size(); i++) {
+        WorkerQueue &queue = *queues[(worker + i) % queues.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.tasks.empty()) {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkStealingPool::worker_loop(size_t worker)
+{
+    Task task;
+    while (true) {
+        if (take_own(worker, task) || steal(worker, task)) {
+            queued--;
+            task();
+            task = Task();
+            if (--unfinished == 0) {
+                std::lock_guard<std::mutex> lock(mutex);
+                all_done.notify_all();
+            }
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(mutex);
+        if (stopping && queued == 0) {
+            return;
+        }
+        // submit() increments queued before it reads sleeping, and this thread does it
+        // the other way round, so either the task is seen here or the wake-up is sent
+        sleeping++;
+        task_added.wait(lock, [this] { return stopping || queued > 0; });
+        sleeping--;
+    }
+}
+
+void WorkStealingPool::submit(const Task &task)
+{
+    size_t target = next_queue++ % queues.size();
+    unfinished++;
+    {
+        std::lock_guard<std::mutex> lock(queues[target]->mutex);
+        queues[target]->tasks.push_back(task);
+    }
+    queued++;
+    if (sleeping > 0) {
+        std::lock_guard<std::mutex> lock(mutex);
+        task_added.notify_one();
+    }
+}
+
+void WorkStealingPool::wait()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    all_done.wait(lock, [this] { return unfinished == 0; });
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    task_added.notify_all();
+    for (size_t i = 0; i < workers.size(); i++) {
+        workers[i].join();
+    }
+    for (size_t i = 0; i < queues.size(); i++) {
+        delete queues[i];
+    }
+}
@@ -0,0 +1,51 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+typedef std::function<void()> Task;
+
+// Fixed-size thread pool. Every worker owns a task queue: it takes its own
+// tasks from the back and steals from the front of other queues when idle.
+// Only the queue locks are taken per task; the pool lock is for workers
+// going to sleep when every queue is empty and for wait().
+class WorkStealingPool {
+private:
+    struct WorkerQueue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<WorkerQueue *> queues;
+    std::vector<std::thread> workers;
+
+    std::mutex mutex;
+    std::condition_variable task_added;
+    std::condition_variable all_done;
+    // tasks in the queues, submitted tasks not finished yet, workers asleep
+    std::atomic<size_t> queued;
+    std::atomic<size_t> unfinished;
+    std::atomic<size_t> sleeping;
+    std::atomic<size_t> next_queue;
+    bool stopping;
+
+    bool take_own(size_t worker, Task &task);
+    bool steal(size_t worker, Task &task);
+    void worker_loop(size_t worker);
+public:
+    explicit WorkStealingPool(size_t threads);
+    WorkStealingPool(const WorkStealingPool &) = delete;
+    WorkStealingPool &operator=(const WorkStealingPool &) = delete;
+    size_t size() const;
+    void submit(const Task &task);
+    void wait();
+    ~WorkStealingPool();
+};
+
+#endif // POOL_H
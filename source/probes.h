@@ -0,0 +1,41 @@
+#ifndef PROBES_H
+#define PROBES_H
+
+// Static tracepoints of the provider "interpreter", for bpftrace, perf and
+// SystemTap, e.g. bpftrace -e 'usdt:./interpreter:interpreter:jump { ... }'.
+// A probe is a single nop until a tracer attaches to it. They are compiled
+// in when sys/sdt.h is available (systemtap-sdt-dev) and left out entirely
+// otherwise, or with NO_PROBES defined. Arguments are integers and pointers:
+//   lexeme         type, line, column, text
+//   parse__start   lexemes
+//   parse__done    nodes, variables
+//   run__start     program, pos
+//   run__done      program, pos, status
+//   jump           program, from, to            (taken jumps only)
+//   read__start    program, pos
+//   read__done     program, pos, bytes          (not fired if no line is ready)
+//   write          program, pos, bytes
+//   runtime__error program, pos, status
+// program is the address of the Program being run, to aggregate per script;
+// pos is the index of an RPN node.
+
+#if !defined(NO_PROBES) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define PROBES_ENABLED
+#endif
+#endif
+
+#ifdef PROBES_ENABLED
+#define PROBE1(name, a) DTRACE_PROBE1(interpreter, name, a)
+#define PROBE2(name, a, b) DTRACE_PROBE2(interpreter, name, a, b)
+#define PROBE3(name, a, b, c) DTRACE_PROBE3(interpreter, name, a, b, c)
+#define PROBE4(name, a, b, c, d) DTRACE_PROBE4(interpreter, name, a, b, c, d)
+#else
+#define PROBE1(name, a) do {} while (0)
+#define PROBE2(name, a, b) do {} while (0)
+#define PROBE3(name, a, b, c) do {} while (0)
+#define PROBE4(name, a, b, c, d) do {} while (0)
+#endif
+
+#endif // PROBES_H
@@ -0,0 +1,314 @@
+#include <algorithm>
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <sys/time.h>
+#include "profiler.h"
+
+OperationProfiler::OperationProfiler():
+    counts(keys_count), cycles(keys_count), pairs(keys_count * keys_count),
+    triples(keys_count * keys_count * keys_count), previous(no_key), before_previous(no_key),
+    last_cycles(0) {}
+
+void OperationProfiler::start()
+{
+    previous = no_key;
+    before_previous = no_key;
+    last_cycles = read_cycles();
+}
+
+void OperationProfiler::stop()
+{
+    if (previous != no_key) {
+        cycles[previous] += read_cycles() - last_cycles;
+    }
+    previous = no_key;
+    before_previous = no_key;
+}
+
+const char *OperationProfiler::key_name(size_t key)
+{
+    return key == push_key ? "Push" : operation_name((Operation)key);
+}
+
+std::vector<OperationProfiler::Row> OperationProfiler::sorted_operations() const
+{
+    std::vector<Row> rows;
+    for (size_t key = 0; key < keys_count; key++) {
+        if (counts[key] > 0) {
+            rows.push_back({ key, counts[key], cycles[key] });
+        }
+    }
+    std::sort(rows.begin(), rows.end(), [](const Row &left, const Row &right) {
+        return left.cycles > right.cycles || (left.cycles == right.cycles && left.key < right.key);
+    });
+    return rows;
+}
+
+std::vector<OperationProfiler::Row> OperationProfiler::sorted_sequences(
+    const std::vector<uint64_t> &table) const
+{
+    std::vector<Row> rows;
+    for (size_t key = 0; key < table.size(); key++) {
+        if (table[key] > 0) {
+            rows.push_back({ key, table[key], 0 });
+        }
+    }
+    std::sort(rows.begin(), rows.end(), [](const Row &left, const Row &right) {
+        return left.count > right.count || (left.count == right.count && left.key < right.key);
+    });
+    return rows;
+}
+
+void OperationProfiler::print_sequence(std::ostream &stream, size_t key, size_t length,
+                                       const char *separator)
+{
+    size_t divisor = 1;
+    for (size_t i = 1; i < length; i++) {
+        divisor *= keys_count;
+    }
+    for (size_t i = 0; i < length; i++) {
+        stream << (i > 0 ? separator : "") << key_name(key / divisor % keys_count);
+        divisor /= keys_count;
+    }
+}
+
+void OperationProfiler::print(std::ostream &stream, size_t sequences_limit) const
+{
+    uint64_t total_count = 0, total_cycles = 0;
+    for (size_t key = 0; key < keys_count; key++) {
+        total_count += counts[key];
+        total_cycles += cycles[key];
+    }
+    if (total_count == 0) {
+        stream << "Operation profile: nothing was executed." << std::endl;
+        return;
+    }
+
+    stream << "Operation profile: " << total_count << " nodes, " << total_cycles << " cycles" << std::endl;
+    stream << std::left << std::setw(24) << "operation" << std::right
+           << std::setw(14) << "count" << std::setw(8) << "%"
+           << std::setw(16) << "cycles" << std::setw(8) << "%"
+           << std::setw(12) << "cycles/op" << std::endl;
+    stream << std::fixed << std::setprecision(2);
+    std::vector<Row> rows = sorted_operations();
+    for (size_t i = 0; i < rows.size(); i++) {
+        stream << std::left << std::setw(24) << key_name(rows[i].key) << std::right
+               << std::setw(14) << rows[i].count
+               << std::setw(8) << 100.0 * rows[i].count / total_count
+               << std::setw(16) << rows[i].cycles
+               << std::setw(8) << (total_cycles > 0 ? 100.0 * rows[i].cycles / total_cycles : 0.0)
+               << std::setw(12) << (double)rows[i].cycles / rows[i].count << std::endl;
+    }
+
+    const std::vector<uint64_t> *tables[] = { &pairs, &triples };
+    const char *titles[] = { "Most frequent pairs:", "Most frequent triples:" };
+    for (size_t length = 2; length <= 3; length++) {
+        stream << titles[length - 2] << std::endl;
+        rows = sorted_sequences(*tables[length - 2]);
+        for (size_t i = 0; i < rows.size() && i < sequences_limit; i++) {
+            stream << std::setw(14) << rows[i].count
+                   << std::setw(8) << 100.0 * rows[i].count / total_count << "  ";
+            print_sequence(stream, rows[i].key, length, " -> ");
+            stream << std::endl;
+        }
+    }
+    stream.unsetf(std::ios::floatfield);
+}
+
+void OperationProfiler::print_json(std::ostream &stream) const
+{
+    std::vector<Row> rows = sorted_operations();
+    stream << "{\n  \"operations\": [";
+    for (size_t i = 0; i < rows.size(); i++) {
+        stream << (i > 0 ? "," : "") << "\n    {\"name\": \"" << key_name(rows[i].key)
+               << "\", \"count\": " << rows[i].count << ", \"cycles\": " << rows[i].cycles << "}";
+    }
+    stream << "\n  ]";
+
+    const std::vector<uint64_t> *tables[] = { &pairs, &triples };
+    const char *titles[] = { "pairs", "triples" };
+    for (size_t length = 2; length <= 3; length++) {
+        rows = sorted_sequences(*tables[length - 2]);
+        stream << ",\n  \"" << titles[length - 2] << "\": [";
+        for (size_t i = 0; i < rows.size(); i++) {
+            stream << (i > 0 ? "," : "") << "\n    {\"sequence\": [\"";
+            print_sequence(stream, rows[i].key, length, "\", \"");
+            stream << "\"], \"count\": " << rows[i].count << "}";
+        }
+        stream << "\n  ]";
+    }
+    stream << "\n}" << std::endl;
+}
+
+volatile size_t LineProfiler::sampled_node = 0;
+uint64_t *volatile LineProfiler::samples = NULL;
+
+LineProfiler::LineProfiler(const Program &program, Mode mode, unsigned interval):
+    program(program), mode(mode), interval(interval), counts(program.get_nodes().size()),
+    costs(program.get_nodes().size()), previous((size_t)-1), last_cycles(0)
+{
+    find_loops();
+}
+
+void LineProfiler::on_signal(int)
+{
+    uint64_t *target = samples;
+    if (target != NULL) {
+        target[sampled_node]++;
+    }
+}
+
+void LineProfiler::start()
+{
+    previous = (size_t)-1;
+    last_cycles = read_cycles();
+    if (mode == pmSampling && !costs.empty()) {
+        sampled_node = 0;
+        samples = costs.data();
+        signal(SIGPROF, on_signal);
+        itimerval timer;
+        timer.it_interval.tv_sec = interval / 1000000;
+        timer.it_interval.tv_usec = interval % 1000000;
+        timer.it_value = timer.it_interval;
+        setitimer(ITIMER_PROF, &timer, NULL);
+    }
+}
+
+void LineProfiler::stop()
+{
+    if (mode == pmSampling) {
+        itimerval timer = {};
+        setitimer(ITIMER_PROF, &timer, NULL);
+        samples = NULL;
+        return;
+    }
+    if (previous < costs.size()) {
+        costs[previous] += read_cycles() - last_cycles;
+    }
+    previous = (size_t)-1;
+}
+
+void LineProfiler::find_loops()
+{
+    const ProgramNodes &nodes = program.get_nodes();
+    for (size_t i = 1; i < nodes.size(); i++) {
+        if (nodes[i].type == ntOperation && nodes[i].data.operation == opJump &&
+                nodes[i - 1].type == ntValue) {
+            size_t target = nodes[i - 1].data.value->to_integer();
+            if (target < i) {
+                loops.push_back({ target, i });
+            }
+        }
+    }
+    // outer loops first: a nested do-while may start at the same node
+    std::sort(loops.begin(), loops.end(), [](const Loop &left, const Loop &right) {
+        return left.start < right.start || (left.start == right.start && left.end > right.end);
+    });
+}
+
+uint64_t LineProfiler::range_cost(size_t start, size_t end) const
+{
+    uint64_t result = 0;
+    for (size_t i = start; i <= end && i < costs.size(); i++) {
+        result += costs[i];
+    }
+    return result;
+}
+
+const char *LineProfiler::cost_name() const
+{
+    return mode == pmSampling ? "samples" : "cycles";
+}
+
+void LineProfiler::print(std::ostream &stream, const std::string &source) const
+{
+    const LineTable &lines = program.get_lines();
+    std::vector<uint64_t> line_counts, line_costs;
+    uint64_t total = range_cost(0, costs.size());
+
+    // a statement may span several nodes, its executions are those of the most frequent one
+    for (size_t i = 0; i < costs.size(); i++) {
+        unsigned line = lines.find(i).line;
+        if (line >= line_costs.size()) {
+            line_counts.resize(line + 1);
+            line_costs.resize(line + 1);
+        }
+        line_counts[line] = std::max(line_counts[line], counts[i]);
+        line_costs[line] += costs[i];
+    }
+
+    stream << "Line profile (" << (mode == pmSampling ? "sampling" : "exact") << ", "
+           << total << " " << cost_name() << "):" << std::endl;
+    stream << std::setw(12) << "executions" << std::setw(16) << cost_name()
+           << std::setw(8) << "%" << "  source" << std::endl;
+    stream << std::fixed << std::setprecision(2);
+    if (line_costs.size() > 0 && line_costs[0] > 0) {
+        stream << std::setw(12) << line_counts[0] << std::setw(16) << line_costs[0]
+               << std::setw(8) << 100.0 * line_costs[0] / total << "  <no source>" << std::endl;
+    }
+    std::istringstream text(source);
+    std::string source_line;
+    for (unsigned line = 1; std::getline(text, source_line); line++) {
+        if (line < line_costs.size() && (line_counts[line] > 0 || line_costs[line] > 0)) {
+            stream << std::setw(12);
+            if (mode == pmSampling) {
+                stream << "-";
+            } else {
+                stream << line_counts[line];
+            }
+            stream << std::setw(16) << line_costs[line]
+                   << std::setw(8) << (total > 0 ? 100.0 * line_costs[line] / total : 0.0);
+        } else {
+            stream << std::setw(36) << "";
+        }
+        stream << "  " << source_line << std::endl;
+    }
+
+    std::vector<Loop> sorted = loops;
+    std::sort(sorted.begin(), sorted.end(), [this](const Loop &left, const Loop &right) {
+        return range_cost(left.start, left.end) > range_cost(right.start, right.end);
+    });
+    stream << "Loops:" << std::endl;
+    for (size_t i = 0; i < sorted.size(); i++) {
+        // named after the statement owning the backward jump, i.e. while of a do-while
+        SourcePosition position = lines.find(sorted[i].end);
+        uint64_t cost = range_cost(sorted[i].start, sorted[i].end);
+        stream << "line " << position.line << ", column " << position.column << ": ";
+        if (mode == pmExact) {
+            // the backward jump runs once per iteration
+            stream << counts[sorted[i].end] << " iterations, ";
+        }
+        stream << cost << " " << cost_name() << " ("
+               << (total > 0 ? 100.0 * cost / total : 0.0) << "%)" << std::endl;
+    }
+    stream.unsetf(std::ios::floatfield);
+}
+
+void LineProfiler::print_collapsed(std::ostream &stream) const
+{
+    const LineTable &lines = program.get_lines();
+    std::map<std::string, uint64_t> stacks;
+    for (size_t i = 0; i < costs.size(); i++) {
+        if (costs[i] == 0) {
+            continue;
+        }
+        std::ostringstream frames;
+        frames << "program";
+        for (size_t j = 0; j < loops.size() && loops[j].start <= i; j++) {
+            if (i <= loops[j].end) {
+                frames << ";loop:" << lines.find(loops[j].end).line;
+            }
+        }
+        unsigned line = lines.find(i).line;
+        if (line == 0) {
+            frames << ";line:?";
+        } else {
+            frames << ";line:" << line;
+        }
+        stacks[frames.str()] += costs[i];
+    }
+    for (std::map<std::string, uint64_t>::const_iterator i = stacks.begin(); i != stacks.end(); i++) {
+        stream << i->first << " " << i->second << std::endl;
+    }
+}
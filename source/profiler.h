@@ -0,0 +1,150 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <csignal>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "program.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+
+inline uint64_t read_cycles()
+{
+    return __rdtsc();
+}
+#else
+#include <chrono>
+
+// no cycle counter, nanoseconds are the closest substitute
+inline uint64_t read_cycles()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+#endif
+
+// Counts executed operations, constant pushes and sequences of two and
+// three consecutive nodes (candidates for superinstructions) across any
+// number of runs. The cycles between two dispatches are charged to the
+// earlier node, so they include the dispatch itself.
+class OperationProfiler {
+public:
+    // every operation is a key of its own, constant pushes share one more
+    static const size_t keys_count = operations_count + 1;
+    static const size_t push_key = operations_count;
+private:
+    static const size_t no_key = (size_t)-1;
+
+    std::vector<uint64_t> counts;
+    std::vector<uint64_t> cycles;
+    std::vector<uint64_t> pairs;
+    std::vector<uint64_t> triples;
+    size_t previous;
+    size_t before_previous;
+    uint64_t last_cycles;
+
+    struct Row {
+        size_t key;
+        uint64_t count;
+        uint64_t cycles;
+    };
+
+    static const char *key_name(size_t key);
+    std::vector<Row> sorted_operations() const;
+    std::vector<Row> sorted_sequences(const std::vector<uint64_t> &table) const;
+    static void print_sequence(std::ostream &stream, size_t key, size_t length, const char *separator);
+public:
+    OperationProfiler();
+    void start();
+    void stop();
+
+    inline void on_node(size_t, const ProgramNode &node)
+    {
+        uint64_t now = read_cycles();
+        size_t key = node.type == ntValue ? push_key : (size_t)node.data.operation;
+        counts[key]++;
+        if (previous != no_key) {
+            cycles[previous] += now - last_cycles;
+            pairs[previous * keys_count + key]++;
+            if (before_previous != no_key) {
+                triples[(before_previous * keys_count + previous) * keys_count + key]++;
+            }
+        }
+        before_previous = previous;
+        previous = key;
+        last_cycles = now;
+    }
+
+    // sorted by cycles, followed by the most frequent pairs and triples
+    void print(std::ostream &stream, size_t sequences_limit=20) const;
+    void print_json(std::ostream &stream) const;
+};
+
+// Attributes the run time of one program to its source lines and loops
+// through the program's line table. In exact mode every node is counted
+// and charged the cycles until the next dispatch. In sampling mode the
+// dispatch loop only publishes the current node index and a SIGPROF timer
+// samples it, so the cost is a single store per node; executions are not
+// counted then. Loops are the ranges closed by backward jumps.
+class LineProfiler {
+public:
+    enum Mode {
+        pmExact,
+        pmSampling
+    };
+private:
+    struct Loop {
+        size_t start;
+        size_t end;
+    };
+
+    // the signal handler can only reach static data
+    static volatile size_t sampled_node;
+    static uint64_t *volatile samples;
+
+    const Program &program;
+    Mode mode;
+    unsigned interval;
+    std::vector<uint64_t> counts;
+    std::vector<uint64_t> costs;
+    std::vector<Loop> loops;
+    size_t previous;
+    uint64_t last_cycles;
+
+    static void on_signal(int signal);
+    void find_loops();
+    uint64_t range_cost(size_t start, size_t end) const;
+    const char *cost_name() const;
+public:
+    // interval is the sampling period in microseconds of CPU time
+    LineProfiler(const Program &program, Mode mode, unsigned interval=1000);
+    LineProfiler(const LineProfiler &) = delete;
+    LineProfiler &operator=(const LineProfiler &) = delete;
+    void start();
+    void stop();
+
+    inline void on_node(size_t pos, const ProgramNode &)
+    {
+        if (mode == pmSampling) {
+            sampled_node = pos;
+            return;
+        }
+        uint64_t now = read_cycles();
+        counts[pos]++;
+        if (previous < costs.size()) {
+            costs[previous] += now - last_cycles;
+        }
+        previous = pos;
+        last_cycles = now;
+    }
+
+    // every source line with its executions and cost, followed by the loops
+    void print(std::ostream &stream, const std::string &source) const;
+    // one line per stack "program;loop:LINE;...;line:LINE COST" for flame graph tools
+    void print_collapsed(std::ostream &stream) const;
+};
+
+#endif // PROFILER_H
@@ -1,147 +1,37 @@
 #include <iostream>
-#include "exceptions.h"
+#include <utility>
 #include "program.h"
+#include "context.h"
 
-Program::Program(const std::vector<ProgramNode> &program, VariableID variables_count):
-    program(program), pos(0)
-{
-    variables.resize(variables_count);
-}
-
-void Program::clear_variables()
-{
-    for (size_t i = 0; i < variables.size(); i++) {
-        if (variables[i] != NULL) {
-            delete variables[i];
-            variables[i] = NULL;
-        }
-    }
-}
-
-void Program::clear_stack()
-{
-    for (size_t i = 0; i < stack.size(); i++) {
-        delete stack[i];
-    }
-    stack.clear();
-}
+Program::Program(ProgramNodes program, VariableID variables_count, LineTable lines):
+    program(std::move(program)), variables_count(variables_count), lines(std::move(lines)) {}
 
-inline void Program::push(Value *value)
+const ProgramNodes &Program::get_nodes() const
 {
-    stack.push_back(value);
+    return program;
 }
 
-inline Value *Program::top()
+VariableID Program::get_variables_count() const
 {
-    if (stack.size() == 0) {
-        throw std::runtime_error("The stack is empty");
-    }
-    return stack.back();
+    return variables_count;
 }
 
-inline Value *Program::pop()
+const LineTable &Program::get_lines() const
 {
-    Value *result = top();
-    stack.pop_back();
-    return result;
+    return lines;
 }
 
-void Program::execute(std::istream &in, std::ostream &out)
+void Program::execute(std::istream &in, std::ostream &out) const
 {
-    pos = 0;
-    clear_variables();
-    clear_stack();
-    while (pos < program.size()) {
-        ProgramNode node = program[pos++];
-        if (node.type == ntValue) {
-            push(node.data.value->clone());
-            continue;
-        }
-        Operation op = node.data.operation;
-
-        Integer id;
-        String read_data;
-        Value *left, *right;
-        switch (op) {
-        case opClearStack:
-            clear_stack();
-            continue;
-        case opJump:
-            right = pop();
-            left = pop();
-            if (!left->to_boolean()) {
-                pos = right->to_integer();
-            }
-            delete left;
-            delete right;
-            continue;
-        case opLoadVariable:
-            left = pop();
-            id = left->to_integer();
-            delete left;
-            if (variables[id] != NULL) {
-                push(variables[id]->clone());
-            } else {
-                throw InterpretationError("Uninitialized variable used.");
-            }
-            continue;
-        case opSaveVariable:
-            right = pop();
-            left = top();
-            id = right->to_integer();
-            if (variables[id] != NULL) {
-                delete variables[id];
-            }
-            variables[id] = left->clone();
-            delete right;
-            continue;
-        case opWrite:
-            left = pop();
-            out << left->to_string();
-            delete left;
-            continue;
-        case opWriteLn:
-            out << "\n";
-            continue;
-        case opReadLn:
-            std::getline(in, read_data);
-            push(new StringValue(read_data));
-            continue;
-        case opDup:
-            push(top()->clone());
-            continue;
-        default:
-            if (operation_is_unary(op)) {
-                left = pop();
-                try {
-                    push(operation_execute(op, left));
-                } catch(...) {
-                    delete left;
-                    throw;
-                }
-                delete left;
-            } else {
-                right = pop();
-                left = pop();
-                try {
-                    push(operation_execute(op, left, right));
-                } catch (...) {
-                    delete left;
-                    delete right;
-                    throw;
-                }
-                delete left;
-                delete right;
-            }
-        }
-    }
+    ExecutionContext context(*this, in, out);
+    context.execute();
 }
 
-void Program::print(std::ostream &out)
+void Program::print(std::ostream &out) const
 {
-    const std::string operations = ";FlswWrd++--*/%<>()=~++<>=~+!&|++--*/<>()=~";
+    const std::string operations = ";FlLswWrd++--*/%<>()=~++<>=~+!&|++--*/<>()=~?";
     const std::string values = " isbr";
-    out << "Program (" << variables.size() << " variables, "
+    out << "Program (" << variables_count << " variables, "
         << program.size() << " operands)." << std::endl;
     for (size_t i = 0; i < program.size(); i++) {
         Operation op = program[i].data.operation;
@@ -167,6 +57,4 @@ Program::~Program()
             delete program[i].data.value;
         }
     }
-    clear_variables();
-    clear_stack();
 }
@@ -1,10 +1,12 @@
 #ifndef PROGRAM_H
 #define PROGRAM_H
 
+#include <iostream>
 #include <vector>
 #include "values.h"
 #include "variables.h"
 #include "operations.h"
+#include "lines.h"
 
 enum NodeType {
     ntOperation,
@@ -23,23 +25,24 @@ struct ProgramNode {
 
 typedef std::vector<ProgramNode> ProgramNodes;
 
+// Compiled program image. It is never modified after construction, so one
+// image may be executed by any number of ExecutionContext objects at once.
 class Program {
 private:
     ProgramNodes program;
-    std::vector<Value *> variables;
-    std::vector<Value *> stack;
-    size_t pos;
-
-    void clear_variables();
-    void clear_stack();
-
-    inline void push(Value *value);
-    inline Value *top();
-    inline Value *pop();
+    VariableID variables_count;
+    LineTable lines;
 public:
-    Program(const ProgramNodes &program, VariableID variables_count);
-    void execute(std::istream &in, std::ostream &out);
-    void print(std::ostream &out);
+    // takes ownership of the values of the nodes; pass temporaries with std::move,
+    // images are large
+    Program(ProgramNodes program, VariableID variables_count, LineTable lines=LineTable());
+    Program(const Program &) = delete;
+    Program &operator=(const Program &) = delete;
+    const ProgramNodes &get_nodes() const;
+    VariableID get_variables_count() const;
+    const LineTable &get_lines() const;
+    void execute(std::istream &in, std::ostream &out) const;
+    void print(std::ostream &out) const;
     ~Program();
 };
 
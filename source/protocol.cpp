@@ -0,0 +1,207 @@
+#include <sstream>
+#include <iomanip>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "protocol.h"
+
+Connection::Connection(int fd, const std::string &unread): fd(fd), buffer(unread) {}
+
+int Connection::connect_to(const std::string &path)
+{
+    sockaddr_un address;
+    if (path.size() >= sizeof(address.sun_path)) {
+        return -1;
+    }
+    int result = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (result < 0) {
+        return -1;
+    }
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path.c_str());
+    if (connect(result, (sockaddr *)&address, sizeof(address)) < 0) {
+        close(result);
+        return -1;
+    }
+    return result;
+}
+
+bool Connection::is_open() const
+{
+    return fd >= 0;
+}
+
+int Connection::release(std::string &unread)
+{
+    int result = fd;
+    unread = buffer;
+    buffer.clear();
+    fd = -1;
+    return result;
+}
+
+bool Connection::fill()
+{
+    char chunk[4096];
+    ssize_t size;
+    do {
+        size = recv(fd, chunk, sizeof(chunk), 0);
+    } while (size < 0 && errno == EINTR);
+    if (size <= 0) {
+        return false;
+    }
+    buffer.append(chunk, size);
+    return true;
+}
+
+bool Connection::has_line() const
+{
+    return buffer.find('\n') != std::string::npos;
+}
+
+bool Connection::read_line(std::string &line)
+{
+    size_t end;
+    while ((end = buffer.find('\n')) == std::string::npos) {
+        if (!fill()) {
+            return false;
+        }
+    }
+    line = buffer.substr(0, end);
+    buffer.erase(0, end + 1);
+    return true;
+}
+
+bool Connection::read_exact(size_t size, std::string &data)
+{
+    while (buffer.size() < size) {
+        if (!fill()) {
+            return false;
+        }
+    }
+    data = buffer.substr(0, size);
+    buffer.erase(0, size);
+    return true;
+}
+
+bool Connection::write(const char *data, size_t size)
+{
+    while (size > 0) {
+        ssize_t sent = send(fd, data, size, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent <= 0) {
+            return false;
+        }
+        data += sent;
+        size -= sent;
+    }
+    return true;
+}
+
+bool Connection::write(const std::string &data)
+{
+    return write(data.data(), data.size());
+}
+
+Connection::~Connection()
+{
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+FrameOutputBuffer::FrameOutputBuffer(Connection &connection, size_t limit):
+    connection(connection), limit(limit), written(0), overflow_flag(false)
+{
+    setp(data, data + sizeof(data));
+}
+
+bool FrameOutputBuffer::send_frame()
+{
+    size_t size = pptr() - pbase();
+    setp(data, data + sizeof(data));
+    if (size == 0 || overflow_flag) {
+        return !overflow_flag;
+    }
+    if (written + size > limit) {
+        size = limit - written;
+        overflow_flag = true;
+    }
+    written += size;
+    if (size > 0) {
+        std::ostringstream header;
+        header << "DATA " << size << "\n";
+        connection.write(header.str());
+        connection.write(data, size);
+    }
+    return !overflow_flag;
+}
+
+int FrameOutputBuffer::overflow(int ch)
+{
+    if (!send_frame()) {
+        return traits_type::eof();
+    }
+    if (ch != traits_type::eof()) {
+        *pptr() = ch;
+        pbump(1);
+    }
+    return traits_type::not_eof(ch);
+}
+
+int FrameOutputBuffer::sync()
+{
+    return send_frame() ? 0 : -1;
+}
+
+bool FrameOutputBuffer::exceeded() const
+{
+    return overflow_flag;
+}
+
+FrameOutputBuffer::~FrameOutputBuffer()
+{
+    send_frame();
+}
+
+std::string content_hash(const std::string &data)
+{
+    // 64-bit FNV-1a
+    unsigned long long hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < data.size(); i++) {
+        hash ^= (unsigned char)data[i];
+        hash *= 1099511628211ULL;
+    }
+    std::ostringstream stream;
+    stream << std::hex << std::setw(16) << std::setfill('0') << hash;
+    return stream.str();
+}
+
+bool read_response(Connection &connection, std::ostream &out, std::string &error)
+{
+    std::string line, chunk;
+    while (connection.read_line(line)) {
+        if (line.compare(0, 5, "DATA ") == 0) {
+            if (!connection.read_exact(strtoul(line.c_str() + 5, NULL, 10), chunk)) {
+                break;
+            }
+            out << chunk;
+        } else if (line == "END") {
+            return true;
+        } else if (line.compare(0, 6, "ERROR ") == 0) {
+            error = line.substr(6);
+            return false;
+        } else {
+            error = "Unexpected response: " + line;
+            return false;
+        }
+    }
+    error = "Connection closed.";
+    return false;
+}
@@ -0,0 +1,73 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+/*
+ * Text protocol spoken over the server socket. A connection carries any
+ * number of requests, each answered before the next one is read:
+ *
+ *     LOAD <size>\n<source>          -> OK <hash>\n | ERROR <message>\n
+ *     RUN <hash> <size>\n<input>     -> (DATA <size>\n<output>)* (END\n | ERROR <message>\n)
+ *     SESSION <hash>\n               -> OK\n | ERROR <message>\n
+ *
+ * After a successful SESSION the connection is an interactive session: all
+ * further bytes sent by the client are program input, everything the server
+ * sends is raw program output, and the server closes the connection when
+ * the program ends.
+ *
+ * Programs are cached by the hash of their source, so a client may skip
+ * LOAD if it already knows that the server has the program. A LOAD whose
+ * hash matches a cached program with a different source is rejected.
+ */
+
+#include <iostream>
+#include <string>
+
+class Connection {
+private:
+    int fd;
+    std::string buffer;
+
+    bool fill();
+public:
+    // unread is data already received on fd, see release()
+    explicit Connection(int fd, const std::string &unread="");
+    Connection(const Connection &) = delete;
+    Connection &operator=(const Connection &) = delete;
+    static int connect_to(const std::string &path);
+    bool is_open() const;
+    // gives up the descriptor, data received but not read yet is stored in unread
+    int release(std::string &unread);
+    // whether a whole line is buffered, so read_line() would not block
+    bool has_line() const;
+    bool read_line(std::string &line);
+    bool read_exact(size_t size, std::string &data);
+    bool write(const char *data, size_t size);
+    bool write(const std::string &data);
+    ~Connection();
+};
+
+// Sends everything written into it as DATA frames; stops sending once limit
+// bytes were written and reports the overflow through exceeded().
+class FrameOutputBuffer: public std::streambuf {
+private:
+    Connection &connection;
+    size_t limit;
+    size_t written;
+    bool overflow_flag;
+    char data[4096];
+
+    bool send_frame();
+protected:
+    int overflow(int ch) override;
+    int sync() override;
+public:
+    FrameOutputBuffer(Connection &connection, size_t limit);
+    bool exceeded() const;
+    ~FrameOutputBuffer();
+};
+
+std::string content_hash(const std::string &data);
+// reads DATA frames into out until END (returns true) or ERROR (returns false)
+bool read_response(Connection &connection, std::ostream &out, std::string &error);
+
+#endif // PROTOCOL_H
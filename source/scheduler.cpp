@@ -0,0 +1,216 @@
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include "scheduler.h"
+
+Scheduler::Session::Session(const std::shared_ptr<const Program> &program,
+                            int input_fd, int output_fd, const ExecutionLimits &limits):
+    program(program), context(*program, output), input_fd(input_fd), output_fd(output_fd),
+    runnable(true), finished(false)
+{
+    context.set_limits(limits);
+}
+
+Scheduler::Scheduler(size_t slice, size_t max_pending):
+    slice(slice), max_pending(max_pending), stopping(false)
+{
+    if (pipe(wakeup_fds) == 0) {
+        fcntl(wakeup_fds[0], F_SETFL, O_NONBLOCK);
+        fcntl(wakeup_fds[1], F_SETFL, O_NONBLOCK);
+    } else {
+        wakeup_fds[0] = wakeup_fds[1] = -1;
+    }
+}
+
+void Scheduler::add_session(const std::shared_ptr<const Program> &program, int input_fd,
+                            int output_fd, const std::string &input, const ExecutionLimits &limits)
+{
+    Session *session = new Session(program, input_fd, output_fd, limits);
+    session->context.feed_input(input.data(), input.size());
+    fcntl(input_fd, F_SETFL, fcntl(input_fd, F_GETFL) | O_NONBLOCK);
+    fcntl(output_fd, F_SETFL, fcntl(output_fd, F_GETFL) | O_NONBLOCK);
+    {
+        std::lock_guard<std::mutex> lock(incoming_mutex);
+        incoming.push_back(session);
+    }
+    char byte = 0;
+    if (write(wakeup_fds[1], &byte, 1) < 0) {
+        // the pipe is full, so the loop is going to wake up anyway
+    }
+}
+
+void Scheduler::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(incoming_mutex);
+        stopping = true;
+    }
+    char byte = 0;
+    if (write(wakeup_fds[1], &byte, 1) < 0) {
+        // see add_session
+    }
+}
+
+void Scheduler::accept_incoming()
+{
+    char buffer[256];
+    while (read(wakeup_fds[0], buffer, sizeof(buffer)) > 0) {}
+
+    std::lock_guard<std::mutex> lock(incoming_mutex);
+    sessions.insert(sessions.end(), incoming.begin(), incoming.end());
+    incoming.clear();
+}
+
+void Scheduler::step(Session &session)
+{
+    RuntimeStatus status;
+    try {
+        status = session.context.run(slice);
+    } catch (const std::exception &e) {
+        // a runtime_error or bad_alloc from the VM ends this session, not the others
+        session.pending += session.output.str();
+        session.output.str("");
+        session.pending += e.what();
+        session.pending += "\n";
+        session.runnable = false;
+        session.finished = true;
+        return;
+    }
+    session.pending += session.output.str();
+    session.output.str("");
+
+    switch (status) {
+    case rsPreempted:
+        break;
+    case rsWaitingInput:
+        session.runnable = false;
+        break;
+    default:
+        if (status != rsOk) {
+            session.pending += session.context.status_message(status);
+            session.pending += "\n";
+        }
+        session.runnable = false;
+        session.finished = true;
+    }
+}
+
+void Scheduler::read_input(Session &session)
+{
+    char buffer[4096];
+    ssize_t size = read(session.input_fd, buffer, sizeof(buffer));
+    if (size > 0) {
+        session.context.feed_input(buffer, size);
+    } else if (size == 0 || (errno != EAGAIN && errno != EINTR)) {
+        session.context.close_input();
+    } else {
+        return;
+    }
+    session.runnable = true;
+}
+
+void Scheduler::write_output(Session &session)
+{
+    while (!session.pending.empty()) {
+        ssize_t size = write(session.output_fd, session.pending.data(), session.pending.size());
+        if (size < 0 && (errno == EAGAIN || errno == EINTR)) {
+            return;
+        }
+        if (size <= 0) {
+            // nobody is listening, the session has no reason to continue
+            session.pending.clear();
+            session.runnable = false;
+            session.finished = true;
+            return;
+        }
+        session.pending.erase(0, size);
+    }
+}
+
+void Scheduler::close_session(Session &session)
+{
+    close(session.input_fd);
+    if (session.output_fd != session.input_fd) {
+        close(session.output_fd);
+    }
+}
+
+void Scheduler::run()
+{
+    std::vector<pollfd> fds;
+    std::vector<Session *> polled;
+    while (true) {
+        {
+            std::lock_guard<std::mutex> lock(incoming_mutex);
+            if (stopping) {
+                break;
+            }
+        }
+        bool any_runnable = false;
+        for (size_t i = 0; i < sessions.size(); i++) {
+            Session &session = *sessions[i];
+            if (session.runnable && session.pending.size() <= max_pending) {
+                step(session);
+                write_output(session);
+            }
+            if (session.runnable && session.pending.size() <= max_pending) {
+                any_runnable = true;
+            }
+        }
+
+        // finished sessions stay until their output is delivered
+        size_t alive = 0;
+        for (size_t i = 0; i < sessions.size(); i++) {
+            if (sessions[i]->finished && sessions[i]->pending.empty()) {
+                close_session(*sessions[i]);
+                delete sessions[i];
+            } else {
+                sessions[alive++] = sessions[i];
+            }
+        }
+        sessions.resize(alive);
+
+        fds.clear();
+        polled.clear();
+        fds.push_back({ wakeup_fds[0], POLLIN, 0 });
+        polled.push_back(NULL);
+        for (size_t i = 0; i < sessions.size(); i++) {
+            Session &session = *sessions[i];
+            if (!session.runnable && !session.finished) {
+                fds.push_back({ session.input_fd, POLLIN, 0 });
+                polled.push_back(&session);
+            }
+            if (!session.pending.empty()) {
+                fds.push_back({ session.output_fd, POLLOUT, 0 });
+                polled.push_back(&session);
+            }
+        }
+        if (poll(fds.data(), fds.size(), any_runnable ? 0 : -1) < 0 && errno != EINTR) {
+            break;
+        }
+        for (size_t i = 0; i < fds.size(); i++) {
+            if (fds[i].revents == 0) {
+                continue;
+            }
+            if (polled[i] == NULL) {
+                accept_incoming();
+            } else if (fds[i].events == POLLIN) {
+                read_input(*polled[i]);
+            } else {
+                write_output(*polled[i]);
+            }
+        }
+    }
+}
+
+Scheduler::~Scheduler()
+{
+    accept_incoming();
+    for (size_t i = 0; i < sessions.size(); i++) {
+        close_session(*sessions[i]);
+        delete sessions[i];
+    }
+    close(wakeup_fds[0]);
+    close(wakeup_fds[1]);
+}
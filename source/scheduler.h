@@ -0,0 +1,61 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "program.h"
+#include "context.h"
+
+// Runs many program instances on the calling thread. An instance is resumed
+// whenever input arrives on its file descriptor and is suspended at read()
+// if no complete line is available or when its time slice is spent, so
+// sessions blocked on input cost neither a thread nor CPU time.
+class Scheduler {
+private:
+    struct Session {
+        std::shared_ptr<const Program> program;
+        std::ostringstream output;
+        ExecutionContext context;
+        int input_fd;
+        int output_fd;
+        bool runnable;
+        bool finished;
+        std::string pending;
+
+        Session(const std::shared_ptr<const Program> &program, int input_fd, int output_fd,
+                const ExecutionLimits &limits);
+    };
+
+    size_t slice;
+    size_t max_pending;
+
+    std::vector<Session *> sessions;
+    std::mutex incoming_mutex;
+    std::vector<Session *> incoming;
+    int wakeup_fds[2];
+    bool stopping;
+
+    void accept_incoming();
+    void step(Session &session);
+    void read_input(Session &session);
+    void write_output(Session &session);
+    void close_session(Session &session);
+public:
+    // slice is the number of instructions an instance may execute before
+    // yielding; an instance with more than max_pending bytes of unsent output
+    // is not resumed until the receiver catches up
+    Scheduler(size_t slice=10000, size_t max_pending=1 << 20);
+    Scheduler(const Scheduler &) = delete;
+    Scheduler &operator=(const Scheduler &) = delete;
+    // takes ownership of the descriptors, which may be the same socket
+    void add_session(const std::shared_ptr<const Program> &program, int input_fd, int output_fd,
+                     const std::string &input="", const ExecutionLimits &limits=ExecutionLimits());
+    void run();
+    void stop();
+    ~Scheduler();
+};
+
+#endif // SCHEDULER_H
@@ -0,0 +1,329 @@
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <cerrno>
+#include <cstring>
+#include <csignal>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "exceptions.h"
+#include "lexical.h"
+#include "syntax.h"
+#include "context.h"
+#include "evaluator.h"
+#include "pool.h"
+#include "server.h"
+
+static std::string error_line(const std::string &message)
+{
+    std::string result = "ERROR " + message;
+    for (size_t i = 0; i < result.size(); i++) {
+        if (result[i] == '\n' || result[i] == '\r') {
+            result[i] = ' ';
+        }
+    }
+    return result + "\n";
+}
+
+Server::Server(const std::string &socket_path, const ServerOptions &options):
+    socket_path(socket_path), options(options)
+{
+    if (pipe(wakeup_fds) == 0) {
+        fcntl(wakeup_fds[0], F_SETFL, O_NONBLOCK);
+        fcntl(wakeup_fds[1], F_SETFL, O_NONBLOCK);
+    } else {
+        wakeup_fds[0] = wakeup_fds[1] = -1;
+    }
+}
+
+std::shared_ptr<const Program> Server::compile(const std::string &source, std::string &error) const
+{
+    LexicalAnalyzer lexical(options.case_insensetive, options.alternative_names);
+    SyntaxAnalyzer syntax(options.comparison_chains, options.lazy_evaluations);
+    try {
+        lexical.parse_string(source);
+        Program *program = syntax.parse(lexical.get_lexemes());
+        if (options.precompute) {
+            program = precompute_program(program);
+        }
+        return std::shared_ptr<const Program>(program);
+    } catch (const std::exception &e) {
+        // bad_alloc included: a program too big to build fails its request, not the daemon
+        error = e.what();
+        return std::shared_ptr<const Program>();
+    }
+}
+
+std::shared_ptr<const Program> Server::find_program(const std::string &hash)
+{
+    std::lock_guard<std::mutex> lock(programs_mutex);
+    auto found = programs.find(hash);
+    if (found == programs.end()) {
+        return std::shared_ptr<const Program>();
+    }
+    return found->second.program;
+}
+
+std::string Server::add_program(const std::string &source, std::string &error)
+{
+    std::string hash = content_hash(source);
+    {
+        std::lock_guard<std::mutex> lock(programs_mutex);
+        auto found = programs.find(hash);
+        if (found != programs.end()) {
+            if (found->second.source != source) {
+                error = "Program hash collides with another cached program.";
+                return "";
+            }
+            return hash;
+        }
+    }
+    // compiled outside of the lock, a concurrent LOAD of the same source is harmless
+    std::shared_ptr<const Program> program = compile(source, error);
+    if (!program) {
+        return "";
+    }
+    std::lock_guard<std::mutex> lock(programs_mutex);
+    auto inserted = programs.insert(std::make_pair(hash, CachedProgram{ source, program }));
+    if (inserted.second) {
+        programs_order.push_back(hash);
+    } else if (inserted.first->second.source != source) {
+        error = "Program hash collides with another cached program.";
+        return "";
+    }
+    // running requests keep their own reference to evicted programs
+    while (programs_order.size() > options.max_programs) {
+        programs.erase(programs_order.front());
+        programs_order.pop_front();
+    }
+    return hash;
+}
+
+bool Server::handle_load(Connection &connection, std::istream &args)
+{
+    size_t size;
+    std::string source, error, hash;
+    if (!(args >> size)) {
+        connection.write(error_line("Bad request."));
+        return false;
+    }
+    if (size > options.max_program_size) {
+        connection.write(error_line("Program size limit exceeded."));
+        return false;
+    }
+    if (!connection.read_exact(size, source)) {
+        return false;
+    }
+    hash = add_program(source, error);
+    if (hash == "") {
+        return connection.write(error_line(error));
+    }
+    return connection.write("OK " + hash + "\n");
+}
+
+bool Server::handle_run(Connection &connection, std::istream &args)
+{
+    size_t size;
+    std::string hash, input;
+    if (!(args >> hash >> size)) {
+        connection.write(error_line("Bad request."));
+        return false;
+    }
+    if (size > options.max_input_size) {
+        connection.write(error_line("Input size limit exceeded."));
+        return false;
+    }
+    if (!connection.read_exact(size, input)) {
+        return false;
+    }
+    std::shared_ptr<const Program> program = find_program(hash);
+    if (!program) {
+        return connection.write(error_line("Unknown program " + hash + "."));
+    }
+
+    // every request gets its own context and streams, nothing is shared but the image
+    std::istringstream in(input);
+    FrameOutputBuffer output(connection, options.max_output_size);
+    std::ostream out(&output);
+    std::string error = "";
+    try {
+        ExecutionContext context(*program, in, out);
+        context.set_limits(options.limits);
+        context.execute();
+    } catch (const std::exception &e) {
+        // a runtime_error or bad_alloc from the VM ends this request, not the worker thread
+        error = e.what();
+    }
+    out.flush();
+    if (output.exceeded()) {
+        error = "Output size limit exceeded.";
+    }
+    if (error != "") {
+        return connection.write(error_line(error));
+    }
+    return connection.write("END\n");
+}
+
+bool Server::handle_session(Connection &connection, std::istream &args)
+{
+    std::string hash, unread;
+    if (!(args >> hash)) {
+        connection.write(error_line("Bad request."));
+        return false;
+    }
+    std::shared_ptr<const Program> program = find_program(hash);
+    if (!program) {
+        return connection.write(error_line("Unknown program " + hash + "."));
+    }
+    if (!connection.write("OK\n")) {
+        return false;
+    }
+    // interactive sessions spend most of their time waiting for input, so they are
+    // multiplexed on the scheduler thread instead of holding a worker
+    int fd = connection.release(unread);
+    sessions.add_session(program, fd, fd, unread, options.limits);
+    return false;
+}
+
+void Server::handle_connection(int fd, const std::string &unread)
+{
+    Connection connection(fd, unread);
+    std::string line, command;
+    bool alive = true;
+    // requests already buffered are served right away, the rest waits in serve()
+    do {
+        if (!connection.read_line(line)) {
+            return;
+        }
+        std::istringstream args(line);
+        args >> command;
+        if (command == "LOAD") {
+            alive = handle_load(connection, args);
+        } else if (command == "RUN") {
+            alive = handle_run(connection, args);
+        } else if (command == "SESSION") {
+            alive = handle_session(connection, args);
+        } else {
+            connection.write(error_line("Unknown command."));
+            alive = false;
+        }
+    } while (alive && connection.has_line());
+    if (alive) {
+        return_connection(connection);
+    }
+}
+
+void Server::return_connection(Connection &connection)
+{
+    IdleConnection idle;
+    idle.fd = connection.release(idle.unread);
+    {
+        std::lock_guard<std::mutex> lock(idle_mutex);
+        returned.push_back(idle);
+    }
+    char byte = 0;
+    if (write(wakeup_fds[1], &byte, 1) < 0) {
+        // the pipe is full, so the loop is going to wake up anyway
+    }
+}
+
+bool Server::serve()
+{
+    sockaddr_un address;
+    if (socket_path.size() >= sizeof(address.sun_path) || wakeup_fds[0] < 0) {
+        return false;
+    }
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0) {
+        return false;
+    }
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, socket_path.c_str());
+    unlink(socket_path.c_str());
+    if (bind(listener, (sockaddr *)&address, sizeof(address)) < 0 || listen(listener, 128) < 0) {
+        close(listener);
+        return false;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    std::thread sessions_thread(&Scheduler::run, &sessions);
+    sessions_thread.detach();
+
+    WorkStealingPool pool(options.jobs);
+    std::vector<IdleConnection> idle;
+    std::vector<pollfd> fds;
+    // accepting is paused for a while when the process runs out of descriptors
+    std::chrono::steady_clock::time_point paused_until;
+    bool paused = false;
+    while (true) {
+        int timeout = -1;
+        if (paused) {
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+                paused_until - std::chrono::steady_clock::now()).count();
+            paused = left > 0;
+            timeout = paused ? (int)left : -1;
+        }
+        fds.clear();
+        fds.push_back({ wakeup_fds[0], POLLIN, 0 });
+        // poll() skips negative descriptors
+        fds.push_back({ paused ? -1 : listener, POLLIN, 0 });
+        for (size_t i = 0; i < idle.size(); i++) {
+            fds.push_back({ idle[i].fd, POLLIN, 0 });
+        }
+        if (poll(fds.data(), fds.size(), timeout) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            std::cerr << "poll: " << strerror(errno) << std::endl;
+            close(listener);
+            return false;
+        }
+
+        // readable idle connections (or closed ones) go to the pool
+        size_t kept = 0;
+        for (size_t i = 0; i < idle.size(); i++) {
+            if (fds[i + 2].revents != 0) {
+                int fd = idle[i].fd;
+                std::string unread = idle[i].unread;
+                pool.submit([this, fd, unread] { handle_connection(fd, unread); });
+            } else {
+                idle[kept++] = idle[i];
+            }
+        }
+        idle.resize(kept);
+
+        if (fds[0].revents != 0) {
+            char buffer[256];
+            while (read(wakeup_fds[0], buffer, sizeof(buffer)) > 0) {}
+            std::lock_guard<std::mutex> lock(idle_mutex);
+            idle.insert(idle.end(), returned.begin(), returned.end());
+            returned.clear();
+        }
+
+        if (fds[1].revents != 0) {
+            int fd = accept(listener, NULL, NULL);
+            if (fd >= 0) {
+                idle.push_back({ fd, "" });
+            } else if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM) {
+                std::cerr << "accept: " << strerror(errno) << ", pausing" << std::endl;
+                paused = true;
+                paused_until = std::chrono::steady_clock::now() + std::chrono::milliseconds(100);
+            } else if (errno != EINTR && errno != EAGAIN && errno != ECONNABORTED) {
+                std::cerr << "accept: " << strerror(errno) << std::endl;
+                close(listener);
+                return false;
+            }
+        }
+    }
+}
+
+Server::~Server()
+{
+    close(wakeup_fds[0]);
+    close(wakeup_fds[1]);
+}
@@ -0,0 +1,80 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "program.h"
+#include "protocol.h"
+#include "scheduler.h"
+#include "limits.h"
+
+struct ServerOptions {
+    size_t jobs;
+    size_t max_programs;
+    size_t max_program_size;
+    size_t max_input_size;
+    size_t max_output_size;
+
+    bool case_insensetive;
+    bool alternative_names;
+    bool comparison_chains;
+    bool lazy_evaluations;
+    bool precompute;
+
+    // applied to every run and session
+    ExecutionLimits limits;
+};
+
+// Daemon that keeps compiled programs resident and executes them on request,
+// see protocol.h for the wire format.
+class Server {
+private:
+    std::string socket_path;
+    ServerOptions options;
+
+    // the source is kept to tell a hash collision from a repeated LOAD
+    struct CachedProgram {
+        std::string source;
+        std::shared_ptr<const Program> program;
+    };
+
+    std::mutex programs_mutex;
+    std::map<std::string, CachedProgram> programs;
+    std::deque<std::string> programs_order;
+
+    Scheduler sessions;
+
+    // connections between requests wait in poll() on the accepting thread
+    // instead of holding a worker; a worker hands its connection back here
+    struct IdleConnection {
+        int fd;
+        std::string unread;
+    };
+
+    std::mutex idle_mutex;
+    std::vector<IdleConnection> returned;
+    int wakeup_fds[2];
+
+    std::shared_ptr<const Program> compile(const std::string &source, std::string &error) const;
+    std::shared_ptr<const Program> find_program(const std::string &hash);
+    std::string add_program(const std::string &source, std::string &error);
+
+    bool handle_load(Connection &connection, std::istream &args);
+    bool handle_run(Connection &connection, std::istream &args);
+    bool handle_session(Connection &connection, std::istream &args);
+    void handle_connection(int fd, const std::string &unread);
+    void return_connection(Connection &connection);
+public:
+    Server(const std::string &socket_path, const ServerOptions &options);
+    Server(const Server &) = delete;
+    Server &operator=(const Server &) = delete;
+    // returns only if the socket could not be set up or stopped accepting
+    bool serve();
+    ~Server();
+};
+
+#endif // SERVER_H
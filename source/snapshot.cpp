@@ -0,0 +1,245 @@
+#include <cstdint>
+#include <cstring>
+#include <sstream>
+#include "snapshot.h"
+#include "protocol.h"
+
+static const char magic[] = "RPNSNAP1";
+static const size_t magic_size = 8;
+
+static void write_u64(std::ostream &stream, uint64_t value)
+{
+    char data[8];
+    for (size_t i = 0; i < 8; i++) {
+        data[i] = (char)(value >> (i * 8));
+    }
+    stream.write(data, 8);
+}
+
+static bool read_u64(std::istream &stream, uint64_t &value)
+{
+    unsigned char data[8];
+    if (!stream.read((char *)data, 8)) {
+        return false;
+    }
+    value = 0;
+    for (size_t i = 0; i < 8; i++) {
+        value |= (uint64_t)data[i] << (i * 8);
+    }
+    return true;
+}
+
+static void write_string(std::ostream &stream, const std::string &value)
+{
+    write_u64(stream, value.size());
+    stream.write(value.data(), value.size());
+}
+
+static bool read_string(std::istream &stream, std::string &value)
+{
+    uint64_t size;
+    if (!read_u64(stream, size)) {
+        return false;
+    }
+    // read in chunks, a corrupted length must not allocate the whole address space
+    value.clear();
+    char buffer[4096];
+    while (size > 0) {
+        size_t chunk = size < sizeof(buffer) ? (size_t)size : sizeof(buffer);
+        if (!stream.read(buffer, chunk)) {
+            return false;
+        }
+        value.append(buffer, chunk);
+        size -= chunk;
+    }
+    return true;
+}
+
+static void write_value(std::ostream &stream, const Value *value)
+{
+    if (value == NULL) {
+        stream.put((char)vtNone);
+        return;
+    }
+    uint64_t bits;
+    Real real;
+    stream.put((char)value->get_type());
+    switch (value->get_type()) {
+    case vtInteger:
+        write_u64(stream, (uint64_t)value->to_integer());
+        break;
+    case vtBoolean:
+        stream.put(value->to_boolean() ? 1 : 0);
+        break;
+    case vtReal:
+        real = value->to_real();
+        memcpy(&bits, &real, sizeof(bits));
+        write_u64(stream, bits);
+        break;
+    default:
+        write_string(stream, value->to_string());
+        break;
+    }
+}
+
+static bool read_value(std::istream &stream, Value *&value)
+{
+    uint64_t bits;
+    Real real;
+    std::string data;
+    int type = stream.get();
+    value = NULL;
+    switch (type) {
+    case vtNone:
+        return true;
+    case vtInteger:
+        if (!read_u64(stream, bits)) {
+            return false;
+        }
+        value = new IntegerValue((Integer)bits);
+        return true;
+    case vtBoolean:
+        type = stream.get();
+        if (type == EOF) {
+            return false;
+        }
+        value = new BooleanValue(type != 0);
+        return true;
+    case vtReal:
+        if (!read_u64(stream, bits)) {
+            return false;
+        }
+        memcpy(&real, &bits, sizeof(real));
+        value = new RealValue(real);
+        return true;
+    case vtString:
+        if (!read_string(stream, data)) {
+            return false;
+        }
+        value = new StringValue(data);
+        return true;
+    default:
+        return false;
+    }
+}
+
+Snapshot::Snapshot():
+    pos(0), input_lines(0) {}
+
+void Snapshot::clear()
+{
+    for (size_t i = 0; i < variables.size(); i++) {
+        delete variables[i];
+    }
+    for (size_t i = 0; i < stack.size(); i++) {
+        delete stack[i];
+    }
+    variables.clear();
+    stack.clear();
+}
+
+std::string Snapshot::hash(const Program &program)
+{
+    const ProgramNodes &nodes = program.get_nodes();
+    std::ostringstream data;
+    data << program.get_variables_count();
+    for (size_t i = 0; i < nodes.size(); i++) {
+        if (nodes[i].type == ntOperation) {
+            data << ";o" << nodes[i].data.operation;
+        } else {
+            // constants are hashed in their binary form, so reals keep every bit
+            write_value(data << ";", nodes[i].data.value);
+        }
+    }
+    return content_hash(data.str());
+}
+
+void Snapshot::capture(const ExecutionContext &context, const std::string &output)
+{
+    clear();
+    program_hash = hash(context.get_program());
+    pos = context.get_pos();
+    input_lines = context.get_input_lines();
+    this->output = output;
+    const std::vector<Value*> &context_variables = context.get_variables();
+    for (size_t i = 0; i < context_variables.size(); i++) {
+        variables.push_back(context_variables[i] != NULL ? context_variables[i]->clone() : NULL);
+    }
+    const std::vector<Value*> &context_stack = context.get_stack();
+    for (size_t i = 0; i < context_stack.size(); i++) {
+        stack.push_back(context_stack[i]->clone());
+    }
+}
+
+bool Snapshot::matches(const Program &program) const
+{
+    return program_hash == hash(program) && variables.size() == (size_t)program.get_variables_count();
+}
+
+void Snapshot::restore(ExecutionContext &context, std::ostream &out) const
+{
+    out << output;
+    context.restore(pos, input_lines, variables, stack);
+}
+
+bool Snapshot::save(std::ostream &stream) const
+{
+    stream.write(magic, magic_size);
+    write_string(stream, program_hash);
+    write_u64(stream, pos);
+    write_u64(stream, input_lines);
+    write_string(stream, output);
+    write_u64(stream, variables.size());
+    for (size_t i = 0; i < variables.size(); i++) {
+        write_value(stream, variables[i]);
+    }
+    write_u64(stream, stack.size());
+    for (size_t i = 0; i < stack.size(); i++) {
+        write_value(stream, stack[i]);
+    }
+    return (bool)stream;
+}
+
+bool Snapshot::load(std::istream &stream)
+{
+    char header[magic_size];
+    uint64_t value, count;
+    Value *item;
+
+    clear();
+    if (!stream.read(header, magic_size) || memcmp(header, magic, magic_size) != 0) {
+        return false;
+    }
+    if (!read_string(stream, program_hash) || !read_u64(stream, value)) {
+        return false;
+    }
+    pos = value;
+    if (!read_u64(stream, value) || !read_string(stream, output)) {
+        return false;
+    }
+    input_lines = value;
+    if (!read_u64(stream, count)) {
+        return false;
+    }
+    for (uint64_t i = 0; i < count; i++) {
+        if (!read_value(stream, item)) {
+            return false;
+        }
+        variables.push_back(item);
+    }
+    if (!read_u64(stream, count)) {
+        return false;
+    }
+    for (uint64_t i = 0; i < count; i++) {
+        if (!read_value(stream, item) || item == NULL) {
+            return false;
+        }
+        stack.push_back(item);
+    }
+    return true;
+}
+
+Snapshot::~Snapshot()
+{
+    clear();
+}
@@ -0,0 +1,49 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include "context.h"
+
+// Saved execution state of a program: program counter, stack, variables,
+// the number of input lines consumed and the output written so far.
+// Restoring a snapshot replays that output and continues from the saved
+// point, so a run restored from a snapshot taken at the first read()
+// behaves exactly like a full run but skips all the work done before it.
+//
+// Binary format (integers are little-endian, strings are prefixed with
+// their 64-bit length):
+//   "RPNSNAP1", program hash (string), pos (u64), input lines (u64),
+//   output (string), variables count (u64), variables, stack size (u64),
+//   stack values.
+// Every value is a ValueType byte followed by an i64 (integer), a byte
+// (boolean), an IEEE double (real) or a string; uninitialized variables
+// are stored as vtNone without payload.
+class Snapshot {
+private:
+    std::string program_hash;
+    size_t pos;
+    size_t input_lines;
+    std::string output;
+    std::vector<Value *> variables;
+    std::vector<Value *> stack;
+
+    void clear();
+public:
+    Snapshot();
+    Snapshot(const Snapshot &) = delete;
+    Snapshot &operator=(const Snapshot &) = delete;
+    static std::string hash(const Program &program);
+    // output is whatever the context has written up to this point
+    void capture(const ExecutionContext &context, const std::string &output);
+    // false if the snapshot was taken from a different program
+    bool matches(const Program &program) const;
+    // writes the saved output to out and puts the context into the saved state
+    void restore(ExecutionContext &context, std::ostream &out) const;
+    bool save(std::ostream &stream) const;
+    bool load(std::istream &stream);
+    ~Snapshot();
+};
+
+#endif // SNAPSHOT_H
@@ -0,0 +1,375 @@
+#include <algorithm>
+#include <utility>
+#include "speculate.h"
+
+// back edges taken fewer times in the warmup are not worth a copy
+static const uint64_t hot_iterations = 16;
+
+SpeculativeTier::SpeculativeTier(const Program &program, size_t warmup):
+    program(program), warmup(warmup), profile(program), loaded(program.get_nodes().size(), NULL),
+    varying(program.get_nodes().size(), false), image(NULL) {}
+
+void SpeculativeTier::start(size_t pos)
+{
+    profile.start(pos);
+}
+
+void SpeculativeTier::stop(size_t pos)
+{
+    profile.stop(pos);
+}
+
+static bool is_jump(const ProgramNode &node)
+{
+    return node.type == ntOperation && node.data.operation == opJump;
+}
+
+// "false; address; opJump" ending at the given node
+static bool is_unconditional(const ProgramNodes &nodes, size_t jump)
+{
+    return jump >= 2 && is_jump(nodes[jump]) && nodes[jump - 2].type == ntValue &&
+           nodes[jump - 2].data.value->get_type() == vtBoolean &&
+           !nodes[jump - 2].data.value->to_boolean();
+}
+
+bool SpeculativeTier::split()
+{
+    const ProgramNodes &nodes = program.get_nodes();
+    size_t size = nodes.size();
+    // the same blocks as BlockLayout::split
+    leader.assign(size + 1, false);
+    leader[0] = true;
+    for (size_t i = 0; i < size; i++) {
+        if (!is_jump(nodes[i])) {
+            continue;
+        }
+        if (i == 0 || nodes[i - 1].type != ntValue) {
+            return false;
+        }
+        Integer target = nodes[i - 1].data.value->to_integer();
+        if (target < 0 || (size_t)target > size) {
+            return false;
+        }
+        leader[target] = true;
+        leader[i + 1] = true;
+    }
+    for (size_t i = 1; i < size; i++) {
+        if (is_jump(nodes[i]) && (leader[i] || leader[i - 1])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool SpeculativeTier::speculate(Region &region) const
+{
+    const ProgramNodes &nodes = program.get_nodes();
+    VariableID count = program.get_variables_count();
+    // values loaded in the executed blocks, NULL once a variable is known to differ
+    std::vector<const Value *> values(count, NULL);
+    std::vector<bool> seen(count, false), rejected(count, false);
+    bool executed = false;
+    for (size_t i = region.start; i < region.end; i++) {
+        if (leader[i]) {
+            executed = profile.get_executions(i) > 0;
+        }
+        if (!executed || nodes[i].type != ntOperation) {
+            continue;
+        }
+        Operation op = nodes[i].data.operation;
+        if (op != opLoadVariable && op != opLoadVariableUnchecked && op != opSaveVariable) {
+            continue;
+        }
+        if (i == 0 || nodes[i - 1].type != ntValue) {
+            return false;
+        }
+        VariableID id = nodes[i - 1].data.value->to_integer();
+        if (id < 0 || id >= count) {
+            return false;
+        }
+        if (op == opSaveVariable || loaded[i] == NULL || varying[i]) {
+            rejected[id] = true;
+        } else if (!seen[id]) {
+            seen[id] = true;
+            values[id] = loaded[i];
+        } else if (!values_equal(*values[id], *loaded[i])) {
+            rejected[id] = true;
+        }
+    }
+    for (VariableID id = 0; id < count; id++) {
+        if (seen[id] && !rejected[id]) {
+            region.variables.push_back(id);
+            region.values.push_back(values[id]);
+        }
+    }
+    return !region.variables.empty();
+}
+
+void SpeculativeTier::select()
+{
+    const ProgramNodes &nodes = program.get_nodes();
+    std::vector<Region> loops;
+    for (size_t i = 1; i < nodes.size(); i++) {
+        if (is_jump(nodes[i]) && (size_t)nodes[i - 1].data.value->to_integer() <= i &&
+                profile.get_taken(i) >= hot_iterations) {
+            loops.push_back(Region{ (size_t)nodes[i - 1].data.value->to_integer(), i + 1, {}, {} });
+        }
+    }
+    // inner loops first, an outer one is only taken if none inside it is
+    std::stable_sort(loops.begin(), loops.end(), [](const Region &a, const Region &b) {
+        return a.end - a.start < b.end - b.start;
+    });
+    for (size_t i = 0; i < loops.size(); i++) {
+        bool overlaps = false;
+        for (size_t j = 0; j < regions.size(); j++) {
+            overlaps = overlaps || (loops[i].start < regions[j].end && regions[j].start < loops[i].end);
+        }
+        if (!overlaps && speculate(loops[i])) {
+            regions.push_back(loops[i]);
+        }
+    }
+    std::sort(regions.begin(), regions.end(), [](const Region &a, const Region &b) {
+        return a.start < b.start;
+    });
+}
+
+Program *SpeculativeTier::emit()
+{
+    const ProgramNodes &nodes = program.get_nodes();
+    const LineTable &source = program.get_lines();
+    size_t size = nodes.size();
+    ProgramNodes result;
+    // the original node every node was generated for
+    std::vector<size_t> origins;
+    std::vector<Fixup> fixups;
+    std::vector<size_t> body(size + 1, 0), specialized(size + 1, 0);
+    generic.assign(size + 1, 0);
+
+    auto add_value = [&](Value *value, size_t origin) {
+        ProgramNode node;
+        node.type = ntValue;
+        node.data.value = value;
+        result.push_back(node);
+        origins.push_back(origin);
+    };
+    auto add_operation = [&](Operation op, size_t origin) {
+        ProgramNode node;
+        node.type = ntOperation;
+        node.data.operation = op;
+        result.push_back(node);
+        origins.push_back(origin);
+    };
+    auto add_jump = [&](LabelKind kind, size_t target, size_t origin) {
+        fixups.push_back(Fixup{ result.size(), kind, target });
+        add_value(NULL, origin);
+        add_operation(opJump, origin);
+    };
+    // whether the last count nodes, all of the current block, are constants
+    auto constants = [&](size_t block, size_t count) {
+        if (result.size() < block + count) {
+            return false;
+        }
+        for (size_t i = result.size() - count; i < result.size(); i++) {
+            if (result[i].type != ntValue) {
+                return false;
+            }
+        }
+        return true;
+    };
+    auto drop = [&]() {
+        delete result.back().data.value;
+        result.pop_back();
+        origins.pop_back();
+    };
+
+    auto copy = [&](const Region &region) {
+        auto hot = [&](size_t pos) {
+            return pos >= region.start && pos < region.end && profile.get_executions(pos) > 0;
+        };
+        // blocks never executed in the warmup may break the speculation, so
+        // jumps to them deoptimize to the generic code, and so does falling into them
+        auto label = [&](size_t target) {
+            return hot(target) ? lkSpecialized : lkGeneric;
+        };
+        size_t block = result.size();
+        // whether the code emitted last falls through to the current node
+        bool falls = false;
+        for (size_t i = region.start; i < region.end; i++) {
+            if (leader[i] && !hot(i)) {
+                if (falls) {
+                    add_value(new BooleanValue(false), i);
+                    add_jump(lkGeneric, i, i);
+                }
+                falls = false;
+                while (i + 1 < region.end && !leader[i + 1]) {
+                    i++;
+                }
+                continue;
+            } else if (leader[i]) {
+                block = result.size();
+                specialized[i] = block;
+                falls = true;
+            }
+            const ProgramNode &node = nodes[i];
+            if (node.type == ntValue && is_jump(nodes[i + 1])) {
+                size_t target = node.data.value->to_integer();
+                i++;
+                if (constants(block, 1) && result.back().data.value->to_boolean()) {
+                    // never jumps
+                    drop();
+                    continue;
+                } else if (constants(block, 1)) {
+                    falls = false;
+                    size_t following = i + 1;
+                    while (following < region.end && !hot(following)) {
+                        following++;
+                    }
+                    // only the cold blocks are skipped, nothing falls into them now
+                    if (label(target) == lkSpecialized && following == target) {
+                        drop();
+                        continue;
+                    }
+                }
+                add_jump(label(target), target, i);
+                continue;
+            } else if (node.type == ntValue) {
+                add_value(node.data.value->clone(), i);
+                continue;
+            }
+            Operation op = node.data.operation;
+            if ((op == opLoadVariable || op == opLoadVariableUnchecked) && constants(block, 1)) {
+                VariableID id = result.back().data.value->to_integer();
+                std::vector<VariableID>::const_iterator found =
+                    std::find(region.variables.begin(), region.variables.end(), id);
+                if (found != region.variables.end()) {
+                    drop();
+                    add_value(region.values[found - region.variables.begin()]->clone(), i);
+                    continue;
+                }
+            } else if (op >= opIntPlus && op <= opRealNotEq) {
+                bool unary = operation_is_unary(op);
+                if (constants(block, unary ? 1 : 2)) {
+                    RuntimeStatus status = rsOk;
+                    Value *right = result.back().data.value, *value;
+                    if (unary) {
+                        value = operation_execute(op, right, status);
+                    } else {
+                        value = operation_execute(op, result[result.size() - 2].data.value, right, status);
+                    }
+                    // an error is left to happen at runtime
+                    if (value != NULL) {
+                        drop();
+                        if (!unary) {
+                            drop();
+                        }
+                        add_value(value, i);
+                        continue;
+                    }
+                }
+            }
+            add_operation(op, i);
+        }
+        if (falls) {
+            add_value(new BooleanValue(false), region.end - 1);
+            add_jump(lkGeneric, region.end, region.end - 1);
+        }
+    };
+
+    size_t next = 0;
+    for (size_t pos = 0; pos <= size; pos++) {
+        // the copy follows its generic loop, which must not fall into it
+        if (next > 0 && regions[next - 1].end == pos) {
+            if (!is_unconditional(nodes, pos - 1)) {
+                add_value(new BooleanValue(false), pos - 1);
+                add_jump(lkGeneric, pos, pos - 1);
+            }
+            copy(regions[next - 1]);
+        }
+        generic[pos] = result.size();
+        if (next < regions.size() && regions[next].start == pos) {
+            const Region &region = regions[next++];
+            for (size_t i = 0; i < region.variables.size(); i++) {
+                add_value(region.values[i]->clone(), pos);
+                add_value(new IntegerValue(region.variables[i]), pos);
+                fixups.push_back(Fixup{ result.size(), lkBody, pos });
+                add_value(NULL, pos);
+                add_operation(opGuard, pos);
+            }
+            add_value(new BooleanValue(false), pos);
+            add_jump(lkSpecialized, pos, pos);
+            body[pos] = result.size();
+        }
+        if (pos == size) {
+            break;
+        }
+        ProgramNode node = nodes[pos];
+        if (node.type == ntValue && pos + 1 < size && is_jump(nodes[pos + 1])) {
+            fixups.push_back(Fixup{ result.size(), lkGeneric, (size_t)node.data.value->to_integer() });
+            node.data.value = NULL;
+        } else if (node.type == ntValue) {
+            node.data.value = node.data.value->clone();
+        }
+        result.push_back(node);
+        origins.push_back(pos);
+    }
+
+    for (size_t i = 0; i < fixups.size(); i++) {
+        const std::vector<size_t> &labels = fixups[i].kind == lkGeneric ? generic :
+                                            fixups[i].kind == lkBody ? body : specialized;
+        result[fixups[i].node].data.value = new IntegerValue((Integer)labels[fixups[i].pos]);
+    }
+    LineTable lines;
+    for (size_t i = 0; i < result.size(); i++) {
+        SourcePosition position = source.find(origins[i]);
+        lines.add(i, position.line, position.column);
+    }
+    return new Program(std::move(result), program.get_variables_count(), std::move(lines));
+}
+
+bool SpeculativeTier::is_profiling() const
+{
+    return warmup > 0;
+}
+
+size_t SpeculativeTier::get_warmup() const
+{
+    return warmup;
+}
+
+void SpeculativeTier::spend(size_t steps)
+{
+    if (warmup == 0) {
+        return;
+    }
+    if (steps < warmup) {
+        warmup -= steps;
+        return;
+    }
+    warmup = 0;
+    if (split()) {
+        select();
+        if (!regions.empty()) {
+            image = emit();
+        }
+    }
+}
+
+const Program *SpeculativeTier::get_image() const
+{
+    return image;
+}
+
+size_t SpeculativeTier::translate(size_t pos) const
+{
+    return generic[pos];
+}
+
+SpeculativeTier::~SpeculativeTier()
+{
+    for (size_t i = 0; i < loaded.size(); i++) {
+        delete loaded[i];
+    }
+    if (image) {
+        delete image;
+    }
+}
@@ -0,0 +1,102 @@
+#ifndef SPECULATE_H
+#define SPECULATE_H
+
+#include <cstdint>
+#include <vector>
+#include "program.h"
+#include "layout.h"
+
+// Optimizing tier of ExecutionContext::run(SpeculativeTier &). The first
+// steps of a run are profiled: the values every load produces and the
+// blocks and jumps executed. Then every hot loop whose loads of some
+// variable always produced one value and which stores that variable only
+// in code that never ran is specialized: the loop is copied with the value
+// folded into its loads, constant operations and branches folded, and the
+// blocks that never ran replaced with jumps back to the generic code. The
+// loop header starts with opGuard nodes that check the variables still
+// hold the values and enter the copy, or fall through to the generic loop
+// otherwise. So a failed guard, or a branch going the way it never went
+// in profiling, deoptimizes to the generic code at the same position with
+// the same stack, and the next iteration checks the guards again.
+//
+// The image is the whole generic program with the copies inserted after
+// their loops; it is compiled once and kept for later runs. A tier is not
+// thread safe, it belongs to one context at a time.
+class SpeculativeTier {
+private:
+    struct Region {
+        size_t start;
+        size_t end;
+        // speculated variables and their values
+        std::vector<VariableID> variables;
+        std::vector<const Value *> values;
+    };
+
+    enum LabelKind {
+        lkGeneric,
+        lkBody,
+        lkSpecialized
+    };
+
+    struct Fixup {
+        size_t node;
+        LabelKind kind;
+        size_t pos;
+    };
+
+    const Program &program;
+    size_t warmup;
+    BlockProfile profile;
+    // first value loaded by every load node, and whether another one followed
+    std::vector<Value *> loaded;
+    std::vector<bool> varying;
+
+    std::vector<bool> leader;
+    std::vector<Region> regions;
+    Program *image;
+    // positions of the original nodes in the image
+    std::vector<size_t> generic;
+
+    bool split();
+    bool speculate(Region &region) const;
+    void select();
+    Program *emit();
+public:
+    // warmup is counted in steps, like ExecutionContext::run slices
+    explicit SpeculativeTier(const Program &program, size_t warmup=65536);
+    SpeculativeTier(const SpeculativeTier &) = delete;
+    SpeculativeTier &operator=(const SpeculativeTier &) = delete;
+
+    void start(size_t pos);
+    void stop(size_t pos);
+
+    inline void on_node(size_t pos, const ProgramNode &node, const std::vector<Value *> &stack,
+                        const std::vector<Value *> &variables)
+    {
+        profile.on_node(pos, node);
+        if (node.type != ntOperation || stack.empty() ||
+                (node.data.operation != opLoadVariable && node.data.operation != opLoadVariableUnchecked)) {
+            return;
+        }
+        const Value *value = variables[stack.back()->to_integer()];
+        if (value == NULL || varying[pos]) {
+            varying[pos] = true;
+        } else if (loaded[pos] == NULL) {
+            loaded[pos] = value->clone();
+        } else if (!values_equal(*loaded[pos], *value)) {
+            varying[pos] = true;
+        }
+    }
+
+    bool is_profiling() const;
+    size_t get_warmup() const;
+    // the image is compiled once the warmup is spent
+    void spend(size_t steps);
+    // NULL if there was nothing to specialize
+    const Program *get_image() const;
+    // the position in the image of an original node, or of the end
+    size_t translate(size_t pos) const;
+    ~SpeculativeTier();
+};
+
+#endif // SPECULATE_H
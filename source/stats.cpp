@@ -0,0 +1,266 @@
+#include <iomanip>
+#include "stats.h"
+
+static const char *phase_names[spCount] = { "lex", "parse", "labels", "precompute", "execute" };
+
+PhaseTime operator+(const PhaseTime &left, const PhaseTime &right)
+{
+    return PhaseTime{ left.wall + right.wall, left.cpu + right.cpu, left.counters + right.counters };
+}
+
+PhaseTime operator-(const PhaseTime &left, const PhaseTime &right)
+{
+    return PhaseTime{ left.wall - right.wall, left.cpu - right.cpu, left.counters - right.counters };
+}
+
+PhaseTimer::PhaseTimer()
+{
+    restart();
+}
+
+void PhaseTimer::restart()
+{
+    wall_start = std::chrono::steady_clock::now();
+    cpu_start = std::clock();
+    counters_start = perf_counters_read();
+}
+
+PhaseTime PhaseTimer::elapsed() const
+{
+    PhaseTime result;
+    result.wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_start).count();
+    result.cpu = (double)(std::clock() - cpu_start) / CLOCKS_PER_SEC;
+    result.counters = perf_counters_read() - counters_start;
+    return result;
+}
+
+CountingBuffer::CountingBuffer(std::streambuf *source): source(source), bytes(0) {}
+
+CountingBuffer::int_type CountingBuffer::underflow()
+{
+    return source->sgetc();
+}
+
+CountingBuffer::int_type CountingBuffer::uflow()
+{
+    int_type c = source->sbumpc();
+    if (!traits_type::eq_int_type(c, traits_type::eof())) {
+        bytes++;
+    }
+    return c;
+}
+
+CountingBuffer::int_type CountingBuffer::overflow(int_type c)
+{
+    if (traits_type::eq_int_type(c, traits_type::eof())) {
+        return traits_type::not_eof(c);
+    }
+    c = source->sputc(traits_type::to_char_type(c));
+    if (!traits_type::eq_int_type(c, traits_type::eof())) {
+        bytes++;
+    }
+    return c;
+}
+
+std::streamsize CountingBuffer::xsputn(const char *data, std::streamsize size)
+{
+    std::streamsize written = source->sputn(data, size);
+    bytes += written;
+    return written;
+}
+
+int CountingBuffer::sync()
+{
+    return source->pubsync();
+}
+
+size_t CountingBuffer::get_bytes() const
+{
+    return bytes;
+}
+
+std::streambuf *CountingBuffer::get_source() const
+{
+    return source;
+}
+
+StatsReport::StatsReport():
+    lexemes(0), nodes(0), variables(0), heap_peak(0), heap_total(0), heap_allocations(0),
+    bytes_read(0), bytes_written(0), counters(false)
+{
+    for (size_t i = 0; i < spCount; i++) {
+        phases[i] = PhaseTime{ 0.0, 0.0 };
+    }
+    runtime = RuntimeStats{ 0, 0, 0 };
+}
+
+// the phases that ran, with invalid events of any of them left out
+static PerfValues total_counters(const PhaseTime *phases)
+{
+    PerfValues result;
+    for (size_t i = 0; i < peCount; i++) {
+        result.counts[i] = 0;
+        result.valid[i] = false;
+        for (size_t phase = 0; phase < spCount; phase++) {
+            if (phases[phase].counters.valid[i]) {
+                result.counts[i] += phases[phase].counters.counts[i];
+                result.valid[i] = true;
+            }
+        }
+    }
+    return result;
+}
+
+static void print_count(std::ostream &stream, const PerfValues &values, PerfEvent event, int width)
+{
+    stream << std::setw(width);
+    if (!values.valid[event]) {
+        stream << "-";
+    } else if (event == peTaskClock) {
+        stream << values.counts[event] / 1e6;
+    } else {
+        stream << values.counts[event];
+    }
+}
+
+static void print_counters_row(std::ostream &stream, const char *name, const PerfValues &values)
+{
+    stream << std::left << std::setw(14) << name << std::right;
+    for (size_t i = 0; i < peCount; i++) {
+        print_count(stream, values, (PerfEvent)i, i == peTaskClock ? 12 : 15);
+        if (i == peInstructions) {
+            stream << std::setw(8);
+            if (values.valid[peCycles] && values.valid[peInstructions] && values.counts[peCycles] > 0) {
+                stream << (double)values.counts[peInstructions] / values.counts[peCycles];
+            } else {
+                stream << "-";
+            }
+        }
+    }
+    stream << std::endl;
+}
+
+void StatsReport::print_counters(std::ostream &stream) const
+{
+    stream << std::left << std::setw(14) << "phase" << std::right;
+    for (size_t i = 0; i < peCount; i++) {
+        stream << std::setw(i == peTaskClock ? 12 : 15) << (i == peTaskClock ? "task ms" : perf_event_name((PerfEvent)i));
+        if (i == peInstructions) {
+            stream << std::setw(8) << "IPC";
+        }
+    }
+    stream << std::endl;
+    for (size_t i = 0; i < spCount; i++) {
+        print_counters_row(stream, phase_names[i], phases[i].counters);
+    }
+    print_counters_row(stream, "total", total_counters(phases));
+    const PerfValues &execute = phases[spExecute].counters;
+    if (runtime.instructions == 0) {
+        return;
+    }
+    // the whole execution phase, reads and writes included, per executed RPN node
+    stream << "per rpn instruction:  ";
+    for (size_t i = 0; i < peCount; i++) {
+        if (execute.valid[i]) {
+            stream << " " << perf_event_name((PerfEvent)i) << " "
+                   << (double)execute.counts[i] / runtime.instructions << (i == peTaskClock ? " ns" : "");
+        }
+    }
+    stream << std::endl;
+}
+
+static void print_counters_json(std::ostream &stream, const PerfValues &values, double divisor)
+{
+    stream << "{";
+    for (size_t i = 0; i < peCount; i++) {
+        stream << (i > 0 ? ", " : "") << "\"" << perf_event_name((PerfEvent)i) << "\": ";
+        if (!values.valid[i]) {
+            stream << "null";
+        } else if (divisor == 1) {
+            stream << values.counts[i];
+        } else {
+            stream << values.counts[i] / divisor;
+        }
+    }
+    stream << "}";
+}
+
+void StatsReport::print_counters_json(std::ostream &stream) const
+{
+    stream << "  \"counters\": {";
+    for (size_t i = 0; i < spCount; i++) {
+        stream << (i > 0 ? "," : "") << "\n    \"" << phase_names[i] << "\": ";
+        ::print_counters_json(stream, phases[i].counters, 1);
+    }
+    stream << ",\n    \"total\": ";
+    ::print_counters_json(stream, total_counters(phases), 1);
+    if (runtime.instructions > 0) {
+        stream << ",\n    \"per_instruction\": ";
+        ::print_counters_json(stream, phases[spExecute].counters, runtime.instructions);
+    }
+    stream << "\n  },\n";
+}
+
+void StatsReport::print(std::ostream &stream) const
+{
+    std::ios::fmtflags flags = stream.flags();
+    PhaseTime total = { 0.0, 0.0 };
+    stream << std::fixed << std::setprecision(3);
+    stream << std::left << std::setw(14) << "phase" << std::right
+           << std::setw(12) << "wall ms" << std::setw(12) << "cpu ms" << std::endl;
+    for (size_t i = 0; i < spCount; i++) {
+        total = total + phases[i];
+        stream << std::left << std::setw(14) << phase_names[i] << std::right
+               << std::setw(12) << phases[i].wall * 1000 << std::setw(12) << phases[i].cpu * 1000 << std::endl;
+    }
+    stream << std::left << std::setw(14) << "total" << std::right
+           << std::setw(12) << total.wall * 1000 << std::setw(12) << total.cpu * 1000 << std::endl;
+    if (counters) {
+        print_counters(stream);
+    }
+    if (counters_note != "") {
+        stream << "hardware counters unavailable (" << counters_note << "), "
+               << (counters ? "software task clock only" : "phase timers only") << std::endl;
+    }
+    stream << "lexemes:               " << lexemes << std::endl;
+    stream << "rpn nodes:             " << nodes << std::endl;
+    stream << "variables:             " << variables << std::endl;
+    stream << "instructions executed: " << runtime.instructions << std::endl;
+    stream << "peak stack depth:      " << runtime.peak_stack << std::endl;
+    stream << "value allocations:     " << runtime.value_allocations << std::endl;
+    stream << "heap peak bytes:       " << heap_peak << std::endl;
+    stream << "heap total bytes:      " << heap_total << " in " << heap_allocations << " allocations" << std::endl;
+    stream << "bytes read:            " << bytes_read << std::endl;
+    stream << "bytes written:         " << bytes_written << std::endl;
+    stream.flags(flags);
+}
+
+void StatsReport::print_json(std::ostream &stream) const
+{
+    std::ios::fmtflags flags = stream.flags();
+    stream << std::fixed << std::setprecision(6);
+    stream << "{\n  \"phases\": {";
+    for (size_t i = 0; i < spCount; i++) {
+        stream << (i > 0 ? "," : "") << "\n    \"" << phase_names[i] << "\": {\"wall\": "
+               << phases[i].wall << ", \"cpu\": " << phases[i].cpu << "}";
+    }
+    stream << "\n  },\n";
+    if (counters) {
+        print_counters_json(stream);
+    }
+    if (counters_note != "") {
+        stream << "  \"counters_note\": \"" << counters_note << "\",\n";
+    }
+    stream << "  \"lexemes\": " << lexemes << ",\n";
+    stream << "  \"nodes\": " << nodes << ",\n";
+    stream << "  \"variables\": " << variables << ",\n";
+    stream << "  \"instructions\": " << runtime.instructions << ",\n";
+    stream << "  \"peak_stack\": " << runtime.peak_stack << ",\n";
+    stream << "  \"value_allocations\": " << runtime.value_allocations << ",\n";
+    stream << "  \"heap_peak\": " << heap_peak << ",\n";
+    stream << "  \"heap_total\": " << heap_total << ",\n";
+    stream << "  \"heap_allocations\": " << heap_allocations << ",\n";
+    stream << "  \"bytes_read\": " << bytes_read << ",\n";
+    stream << "  \"bytes_written\": " << bytes_written << "\n}\n";
+    stream.flags(flags);
+}
@@ -0,0 +1,94 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <chrono>
+#include <cstddef>
+#include <ctime>
+#include <iostream>
+#include <streambuf>
+#include <string>
+#include "perf.h"
+
+// wall and CPU time, in seconds, and the installed perf counters, if any
+struct PhaseTime {
+    double wall;
+    double cpu;
+    PerfValues counters;
+};
+
+PhaseTime operator+(const PhaseTime &left, const PhaseTime &right);
+PhaseTime operator-(const PhaseTime &left, const PhaseTime &right);
+
+// starts on construction; CPU time is of the whole process
+class PhaseTimer {
+private:
+    std::chrono::steady_clock::time_point wall_start;
+    std::clock_t cpu_start;
+    PerfValues counters_start;
+public:
+    PhaseTimer();
+    void restart();
+    PhaseTime elapsed() const;
+};
+
+// Filled by ExecutionContext::run(RuntimeStats &), accumulates over runs.
+// Values created by the dispatch loop are counted per executed node, so
+// the plain run() is not slowed down by the counting.
+struct RuntimeStats {
+    size_t instructions;
+    size_t peak_stack;
+    size_t value_allocations;
+};
+
+// Passes everything through to another buffer, counting the bytes.
+// Unbuffered, so reads never take more from the source than asked for.
+class CountingBuffer: public std::streambuf {
+private:
+    std::streambuf *source;
+    size_t bytes;
+protected:
+    int_type underflow() override;
+    int_type uflow() override;
+    int_type overflow(int_type c) override;
+    std::streamsize xsputn(const char *data, std::streamsize size) override;
+    int sync() override;
+public:
+    explicit CountingBuffer(std::streambuf *source);
+    size_t get_bytes() const;
+    std::streambuf *get_source() const;
+};
+
+enum StatsPhase {
+    spLex,
+    spParse,
+    spLabels,
+    spPrecompute,
+    spExecute,
+    spCount
+};
+
+// the --stats report
+struct StatsReport {
+    PhaseTime phases[spCount];
+    size_t lexemes;
+    size_t nodes;
+    size_t variables;
+    RuntimeStats runtime;
+    // with --batch, the totals include every job and the peak is the largest of any thread
+    size_t heap_peak;
+    size_t heap_total;
+    size_t heap_allocations;
+    size_t bytes_read;
+    size_t bytes_written;
+    // print the perf counters of the phases; the note tells why the hardware ones are missing
+    bool counters;
+    std::string counters_note;
+
+    StatsReport();
+    void print_counters(std::ostream &stream) const;
+    void print_counters_json(std::ostream &stream) const;
+    void print(std::ostream &stream) const;
+    void print_json(std::ostream &stream) const;
+};
+
+#endif // STATS_H
@@ -1,6 +1,10 @@
 #include <sstream>
+#include <utility>
 #include "exceptions.h"
 #include "syntax.h"
+#include "initialization.h"
+#include "memory.h"
+#include "probes.h"
 
 static inline ValueType keyword_to_value_type(LexemeType lexeme)
 {
@@ -52,11 +56,11 @@ static inline std::string value_type_to_string(ValueType type)
 
 SyntaxAnalyzer::SyntaxAnalyzer(bool comparison_chains, bool lazy_evaluations):
     comparison_chains(comparison_chains), lazy_evaluations(lazy_evaluations),
-    pos(0), cur_lexeme(NULL), cur_lexeme_type(ltNone) {}
+    lexemes(NULL), lexemes_count(0), pos(0), cur_lexeme(NULL), cur_lexeme_type(ltNone), statement(NULL), propagation_time{ 0.0, 0.0 } {}
 
 void SyntaxAnalyzer::get_next_lexeme()
 {
-    if (pos == lexemes.size()) {
+    if (pos == lexemes_count) {
         cur_lexeme = NULL;
         cur_lexeme_type = ltNone;
     } else {
@@ -109,6 +113,46 @@ void SyntaxAnalyzer::throw_type_mismatch(const Lexeme *where, ValueType left, Va
                                           " and " + value_type_to_string(right) + ")");
 }
 
+void SyntaxAnalyzer::reserve_tables()
+{
+    // upper bounds counted over the lexemes, so that neither table grows: if, else,
+    // while and do make at most three labels and jumps, and, or, break and continue
+    // one of each; a line entry starts when a statement begins or its parent resumes
+    size_t controls = 0, jumps = 0, statements_count = 0;
+    for (size_t i = 0; i < lexemes_count; i++) {
+        switch (lexemes[i].get_type()) {
+        case ltIf:
+        case ltElse:
+        case ltWhile:
+        case ltDo:
+            controls++;
+            break;
+        case ltAnd:
+        case ltOr:
+        case ltBreak:
+        case ltContinue:
+            jumps++;
+            break;
+        case ltSemicolon:
+        case ltBlockOpen:
+            statements_count++;
+            break;
+        default:
+            ;
+        }
+    }
+    labels.reserve(controls * 3 + jumps, controls * 3 + jumps);
+    lines.reserve((statements_count + controls) * 2 + 1);
+}
+
+void SyntaxAnalyzer::gen_node(const ProgramNode &node)
+{
+    if (statement != NULL) {
+        lines.add(program.size(), statement->get_line(), statement->get_pos());
+    }
+    program.push_back(node);
+}
+
 void SyntaxAnalyzer::gen_constant(ValueType type, const std::string &value)
 {
     ProgramNode result;
@@ -129,7 +173,7 @@ void SyntaxAnalyzer::gen_constant(ValueType type, const std::string &value)
     default:
         throw std::runtime_error("Unknown constant type");
     }
-    program.push_back(result);
+    gen_node(result);
 }
 
 void SyntaxAnalyzer::gen_constant(Integer value)
@@ -137,7 +181,7 @@ void SyntaxAnalyzer::gen_constant(Integer value)
     ProgramNode result;
     result.type = ntValue;
     result.data.value = new IntegerValue(value);
-    program.push_back(result);
+    gen_node(result);
 }
 
 void SyntaxAnalyzer::gen_operation(Operation operation)
@@ -145,12 +189,12 @@ void SyntaxAnalyzer::gen_operation(Operation operation)
     ProgramNode result;
     result.type = ntOperation;
     result.data.operation = operation;
-    program.push_back(result);
+    gen_node(result);
 }
 
 void SyntaxAnalyzer::gen_label(LabelID label)
 {
-    labels.set_value(label, new IntegerValue(program.size()));
+    labels.set_address(label, program.size());
 }
 
 void SyntaxAnalyzer::gen_jump(LabelID label, JumpType type)
@@ -160,7 +204,7 @@ void SyntaxAnalyzer::gen_jump(LabelID label, JumpType type)
     switch (type) {
     case jtUnconditional:
         result.data.value = new BooleanValue(false);
-        program.push_back(result);
+        gen_node(result);
         break;
     case jtAtTrue:
         gen_operation(opBoolNot);
@@ -170,7 +214,7 @@ void SyntaxAnalyzer::gen_jump(LabelID label, JumpType type)
     }
     labels.add_node(label, program.size());
     result.data.value = NULL;
-    program.push_back(result);
+    gen_node(result);
     gen_operation(opJump);
 }
 
@@ -182,10 +226,13 @@ void SyntaxAnalyzer::state_program()
     check_lexeme(ltProgram, "program should starts with 'program' keyword");
     check_lexeme(ltBlockOpen, "expected '{'");
     state_descriptions();
-    state_operators(undefined_label, undefined_label);
+    state_operators();
     check_lexeme(ltBlockClose, "expected '}'");
     check_lexeme(ltNone, "unexpected continuation after program end");
+    PhaseTimer timer;
+    AllocationScope scope(msLabels);
     labels.propagate(program);
+    propagation_time = timer.elapsed();
 }
 
 void SyntaxAnalyzer::state_descriptions()
@@ -209,7 +256,8 @@ void SyntaxAnalyzer::state_description(ValueType variable_type)
 
 void SyntaxAnalyzer::state_variable(ValueType variable_type)
 {
-    Lexeme *lexeme = cur_lexeme;
+    const Lexeme *lexeme = cur_lexeme;
+    statement = lexeme;
     check_lexeme(ltIdentificator, "is not a valid identificator");
 
     if (!variables.register_name(lexeme->get_value(), variable_type)) {
@@ -236,20 +284,96 @@ void SyntaxAnalyzer::state_variable(ValueType variable_type)
     }
 }
 
-void SyntaxAnalyzer::state_operators(LabelID cont_label, LabelID break_label)
+// Statements are parsed without recursion: a compound statement pushes a
+// frame, and once its nested statement is complete resume_statement() goes
+// on with the frame on top.
+void SyntaxAnalyzer::state_operators()
+{
+    statements.clear();
+    statements.push_back(StatementFrame{ skProgram, NULL, statement, undefined_label, undefined_label,
+                                         undefined_label, false });
+    while (!statements.empty()) {
+        if (resume_statement()) {
+            state_operator(statements.back().cont_label, statements.back().break_label);
+        } else {
+            statement = statements.back().outer_statement;
+            statements.pop_back();
+        }
+    }
+}
+
+// returns true if a nested statement follows, false once the frame on top is complete
+bool SyntaxAnalyzer::resume_statement()
 {
-    while (cur_lexeme_type != ltBlockClose) {
-        state_operator(cont_label, break_label);
+    StatementFrame &frame = statements.back();
+    LabelID else_end;
+    bool first = !frame.started;
+    frame.started = true;
+    switch (frame.kind) {
+    case skProgram:
+        return cur_lexeme_type != ltBlockClose;
+    case skBlock:
+        if (cur_lexeme_type != ltBlockClose) {
+            return true;
+        }
+        check_lexeme(ltBlockClose, "expected '}'");
+        return false;
+    case skIf:
+        if (first) {
+            return true;
+        }
+        if (cur_lexeme_type != ltElse) {
+            gen_label(frame.label);
+            return false;
+        }
+        get_next_lexeme();
+        else_end = labels.new_label();
+        gen_jump(else_end, jtUnconditional);
+        gen_label(frame.label);
+        frame.kind = skElse;
+        frame.label = else_end;
+        return true;
+    case skElse:
+        gen_label(frame.label);
+        return false;
+    case skWhile:
+        if (first) {
+            return true;
+        }
+        gen_jump(frame.cont_label, jtUnconditional);
+        gen_label(frame.break_label);
+        return false;
+    case skDo:
+        if (first) {
+            return true;
+        }
+        frame.lexeme = cur_lexeme;
+        statement = frame.lexeme;
+        check_lexeme(ltWhile, "expected 'while' keyword");
+        check_lexeme(ltBracketOpen, "expected '('");
+        gen_label(frame.cont_label);
+        if (state_expression().type != vtBoolean) {
+            throw_semantic_error(frame.lexeme, "condition should be boolean");
+        }
+        gen_jump(frame.label, jtAtTrue);
+        check_lexeme(ltBracketClose, "expected ')'");
+        check_lexeme(ltSemicolon, "expected ';'");
+        gen_label(frame.break_label);
+        return false;
     }
+    return false;
 }
 
+// parses a simple statement, or the head of a compound one and pushes its frame
 void SyntaxAnalyzer::state_operator(LabelID cont_label, LabelID break_label)
 {
-    Lexeme *lexeme = cur_lexeme;
+    const Lexeme *lexeme = cur_lexeme;
+    const Lexeme *outer_statement = statement;
     VariableID var;
-    LabelID then_end, else_end;
+    LabelID then_end;
     LabelID condition, loop_start, loop_end;
 
+    statement = lexeme;
     switch (cur_lexeme_type) {
     case ltNone:
         throw_syntax_error("expected '}'");
@@ -263,18 +387,9 @@ void SyntaxAnalyzer::state_operator(LabelID cont_label, LabelID break_label)
         }
         check_lexeme(ltBracketClose, "expected ')'");
         gen_jump(then_end, jtAtFalse);
-        state_operator(cont_label, break_label);
-        if (cur_lexeme_type == ltElse) {
-            get_next_lexeme();
-            else_end = labels.new_label();
-            gen_jump(else_end, jtUnconditional);
-            gen_label(then_end);
-            state_operator(cont_label, break_label);
-            gen_label(else_end);
-        } else {
-            gen_label(then_end);
-        }
-        break;
+        statements.push_back(StatementFrame{ skIf, lexeme, outer_statement, cont_label, break_label,
+                                             then_end, false });
+        return;
     case ltWhile:
         condition = labels.new_label();
         loop_end = labels.new_label();
@@ -286,29 +401,18 @@ void SyntaxAnalyzer::state_operator(LabelID cont_label, LabelID break_label)
         }
         gen_jump(loop_end, jtAtFalse);
         check_lexeme(ltBracketClose, "expected ')'");
-        state_operator(condition, loop_end);
-        gen_jump(condition, jtUnconditional);
-        gen_label(loop_end);
-        break;
+        statements.push_back(StatementFrame{ skWhile, lexeme, outer_statement, condition, loop_end,
+                                             undefined_label, false });
+        return;
     case ltDo:
         condition = labels.new_label();
         loop_start = labels.new_label();
         loop_end = labels.new_label();
         get_next_lexeme();
         gen_label(loop_start);
-        state_operator(condition, loop_end);
-        lexeme = cur_lexeme;
-        check_lexeme(ltWhile, "expected 'while' keyword");
-        check_lexeme(ltBracketOpen, "expected '('");
-        gen_label(condition);
-        if (state_expression().type != vtBoolean) {
-            throw_semantic_error(lexeme, "condition should be boolean");
-        }
-        gen_jump(loop_start, jtAtTrue);
-        check_lexeme(ltBracketClose, "expected ')'");
-        check_lexeme(ltSemicolon, "expected ';'");
-        gen_label(loop_end);
-        break;
+        statements.push_back(StatementFrame{ skDo, lexeme, outer_statement, condition, loop_end,
+                                             loop_start, false });
+        return;
     case ltContinue:
         get_next_lexeme();
         check_lexeme(ltSemicolon, "expected ';'");
@@ -371,415 +475,455 @@ void SyntaxAnalyzer::state_operator(LabelID cont_label, LabelID break_label)
         break;
     case ltBlockOpen:
         check_lexeme(ltBlockOpen, "expected '{'");
-        state_operators(cont_label, break_label);
-        check_lexeme(ltBlockClose, "expected '}'");
-        break;
+        statements.push_back(StatementFrame{ skBlock, lexeme, outer_statement, cont_label, break_label,
+                                             undefined_label, false });
+        return;
     default:
         state_expression();
         check_lexeme(ltSemicolon, "expected ';'");
         gen_operation(opClearStack);
         break;
     }
+    statement = outer_statement;
 }
 
-ValueInfo SyntaxAnalyzer::state_expression()
+static inline bool is_comparer(LexemeType lexeme)
 {
-    Lexeme *lexeme;
-    ValueInfo cur, prev, first;
-    ProgramNodes variable_links;
-
-    first = cur = state_expression_or();
-    while (cur_lexeme_type == ltAssign) {
-        lexeme = cur_lexeme;
-        get_next_lexeme();
-        prev = cur;
+    return lexeme >= ltComparersStart && lexeme <= ltComparersEnd;
+}
 
-        if (!prev.is_var) {
-            throw_semantic_error(lexeme, "assignation to non-variable");
-        }
-        program.pop_back();
-        variable_links.push_back(program.back());
-        program.pop_back();
+static inline bool is_unary(LexemeType lexeme)
+{
+    return lexeme >= ltUnaryOperationsStart && lexeme <= ltUnaryOperationsEnd;
+}
 
-        cur = state_expression_or();
-        if ((cur.type == vtString) ^ (prev.type == vtString) ||
-            (cur.type == vtBoolean) ^ (prev.type == vtBoolean)) {
-            throw_type_mismatch(lexeme, prev.type, cur.type);
-        }
-    }
-    while (!variable_links.empty()) {
-        program.push_back(variable_links.back());
-        variable_links.pop_back();
-        gen_operation(opSaveVariable);
+SyntaxAnalyzer::Precedence SyntaxAnalyzer::binary_precedence(LexemeType lexeme)
+{
+    switch (lexeme) {
+    case ltAssign:
+        return pcAssign;
+    case ltOr:
+        return pcOr;
+    case ltAnd:
+        return pcAnd;
+    case ltPlus:
+    case ltMinus:
+        return pcSum;
+    case ltMul:
+    case ltDiv:
+    case ltMod:
+        return pcMul;
+    default:
+        return is_comparer(lexeme) ? pcCompare : pcNone;
     }
-    return first;
 }
 
-ValueInfo SyntaxAnalyzer::state_expression_or()
+// Precedence climbing over explicit stacks: prefix operators and brackets
+// are pending until their operand is complete, and a binary operator first
+// completes the pending ones that bind at least as tight (assignments,
+// right associative, are completed at the end of their chain). The code is
+// generated in the same order as by one function per precedence level.
+ValueInfo SyntaxAnalyzer::state_expression()
 {
-    Lexeme *lexeme;
-    ValueInfo cur, prev;
-    LabelID exp_end = undefined_label;
-
-    cur = state_expression_and();
-    if (lazy_evaluations && cur_lexeme_type == ltOr) {
-        exp_end = labels.new_label();
-    }
-    while (cur_lexeme_type == ltOr) {
-        if (lazy_evaluations) {
-            gen_operation(opDup);
-            gen_jump(exp_end, jtAtTrue);
+    while (true) {
+        while (is_unary(cur_lexeme_type) || cur_lexeme_type == ltBracketOpen) {
+            Precedence precedence = cur_lexeme_type == ltBracketOpen ? pcNone : pcUnary;
+            operators.push_back(PendingOperator{ cur_lexeme, precedence, undefined_label, false,
+                                                 ValueInfo(), 0 });
+            get_next_lexeme();
         }
-
-        lexeme = cur_lexeme;
-        get_next_lexeme();
-        prev = cur;
-        cur = state_expression_and();
-        cur.is_var = false;
-
-        if (cur.type != vtBoolean || prev.type != vtBoolean) {
-            throw_type_mismatch(lexeme, prev.type, cur.type);
+        operands.push_back(state_operand());
+
+        Precedence precedence = binary_precedence(cur_lexeme_type);
+        while (precedence == pcNone) {
+            reduce(pcNone);
+            if (operators.empty()) {
+                ValueInfo result = operands.back();
+                operands.pop_back();
+                return result;
+            }
+            // an open bracket
+            operators.pop_back();
+            operands.back().is_var = false;
+            if (cur_lexeme_type == ltBracketClose) {
+                get_next_lexeme();
+            } else {
+                throw_syntax_error("expected ')'");
+            }
+            precedence = binary_precedence(cur_lexeme_type);
         }
-
-        gen_operation(opBoolOr);
+        state_binary_operator(precedence);
     }
-    if (exp_end != undefined_label) {
-        gen_label(exp_end);
+}
+
+void SyntaxAnalyzer::state_binary_operator(Precedence precedence)
+{
+    reduce(precedence);
+    if (precedence == pcAssign) {
+        state_assignment();
+        return;
+    }
+    PendingOperator pending = { cur_lexeme, precedence, undefined_label, false, ValueInfo(), 0 };
+    if (!operators.empty() && operators.back().precedence == precedence) {
+        // left associative: the previous operator is complete, its chain goes on
+        PendingOperator previous = operators.back();
+        operators.pop_back();
+        reduce_operator(previous, true);
+        pending.label = previous.label;
+        pending.chained = true;
+    }
+    if (lazy_evaluations && (precedence == pcOr || precedence == pcAnd)) {
+        if (pending.label == undefined_label) {
+            pending.label = labels.new_label();
+        }
+        gen_operation(opDup);
+        gen_jump(pending.label, precedence == pcOr ? jtAtTrue : jtAtFalse);
+    } else if (comparison_chains && precedence == pcCompare && pending.chained) {
+        // load previous constant
+        gen_constant(0);
+        gen_operation(opLoadVariable);
     }
-    return cur;
+    get_next_lexeme();
+    operators.push_back(pending);
 }
 
-ValueInfo SyntaxAnalyzer::state_expression_and()
+void SyntaxAnalyzer::state_assignment()
 {
-    Lexeme *lexeme;
-    ValueInfo cur, prev;
-    LabelID exp_end = undefined_label;
+    const Lexeme *lexeme = cur_lexeme;
+    ValueInfo target = operands.back();
+    get_next_lexeme();
 
-    cur = state_expression_cmp();
-    if (lazy_evaluations && cur_lexeme_type == ltAnd) {
-        exp_end = labels.new_label();
+    if (!operators.empty() && operators.back().precedence == pcAssign) {
+        // the value of a chain is its first target, which stays on the operand stack
+        PendingOperator &chain = operators.back();
+        check_assignment(chain.lexeme, chain.target, target);
+        operands.pop_back();
+        chain.lexeme = lexeme;
+        chain.target = target;
+    } else {
+        operators.push_back(PendingOperator{ lexeme, pcAssign, undefined_label, false, target,
+                                             variable_links.size() });
     }
-    while (cur_lexeme_type == ltAnd) {
-        if (lazy_evaluations) {
-            gen_operation(opDup);
-            gen_jump(exp_end, jtAtFalse);
-        }
+    if (!target.is_var) {
+        throw_semantic_error(lexeme, "assignation to non-variable");
+    }
+    program.pop_back();
+    variable_links.push_back(program.back());
+    program.pop_back();
+}
 
-        lexeme = cur_lexeme;
+ValueInfo SyntaxAnalyzer::state_operand()
+{
+    ValueInfo result;
+    if (cur_lexeme_type >= ltConstantsStart && cur_lexeme_type <= ltConstantsEnd) {
+        result.type = constant_to_value_type(cur_lexeme_type);
+        result.is_var = false;
+        gen_constant(result.type, cur_lexeme->get_value());
         get_next_lexeme();
-        prev = cur;
-        cur = state_expression_cmp();
-        cur.is_var = false;
-
-        if (cur.type != vtBoolean || prev.type != vtBoolean) {
-            throw_type_mismatch(lexeme, prev.type, cur.type);
+    } else if (cur_lexeme_type == ltIdentificator) {
+        VariableID id = variables.get_number(cur_lexeme->get_value());
+        if (id < 0) {
+            throw_semantic_error(cur_lexeme, "variable is not defined");
         }
-
-        gen_operation(opBoolAnd);
-    }
-    if (exp_end != undefined_label) {
-        gen_label(exp_end);
+        result.type = variables.get_type(id);
+        result.is_var = true;
+        gen_constant(id);
+        gen_operation(opLoadVariable);
+        get_next_lexeme();
+    } else {
+       throw_syntax_error("expected operand");
     }
-    return cur;
+    return result;
 }
 
-static inline bool is_comparer(LexemeType lexeme)
+// completes the pending operators down to the first one binding looser than precedence
+void SyntaxAnalyzer::reduce(Precedence precedence)
 {
-    return lexeme >= ltComparersStart && lexeme <= ltComparersEnd;
+    while (!operators.empty() && operators.back().precedence > precedence) {
+        PendingOperator pending = operators.back();
+        operators.pop_back();
+        reduce_operator(pending, false);
+    }
 }
 
-ValueInfo SyntaxAnalyzer::state_expression_cmp()
+// continues is true if the next operator has the same precedence
+void SyntaxAnalyzer::reduce_operator(const PendingOperator &pending, bool continues)
 {
-    Lexeme *lexeme;
-    ValueInfo cur, prev;
-    bool first_cmp = true;
-
-    cur = state_expression_sum();
-    while (is_comparer(cur_lexeme_type)) {
-        if (comparison_chains && !first_cmp) {
-            // load previous constant
-            gen_constant(0);
-            gen_operation(opLoadVariable);
+    const Lexeme *lexeme = pending.lexeme;
+    if (pending.precedence == pcUnary) {
+        operands.back() = gen_unary(lexeme, operands.back());
+        return;
+    }
+    ValueInfo cur = operands.back();
+    operands.pop_back();
+    if (pending.precedence == pcAssign) {
+        check_assignment(lexeme, pending.target, cur);
+        while (variable_links.size() > pending.links_start) {
+            program.push_back(variable_links.back());
+            variable_links.pop_back();
+            gen_operation(opSaveVariable);
         }
+        return;
+    }
+    ValueInfo prev = operands.back();
+    cur.is_var = false;
 
-        lexeme = cur_lexeme;
-        get_next_lexeme();
-        prev = cur;
-        cur = state_expression_sum();
-        cur.is_var = false;
-
-        if (comparison_chains && is_comparer(cur_lexeme_type)) {
+    switch (pending.precedence) {
+    case pcOr:
+    case pcAnd:
+        if (cur.type != vtBoolean || prev.type != vtBoolean) {
+            throw_type_mismatch(lexeme, prev.type, cur.type);
+        }
+        gen_operation(pending.precedence == pcOr ? opBoolOr : opBoolAnd);
+        if (!continues && pending.label != undefined_label) {
+            gen_label(pending.label);
+        }
+        break;
+    case pcCompare:
+        if (comparison_chains && continues) {
             // save constant for next comparison
             gen_constant(0);
             gen_operation(opSaveVariable);
         }
-
-        if (cur.type == vtString && prev.type == vtString) {
-            switch (lexeme->get_type()) {
-            case ltSm:
-                gen_operation(opStrSm);
-                break;
-            case ltGr:
-                gen_operation(opStrGr);
-                break;
-            case ltEq:
-                gen_operation(opStrEq);
-                break;
-            case ltNotEq:
-                gen_operation(opStrNotEq);
-                break;
-            default:
-                throw_type_mismatch(lexeme, prev.type, cur.type);
-            };
-        } else {
-            if (cur.type == vtString || prev.type == vtString ||
-                cur.type == vtBoolean || prev.type == vtBoolean) {
-                throw_type_mismatch(lexeme, prev.type, cur.type);
-            }
-
-            if (cur.type == vtReal || prev.type == vtReal) {
-                switch (lexeme->get_type()) {
-                case ltSm:
-                    gen_operation(opRealSm);
-                    break;
-                case ltGr:
-                    gen_operation(opRealGr);
-                    break;
-                case ltSmEq:
-                    gen_operation(opRealSmEq);
-                    break;
-                case ltGrEq:
-                    gen_operation(opRealGrEq);
-                    break;
-                case ltEq:
-                    gen_operation(opRealEq);
-                    break;
-                case ltNotEq:
-                    gen_operation(opRealNotEq);
-                    break;
-                default:
-                    throw_type_mismatch(lexeme, prev.type, cur.type);
-                };
-            } else {
-                switch (lexeme->get_type()) {
-                case ltSm:
-                    gen_operation(opIntSm);
-                    break;
-                case ltGr:
-                    gen_operation(opIntGr);
-                    break;
-                case ltSmEq:
-                    gen_operation(opIntSmEq);
-                    break;
-                case ltGrEq:
-                    gen_operation(opIntGrEq);
-                    break;
-                case ltEq:
-                    gen_operation(opIntEq);
-                    break;
-                case ltNotEq:
-                    gen_operation(opIntNotEq);
-                    break;
-                default:
-                    throw_type_mismatch(lexeme, prev.type, cur.type);
-                };
-            }
+        gen_comparison(lexeme, prev, cur);
+        if (comparison_chains && pending.chained) {
+            gen_operation(opBoolAnd);
         }
-
-        if (!comparison_chains) {
+        // a chain compares each operand with the next one
+        if (!comparison_chains || !continues) {
             cur.type = vtBoolean;
-            continue;
         }
-        if (!first_cmp) {
-            gen_operation(opBoolAnd);
-        }
-        first_cmp = false;
-    }
-    if (comparison_chains && !first_cmp) {
-        cur.type = vtBoolean;
+        break;
+    case pcSum:
+        cur.type = gen_sum(lexeme, prev, cur);
+        break;
+    case pcMul:
+        cur.type = gen_mul(lexeme, prev, cur);
+        break;
+    default:
+        break;
     }
-    return cur;
+    operands.back() = cur;
 }
 
-ValueInfo SyntaxAnalyzer::state_expression_sum()
+ValueInfo SyntaxAnalyzer::gen_unary(const Lexeme *lexeme, ValueInfo operand)
 {
-    Lexeme *lexeme;
-    ValueInfo cur, prev;
-
-    cur = state_expression_mul();
-    while (cur_lexeme_type == ltPlus || cur_lexeme_type == ltMinus) {
-        lexeme = cur_lexeme;
-        get_next_lexeme();
-        prev = cur;
-        cur = state_expression_mul();
-        cur.is_var = false;
-
-        if (lexeme->get_type() == ltPlus && cur.type == vtString && prev.type == vtString) {
-            gen_operation(opStrPlus);
-            cur.type = vtString;
-            continue;
-        }
+    LexemeType lexeme_type = lexeme->get_type();
+    bool correct = true;
 
-        if (cur.type == vtString || prev.type == vtString ||
-            cur.type == vtBoolean || prev.type == vtBoolean) {
-            throw_type_mismatch(lexeme, prev.type, cur.type);
+    operand.is_var = false;
+    switch (operand.type) {
+    case vtInteger:
+        if (lexeme_type == ltPlusUn) {
+            gen_operation(opIntPlusUn);
+        } else if (lexeme_type == ltMinusUn) {
+            gen_operation(opIntMinusUn);
+        } else {
+            correct = false;
         }
-
-        if (cur.type == vtReal || prev.type == vtReal) {
-            gen_operation(lexeme->get_type() == ltPlus ? opRealPlus : opRealMinus);
-            cur.type = vtReal;
+        break;
+    case vtString:
+        if (lexeme_type == ltPlusUn) {
+            gen_operation(opStrPlusUn);
         } else {
-            gen_operation(lexeme->get_type() == ltPlus ? opIntPlus : opIntMinus);
-            cur.type = vtInteger;
+            correct = false;
         }
-    }
-    return cur;
-}
-
-ValueInfo SyntaxAnalyzer::state_expression_mul()
-{
-    Lexeme *lexeme;
-    LexemeType lexeme_type;
-    ValueInfo cur, prev;
-
-    cur = state_expression_un();
-    while (cur_lexeme_type == ltMul || cur_lexeme_type == ltDiv || cur_lexeme_type == ltMod) {
-        lexeme = cur_lexeme;
-        lexeme_type = cur_lexeme_type;
-        get_next_lexeme();
-        prev = cur;
-        cur = state_expression_un();
-        cur.is_var = false;
-
-        if (cur.type == vtString || prev.type == vtString ||
-            cur.type == vtBoolean || prev.type == vtBoolean) {
-            throw_type_mismatch(lexeme, prev.type, cur.type);
+        break;
+    case vtBoolean:
+        if (lexeme_type == ltNot) {
+            gen_operation(opBoolNot);
+        } else {
+            correct = false;
         }
-
-        if (cur.type == vtReal || prev.type == vtReal) {
-            if (lexeme_type == ltMul) {
-                gen_operation(opRealMul);
-            } else if (lexeme_type == ltDiv) {
-                gen_operation(opRealDiv);
-            } else if (lexeme_type == ltMod) {
-                throw_type_mismatch(lexeme, prev.type, cur.type);
-            }
-            cur.type = vtReal;
+        break;
+    case vtReal:
+        if (lexeme_type == ltPlusUn) {
+            gen_operation(opRealPlusUn);
+        } else if (lexeme_type == ltMinusUn) {
+            gen_operation(opRealMinusUn);
         } else {
-            if (lexeme_type == ltMul) {
-                gen_operation(opIntMul);
-            } else if (lexeme_type == ltDiv) {
-                gen_operation(opIntDiv);
-            } else if (lexeme_type == ltMod) {
-                gen_operation(opIntMod);
-            }
-            cur.type = vtInteger;
+            correct = false;
         }
+        break;
+    default:
+        correct = false;
+        break;
+    }
+    if (!correct) {
+        throw_semantic_error(lexeme, "type mismatch (" +
+                             value_type_to_string(operand.type) + ")");
     }
-    return cur;
+    return operand;
 }
 
-ValueInfo SyntaxAnalyzer::state_expression_un()
+void SyntaxAnalyzer::gen_comparison(const Lexeme *lexeme, ValueInfo prev, ValueInfo cur)
 {
-    if (cur_lexeme_type >= ltUnaryOperationsStart && cur_lexeme_type <= ltUnaryOperationsEnd) {
-        Lexeme *lexeme = cur_lexeme;
-        LexemeType lexeme_type = cur_lexeme_type;
-        ValueInfo result;
-        bool correct = true;
-
-        get_next_lexeme();
-        result = state_expression_un();
-        result.is_var = false;
-        switch (result.type) {
-        case vtInteger:
-            if (lexeme_type == ltPlusUn) {
-                gen_operation(opIntPlusUn);
-            } else if (lexeme_type == ltMinusUn) {
-                gen_operation(opIntMinusUn);
-            } else {
-                correct = false;
-            }
+    if (cur.type == vtString && prev.type == vtString) {
+        switch (lexeme->get_type()) {
+        case ltSm:
+            gen_operation(opStrSm);
             break;
-        case vtString:
-            if (lexeme_type == ltPlusUn) {
-                gen_operation(opStrPlusUn);
-            } else {
-                correct = false;
-            }
+        case ltGr:
+            gen_operation(opStrGr);
             break;
-        case vtBoolean:
-            if (lexeme_type == ltNot) {
-                gen_operation(opBoolNot);
-            } else {
-                correct = false;
-            }
+        case ltEq:
+            gen_operation(opStrEq);
             break;
-        case vtReal:
-            if (lexeme_type == ltPlusUn) {
-                gen_operation(opRealPlusUn);
-            } else if (lexeme_type == ltMinusUn) {
-                gen_operation(opRealMinusUn);
-            } else {
-                correct = false;
-            }
+        case ltNotEq:
+            gen_operation(opStrNotEq);
             break;
         default:
-            correct = false;
+            throw_type_mismatch(lexeme, prev.type, cur.type);
+        };
+        return;
+    }
+    if (cur.type == vtString || prev.type == vtString ||
+        cur.type == vtBoolean || prev.type == vtBoolean) {
+        throw_type_mismatch(lexeme, prev.type, cur.type);
+    }
+
+    if (cur.type == vtReal || prev.type == vtReal) {
+        switch (lexeme->get_type()) {
+        case ltSm:
+            gen_operation(opRealSm);
             break;
-        }
-        if (!correct) {
-            throw_semantic_error(lexeme, "type mismatch (" +
-                                 value_type_to_string(result.type) + ")");
-        }
-        return result;
+        case ltGr:
+            gen_operation(opRealGr);
+            break;
+        case ltSmEq:
+            gen_operation(opRealSmEq);
+            break;
+        case ltGrEq:
+            gen_operation(opRealGrEq);
+            break;
+        case ltEq:
+            gen_operation(opRealEq);
+            break;
+        case ltNotEq:
+            gen_operation(opRealNotEq);
+            break;
+        default:
+            throw_type_mismatch(lexeme, prev.type, cur.type);
+        };
     } else {
-        return state_operand();
+        switch (lexeme->get_type()) {
+        case ltSm:
+            gen_operation(opIntSm);
+            break;
+        case ltGr:
+            gen_operation(opIntGr);
+            break;
+        case ltSmEq:
+            gen_operation(opIntSmEq);
+            break;
+        case ltGrEq:
+            gen_operation(opIntGrEq);
+            break;
+        case ltEq:
+            gen_operation(opIntEq);
+            break;
+        case ltNotEq:
+            gen_operation(opIntNotEq);
+            break;
+        default:
+            throw_type_mismatch(lexeme, prev.type, cur.type);
+        };
     }
 }
 
-ValueInfo SyntaxAnalyzer::state_operand()
+ValueType SyntaxAnalyzer::gen_sum(const Lexeme *lexeme, ValueInfo prev, ValueInfo cur)
 {
-    ValueInfo result;
-    if (cur_lexeme_type >= ltConstantsStart && cur_lexeme_type <= ltConstantsEnd) {
-        result.type = constant_to_value_type(cur_lexeme_type);
-        result.is_var = false;
-        gen_constant(result.type, cur_lexeme->get_value());
-        get_next_lexeme();
-    } else if (cur_lexeme_type == ltIdentificator) {
-        VariableID id = variables.get_number(cur_lexeme->get_value());
-        if (id < 0) {
-            throw_semantic_error(cur_lexeme, "variable is not defined");
-        }
-        result.type = variables.get_type(id);
-        result.is_var = true;
-        gen_constant(id);
-        gen_operation(opLoadVariable);
-        get_next_lexeme();
-    } else if (cur_lexeme_type == ltBracketOpen) {
-        get_next_lexeme();
-        result = state_expression();
-        result.is_var = false;
-        if (cur_lexeme_type == ltBracketClose) {
-            get_next_lexeme();
-        } else {
-            throw_syntax_error("expected ')'");
+    if (lexeme->get_type() == ltPlus && cur.type == vtString && prev.type == vtString) {
+        gen_operation(opStrPlus);
+        return vtString;
+    }
+
+    if (cur.type == vtString || prev.type == vtString ||
+        cur.type == vtBoolean || prev.type == vtBoolean) {
+        throw_type_mismatch(lexeme, prev.type, cur.type);
+    }
+
+    if (cur.type == vtReal || prev.type == vtReal) {
+        gen_operation(lexeme->get_type() == ltPlus ? opRealPlus : opRealMinus);
+        return vtReal;
+    }
+    gen_operation(lexeme->get_type() == ltPlus ? opIntPlus : opIntMinus);
+    return vtInteger;
+}
+
+ValueType SyntaxAnalyzer::gen_mul(const Lexeme *lexeme, ValueInfo prev, ValueInfo cur)
+{
+    LexemeType lexeme_type = lexeme->get_type();
+
+    if (cur.type == vtString || prev.type == vtString ||
+        cur.type == vtBoolean || prev.type == vtBoolean) {
+        throw_type_mismatch(lexeme, prev.type, cur.type);
+    }
+
+    if (cur.type == vtReal || prev.type == vtReal) {
+        if (lexeme_type == ltMul) {
+            gen_operation(opRealMul);
+        } else if (lexeme_type == ltDiv) {
+            gen_operation(opRealDiv);
+        } else if (lexeme_type == ltMod) {
+            throw_type_mismatch(lexeme, prev.type, cur.type);
         }
-    } else {
-       throw_syntax_error("expected operand");
+        return vtReal;
+    }
+    if (lexeme_type == ltMul) {
+        gen_operation(opIntMul);
+    } else if (lexeme_type == ltDiv) {
+        gen_operation(opIntDiv);
+    } else if (lexeme_type == ltMod) {
+        gen_operation(opIntMod);
+    }
+    return vtInteger;
+}
+
+void SyntaxAnalyzer::check_assignment(const Lexeme *lexeme, ValueInfo prev, ValueInfo cur)
+{
+    if ((cur.type == vtString) ^ (prev.type == vtString) ||
+        (cur.type == vtBoolean) ^ (prev.type == vtBoolean)) {
+        throw_type_mismatch(lexeme, prev.type, cur.type);
     }
-    return result;
 }
 
 Program *SyntaxAnalyzer::parse(const LexemeArray &array)
 {
-    lexemes = array;
+    AllocationScope scope(msParser);
+    PROBE1(parse__start, array.size());
+    lexemes = array.data();
+    lexemes_count = array.size();
     pos = 0;
     get_next_lexeme();
 
     program.clear();
+    // about one node per lexeme, so the nodes are not copied while they grow
+    program.reserve(array.size());
+    variable_links.clear();
+    statements.clear();
+    operators.clear();
+    operands.clear();
     variables.clear();
     labels.clear();
+    lines = LineTable();
+    reserve_tables();
+    statement = NULL;
+    propagation_time = PhaseTime{ 0.0, 0.0 };
 
     state_program();
-    return new Program(program, variables.size());
+    InitializationAnalyzer(variables.size()).process(program);
+    PROBE2(parse__done, program.size(), variables.size());
+    // both are reset by the next parse()
+    return new Program(std::move(program), variables.size(), std::move(lines));
+}
+
+PhaseTime SyntaxAnalyzer::get_propagation_time() const
+{
+    return propagation_time;
+}
+
+const VariablesTable &SyntaxAnalyzer::get_variables() const
+{
+    return variables;
 }
@@ -1,10 +1,13 @@
 #ifndef SYNTAX_H
 #define SYNTAX_H
 
+#include <vector>
 #include "lexeme.h"
 #include "variables.h"
 #include "labels.h"
 #include "program.h"
+#include "lines.h"
+#include "stats.h"
 
 struct ValueInfo {
     ValueType type;
@@ -19,17 +22,76 @@ private:
         jtAtFalse
     };
 
+    // binding power of the binary operators, from the loosest
+    enum Precedence {
+        pcNone,
+        pcAssign,
+        pcOr,
+        pcAnd,
+        pcCompare,
+        pcSum,
+        pcMul,
+        pcUnary
+    };
+
+    enum StatementKind {
+        skProgram,
+        skBlock,
+        skIf,
+        skElse,
+        skWhile,
+        skDo
+    };
+
+    // a compound statement waiting for its nested statements
+    struct StatementFrame {
+        StatementKind kind;
+        const Lexeme *lexeme;
+        const Lexeme *outer_statement;
+        // labels for continue and break inside it
+        LabelID cont_label;
+        LabelID break_label;
+        // the end of the branch for if and else, the loop start for do
+        LabelID label;
+        bool started;
+    };
+
+    // an operator waiting for its right operand, or an open bracket (pcNone)
+    struct PendingOperator {
+        const Lexeme *lexeme;
+        Precedence precedence;
+        // the end of a lazy 'or' or 'and' chain
+        LabelID label;
+        // a comparison after the first one of a chain
+        bool chained;
+        // assignments: the last target, and its first link in variable_links
+        ValueInfo target;
+        size_t links_start;
+    };
+
     bool comparison_chains;
     bool lazy_evaluations;
 
-    LexemeArray lexemes;
+    // the array given to parse(), which is not copied
+    const Lexeme *lexemes;
+    size_t lexemes_count;
     size_t pos;
-    Lexeme *cur_lexeme;
+    const Lexeme *cur_lexeme;
     LexemeType cur_lexeme_type;
 
     ProgramNodes program;
+    // variables of the assignments being parsed, innermost last
+    ProgramNodes variable_links;
+    // explicit stacks instead of recursion, so nesting depth is only limited by memory
+    std::vector<StatementFrame> statements;
+    std::vector<PendingOperator> operators;
+    std::vector<ValueInfo> operands;
     VariablesTable variables;
     LabelsTable labels;
+    LineTable lines;
+    // generated nodes are attributed to the statement that starts here
+    const Lexeme *statement;
+    PhaseTime propagation_time;
 
     void get_next_lexeme();
     void check_lexeme(LexemeType lexeme, const std::string &error_message);
@@ -38,6 +100,9 @@ private:
     void throw_semantic_error(const Lexeme *where, const std::string &message);
     void throw_type_mismatch(const Lexeme *where, ValueType left, ValueType right);
 
+    void reserve_tables();
+
+    void gen_node(const ProgramNode &node);
     void gen_constant(ValueType type, const std::string &value);
     void gen_constant(Integer value);
     void gen_operation(Operation operation);
@@ -48,19 +113,28 @@ private:
     void state_descriptions();
     void state_description(ValueType type);
     void state_variable(ValueType type);
-    void state_operators(LabelID cont_label, LabelID break_label);
+    void state_operators();
+    bool resume_statement();
     void state_operator(LabelID cont_label, LabelID break_label);
+    static Precedence binary_precedence(LexemeType lexeme);
     ValueInfo state_expression();
-    ValueInfo state_expression_or();
-    ValueInfo state_expression_and();
-    ValueInfo state_expression_cmp();
-    ValueInfo state_expression_sum();
-    ValueInfo state_expression_mul();
-    ValueInfo state_expression_un();
+    void state_binary_operator(Precedence precedence);
+    void state_assignment();
     ValueInfo state_operand();
+    void reduce(Precedence precedence);
+    void reduce_operator(const PendingOperator &pending, bool continues);
+    ValueInfo gen_unary(const Lexeme *lexeme, ValueInfo operand);
+    void gen_comparison(const Lexeme *lexeme, ValueInfo prev, ValueInfo cur);
+    ValueType gen_sum(const Lexeme *lexeme, ValueInfo prev, ValueInfo cur);
+    ValueType gen_mul(const Lexeme *lexeme, ValueInfo prev, ValueInfo cur);
+    void check_assignment(const Lexeme *lexeme, ValueInfo prev, ValueInfo cur);
 public:
     SyntaxAnalyzer(bool comparison_chains=false, bool lazy_evaluations=false);
     Program *parse(const LexemeArray &array);
+    // part of the last parse() spent on resolving jump labels
+    PhaseTime get_propagation_time() const;
+    // declared variables of the last parse()
+    const VariablesTable &get_variables() const;
 };
 
 #endif // SYNTAX_H
@@ -0,0 +1,182 @@
+#include "trace.h"
+
+static const char trace_magic[] = "RPNTRACE";
+static const char trace_version = 1;
+
+ExecutionTracer::ExecutionTracer():
+    ring(capacity), head(0), tail(0), closing(false), last_time(0), base(Clock::now()),
+    expected(no_node), previous(no_node), io_kind(teRead), io_pos(no_node), io_start(0) {}
+
+bool ExecutionTracer::open(const std::string &path)
+{
+    file.open(path, std::ios::binary);
+    if (!file.is_open()) {
+        return false;
+    }
+    file.write(trace_magic, sizeof(trace_magic) - 1);
+    file.put(trace_version);
+    base = Clock::now();
+    writer = std::thread(&ExecutionTracer::write_loop, this);
+    return true;
+}
+
+bool ExecutionTracer::close()
+{
+    if (!writer.joinable()) {
+        return false;
+    }
+    closing.store(true, std::memory_order_release);
+    writer.join();
+    file.close();
+    return !file.fail();
+}
+
+void ExecutionTracer::write_loop()
+{
+    while (true) {
+        bool last = closing.load(std::memory_order_acquire);
+        size_t end = head.load(std::memory_order_acquire), begin = tail.load(std::memory_order_relaxed);
+        for (size_t i = begin; i < end; i++) {
+            write_event(ring[i % capacity]);
+        }
+        tail.store(end, std::memory_order_release);
+        if (last) {
+            break;
+        }
+        if (begin == end) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+    file.flush();
+}
+
+void ExecutionTracer::write_number(uint64_t value)
+{
+    while (value >= 0x80) {
+        file.put((char)((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    file.put((char)value);
+}
+
+void ExecutionTracer::write_event(const TraceEvent &event)
+{
+    file.put((char)event.kind);
+    write_number(event.pos);
+    if (event.kind == teJump) {
+        write_number(event.target);
+    }
+    // events are pushed in order of time, except that an I/O event is pushed when it ends
+    uint64_t time = event.time > last_time ? event.time : last_time;
+    write_number(time - last_time);
+    last_time = time;
+    if (event.kind != teJump && event.kind != teStart) {
+        write_number(event.duration);
+    }
+}
+
+void ExecutionTracer::push(TraceEventKind kind, uint64_t pos, uint64_t target, uint64_t time, uint64_t duration)
+{
+    size_t position = head.load(std::memory_order_relaxed);
+    while (position - tail.load(std::memory_order_acquire) >= capacity) {
+        std::this_thread::yield();
+    }
+    ring[position % capacity] = TraceEvent{ kind, pos, target, time, duration };
+    head.store(position + 1, std::memory_order_release);
+}
+
+void ExecutionTracer::finish_io(uint64_t time)
+{
+    push(io_kind, io_pos, 0, io_start, time - io_start);
+    io_pos = no_node;
+}
+
+void ExecutionTracer::start(size_t pos)
+{
+    expected = pos;
+    previous = no_node;
+    push(teStart, pos, 0, now(), 0);
+}
+
+void ExecutionTracer::stop(size_t pos, RuntimeStatus status)
+{
+    uint64_t time = now();
+    if (io_pos != no_node) {
+        finish_io(time);
+    }
+    // a jump past the last node or a preemption at a backward jump ends the run
+    // without another dispatch; a run waiting for input stops at the read itself
+    if (pos != expected && pos != previous && previous != no_node) {
+        push(teJump, previous, pos, time, 0);
+    }
+    push(teEnd, pos, 0, time, status);
+}
+
+ExecutionTracer::~ExecutionTracer()
+{
+    if (writer.joinable()) {
+        close();
+    }
+}
+
+TraceReader::TraceReader(): stream(NULL), time(0), failed(false) {}
+
+bool TraceReader::open(std::istream &stream)
+{
+    char header[sizeof(trace_magic)];
+    this->stream = &stream;
+    time = 0;
+    failed = !stream.read(header, sizeof(header)) ||
+             std::string(header, sizeof(trace_magic) - 1) != trace_magic ||
+             header[sizeof(trace_magic) - 1] != trace_version;
+    return !failed;
+}
+
+bool TraceReader::read_number(uint64_t &value)
+{
+    value = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+        int c = stream->get();
+        if (c == EOF) {
+            return false;
+        }
+        value |= (uint64_t)(c & 0x7F) << shift;
+        if ((c & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool TraceReader::next(TraceEvent &event)
+{
+    if (stream == NULL || failed) {
+        return false;
+    }
+    int kind = stream->get();
+    if (kind == EOF) {
+        return false;
+    }
+    event = TraceEvent{ (TraceEventKind)kind, 0, 0, 0, 0 };
+    uint64_t delta;
+    bool ok = kind <= teEnd && read_number(event.pos);
+    if (ok && kind == teJump) {
+        ok = read_number(event.target);
+    }
+    ok = ok && read_number(delta);
+    if (ok && kind != teJump && kind != teStart) {
+        ok = read_number(event.duration);
+    }
+    if (!ok) {
+        failed = true;
+        return false;
+    }
+    time += delta;
+    event.time = time;
+    return true;
+}
+
+bool TraceReader::error() const
+{
+    return failed;
+}
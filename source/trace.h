@@ -0,0 +1,133 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "program.h"
+
+// Trace file format: the magic "RPNTRACE" and the version byte 1, then
+// events until the end of file. Every event is its kind byte followed by
+// unsigned LEB128 fields:
+//   teStart  pos, time
+//   teJump   from, to, time
+//   teRead   pos, time, duration
+//   teWrite  pos, time, duration
+//   teEnd    pos, time, status
+// time is in nanoseconds since the previous event (since the trace was
+// opened for the first one). Only taken jumps are recorded: between two
+// events execution is sequential, so every executed node index can be
+// reconstructed. A read lasts from its dispatch to the dispatch of the
+// next node, so its duration includes waiting for the input.
+enum TraceEventKind {
+    teStart,
+    teJump,
+    teRead,
+    teWrite,
+    teEnd
+};
+
+// times are absolute in the decoded form, nanoseconds since the trace was
+// opened; duration holds the RuntimeStatus of a teEnd
+struct TraceEvent {
+    TraceEventKind kind;
+    uint64_t pos;
+    uint64_t target;
+    uint64_t time;
+    uint64_t duration;
+};
+
+// Records the execution of one thread through ExecutionContext::run(
+// ExecutionTracer &) into a lock-free single-producer ring buffer, which
+// a background thread drains into the trace file. The interpreter waits
+// only when the buffer is full, so no event is ever lost.
+class ExecutionTracer {
+private:
+    typedef std::chrono::steady_clock Clock;
+    static const size_t capacity = 1 << 16;
+    static const size_t no_node = (size_t)-1;
+
+    std::vector<TraceEvent> ring;
+    // written by the interpreter and the writer thread respectively
+    std::atomic<size_t> head;
+    std::atomic<size_t> tail;
+    std::atomic<bool> closing;
+
+    std::ofstream file;
+    std::thread writer;
+    uint64_t last_time;
+    Clock::time_point base;
+
+    size_t expected;
+    size_t previous;
+    // the I/O operation in progress, its duration ends with the next dispatch
+    TraceEventKind io_kind;
+    size_t io_pos;
+    uint64_t io_start;
+
+    void write_loop();
+    void write_event(const TraceEvent &event);
+    void write_number(uint64_t value);
+    void push(TraceEventKind kind, uint64_t pos, uint64_t target, uint64_t time, uint64_t duration);
+    void finish_io(uint64_t time);
+
+    inline uint64_t now() const
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - base).count();
+    }
+public:
+    ExecutionTracer();
+    ExecutionTracer(const ExecutionTracer &) = delete;
+    ExecutionTracer &operator=(const ExecutionTracer &) = delete;
+    bool open(const std::string &path);
+    // flushes the rest of the events and closes the file, returns false on a write error
+    bool close();
+    void start(size_t pos);
+    void stop(size_t pos, RuntimeStatus status);
+
+    inline void on_node(size_t pos, const ProgramNode &node)
+    {
+        if (io_pos != no_node) {
+            finish_io(now());
+        }
+        if (pos != expected) {
+            push(teJump, previous, pos, now(), 0);
+        }
+        previous = pos;
+        expected = pos + 1;
+        if (node.type == ntOperation) {
+            Operation op = node.data.operation;
+            if (op == opReadLn || op == opWrite || op == opWriteLn) {
+                io_kind = op == opReadLn ? teRead : teWrite;
+                io_pos = pos;
+                io_start = now();
+            }
+        }
+    }
+
+    ~ExecutionTracer();
+};
+
+// decodes a trace file written by ExecutionTracer
+class TraceReader {
+private:
+    std::istream *stream;
+    uint64_t time;
+    bool failed;
+
+    bool read_number(uint64_t &value);
+public:
+    TraceReader();
+    // checks the header
+    bool open(std::istream &stream);
+    // false at the end of the trace; error() tells a truncated or corrupt one
+    bool next(TraceEvent &event);
+    bool error() const;
+};
+
+#endif // TRACE_H
@@ -1,5 +1,6 @@
 #include <sstream>
 #include <cstdlib>
+#include <cstring>
 #include "values.h"
 
 ValueType Value::get_type() const
@@ -7,6 +8,11 @@ ValueType Value::get_type() const
     return vtNone;
 }
 
+size_t Value::heap_size() const
+{
+    return 0;
+}
+
 IntegerValue::IntegerValue(Integer value): value(value) {}
 
 IntegerValue::IntegerValue(const String &str)
@@ -59,6 +65,16 @@ ValueType StringValue::get_type() const
     return vtString;
 }
 
+size_t StringValue::heap_size() const
+{
+    // short strings are kept inside the object
+    const char *data = value.data(), *object = (const char *)&value;
+    if (data >= object && data < object + sizeof(value)) {
+        return 0;
+    }
+    return value.capacity() + 1;
+}
+
 Integer StringValue::to_integer() const
 {
     return atoll(value.c_str());
@@ -168,3 +184,23 @@ Real RealValue::to_real() const
 {
     return value;
 }
+
+bool values_equal(const Value &left, const Value &right)
+{
+    Real left_real, right_real;
+    if (left.get_type() != right.get_type()) {
+        return false;
+    }
+    switch (left.get_type()) {
+    case vtInteger:
+        return left.to_integer() == right.to_integer();
+    case vtBoolean:
+        return left.to_boolean() == right.to_boolean();
+    case vtReal:
+        left_real = left.to_real();
+        right_real = right.to_real();
+        return memcmp(&left_real, &right_real, sizeof(Real)) == 0;
+    default:
+        return left.to_string() == right.to_string();
+    }
+}
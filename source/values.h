@@ -20,6 +20,8 @@ class Value {
 public:
     virtual Value *clone() const = 0;
     virtual ValueType get_type() const;
+    // bytes owned by the value outside of the object itself
+    virtual size_t heap_size() const;
     virtual Integer to_integer() const = 0;
     virtual String to_string() const = 0;
     virtual Boolean to_boolean() const = 0;
@@ -48,6 +50,7 @@ public:
     explicit StringValue(const String &value);
     Value *clone() const override;
     ValueType get_type() const override;
+    size_t heap_size() const override;
     Integer to_integer() const override;
     String to_string() const override;
     Boolean to_boolean() const override;
@@ -82,4 +85,8 @@ public:
     Real to_real() const override;
 };
 
+// same type and same value; reals are compared bit for bit, so that a
+// value specialized on 0.0 does not accept -0.0 and a NaN matches itself
+bool values_equal(const Value &left, const Value &right);
+
 #endif // VALUES_H
@@ -3,11 +3,12 @@
 void VariablesTable::clear()
 {
     data.clear();
+    numbers.clear();
 }
 
 bool VariablesTable::register_name(const std::string &name, ValueType type)
 {
-    if (get_number(name) != -1) {
+    if (!numbers.emplace(name, size()).second) {
         return false;
     }
     data.push_back({ size(), name, type });
@@ -16,12 +17,11 @@ bool VariablesTable::register_name(const std::string &name, ValueType type)
 
 VariableID VariablesTable::get_number(const std::string &name) const
 {
-    for (auto i = data.begin(); i != data.end(); i++) {
-        if (i->name == name) {
-            return i->number;
-        }
+    auto found = numbers.find(name);
+    if (found == numbers.end()) {
+        return -1;
     }
-    return -1;
+    return found->second;
 }
 
 ValueType VariablesTable::get_type(VariableID number) const
@@ -29,6 +29,11 @@ ValueType VariablesTable::get_type(VariableID number) const
     return data[number].type;
 }
 
+const std::string &VariablesTable::get_name(VariableID number) const
+{
+    return data[number].name;
+}
+
 VariableID VariablesTable::size() const
 {
     return (VariableID)data.size();
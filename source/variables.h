@@ -2,6 +2,7 @@
 #define VARIABLES_H
 
 #include <string>
+#include <unordered_map>
 #include <vector>
 #include "values.h"
 
@@ -16,11 +17,14 @@ private:
     };
 
     std::vector<VariableInfo> data;
+    // numbers by name, a scan of data made parsing quadratic in the number of variables
+    std::unordered_map<std::string, VariableID> numbers;
 public:
     void clear();
     bool register_name(const std::string &name, ValueType type);
     VariableID get_number(const std::string &name) const;
     ValueType get_type(VariableID number) const;
+    const std::string &get_name(VariableID number) const;
     VariableID size() const;
 };
 
@@ -0,0 +1,321 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "../source/exceptions.h"
+#include "../source/lexical.h"
+#include "../source/syntax.h"
+#include "../source/context.h"
+
+typedef std::chrono::steady_clock Clock;
+
+enum Phase {
+    phLex,
+    phParse,
+    phExecute,
+    phCount
+};
+
+static const char *phase_names[phCount] = { "lex", "parse", "execute" };
+
+struct Benchmark {
+    std::string name;
+    std::string source;
+    std::string input;
+    // seconds of every run, per phase
+    std::vector<double> times[phCount];
+    std::string error;
+};
+
+struct Summary {
+    double median;
+    double spread;
+};
+
+// results of one benchmark, phase medians in milliseconds
+typedef std::map<std::string, std::vector<double> > Baseline;
+
+static double seconds_since(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+static bool read_file(const std::string &path, std::string &data)
+{
+    std::ifstream stream(path, std::ios::binary);
+    if (!stream.is_open()) {
+        return false;
+    }
+    std::ostringstream buffer;
+    buffer << stream.rdbuf();
+    data = buffer.str();
+    return true;
+}
+
+// stresses the lexer and the parser rather than the interpreter
+static std::string generate_huge_source(size_t variables, size_t statements)
+{
+    std::ostringstream source;
+    source << "program {\n";
+    for (size_t i = 0; i < variables; i++) {
+        source << "    int v" << i << " = " << i << ";\n";
+    }
+    for (size_t i = 0; i < statements; i++) {
+        size_t a = i % variables, b = (i * 7 + 3) % variables, c = (i * 13 + 5) % variables;
+        switch (i % 4) {
+        case 0:
+            source << "    v" << a << " = (v" << b << " + v" << c << " * 3) % 1000;\n";
+            break;
+        case 1:
+            source << "    if (v" << a << " > v" << b << " and not (v" << c << " == 0)) v" << c
+                   << " = v" << a << " - v" << b << "; else v" << a << " = v" << a << " + 1;\n";
+            break;
+        case 2:
+            source << "    while (v" << a << " > 500) { v" << a << " = v" << a << " / 2; }\n";
+            break;
+        default:
+            source << "    /* statement " << i << " */ v" << b << " = -v" << b << " + " << i << ";\n";
+            break;
+        }
+    }
+    source << "    write(v0, \" \", v1);\n}\n";
+    return source.str();
+}
+
+// input of bench/read_heavy.prog: a record count, then a number and a name per record
+static std::string generate_read_heavy_input(size_t records)
+{
+    std::ostringstream input;
+    unsigned long long seed = 12345;
+    input << records << "\n";
+    for (size_t i = 0; i < records; i++) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        input << (seed >> 33) % 100000 << "\nname" << (seed >> 17) % 100000 << "\n";
+    }
+    return input.str();
+}
+
+static bool load_benchmarks(const std::string &directory, std::vector<Benchmark> &benchmarks)
+{
+    std::error_code error;
+    std::vector<std::string> paths;
+    for (std::filesystem::directory_iterator i(directory, error), end; !error && i != end; i.increment(error)) {
+        if (i->path().extension() == ".prog") {
+            paths.push_back(i->path().string());
+        }
+    }
+    if (error) {
+        return false;
+    }
+    std::sort(paths.begin(), paths.end());
+    for (size_t i = 0; i < paths.size(); i++) {
+        Benchmark benchmark;
+        std::filesystem::path path(paths[i]);
+        benchmark.name = path.stem().string();
+        if (!read_file(paths[i], benchmark.source)) {
+            return false;
+        }
+        // the scripted stdin is optional, large inputs are generated instead of stored
+        if (benchmark.name == "read_heavy") {
+            benchmark.input = generate_read_heavy_input(20000);
+        } else {
+            read_file(std::filesystem::path(path).replace_extension(".in").string(), benchmark.input);
+        }
+        benchmarks.push_back(benchmark);
+    }
+    Benchmark huge;
+    huge.name = "generated_huge";
+    huge.source = generate_huge_source(2000, 40000);
+    benchmarks.push_back(huge);
+    return true;
+}
+
+static void run_benchmark(Benchmark &benchmark, size_t runs)
+{
+    std::ofstream null("/dev/null");
+    for (size_t run = 0; run < runs; run++) {
+        LexicalAnalyzer lexical;
+        SyntaxAnalyzer syntax(true, false);
+        Program *program = NULL;
+        std::istringstream input(benchmark.input);
+        Clock::time_point start;
+        try {
+            start = Clock::now();
+            lexical.parse_string(benchmark.source);
+            benchmark.times[phLex].push_back(seconds_since(start));
+
+            start = Clock::now();
+            program = syntax.parse(lexical.get_lexemes());
+            benchmark.times[phParse].push_back(seconds_since(start));
+
+            start = Clock::now();
+            ExecutionContext context(*program, input, null);
+            context.execute();
+            benchmark.times[phExecute].push_back(seconds_since(start));
+        } catch (const Exception &e) {
+            benchmark.error = e.what();
+        }
+        delete program;
+        if (benchmark.error != "") {
+            return;
+        }
+    }
+}
+
+static Summary summarize(std::vector<double> times)
+{
+    std::sort(times.begin(), times.end());
+    Summary result = { 0.0, 0.0 };
+    if (times.empty()) {
+        return result;
+    }
+    size_t middle = times.size() / 2;
+    result.median = times.size() % 2 ? times[middle] : (times[middle - 1] + times[middle]) / 2;
+    // half of the range, relative to the median
+    if (result.median > 0) {
+        result.spread = (times.back() - times.front()) / 2 / result.median * 100;
+    }
+    return result;
+}
+
+// reads files written by save_results, one benchmark per line:
+//   "name": [lex, parse, execute],
+static bool load_baseline(const std::string &path, Baseline &baseline)
+{
+    std::ifstream stream(path);
+    if (!stream.is_open()) {
+        return false;
+    }
+    std::string line;
+    while (std::getline(stream, line)) {
+        size_t open = line.find('"'), close = line.find('"', open + 1), bracket = line.find('[');
+        if (open == std::string::npos || close == std::string::npos || bracket == std::string::npos) {
+            continue;
+        }
+        std::vector<double> medians(phCount);
+        if (sscanf(line.c_str() + bracket, "[%lf, %lf, %lf]", &medians[0], &medians[1], &medians[2]) == 3) {
+            baseline[line.substr(open + 1, close - open - 1)] = medians;
+        }
+    }
+    return true;
+}
+
+static bool save_results(const std::string &path, const std::vector<Benchmark> &benchmarks)
+{
+    std::ofstream stream(path);
+    if (!stream.is_open()) {
+        return false;
+    }
+    stream << std::fixed << std::setprecision(4);
+    stream << "{\n  \"unit\": \"ms\",\n  \"phases\": [\"lex\", \"parse\", \"execute\"],\n  \"benchmarks\": {\n";
+    for (size_t i = 0; i < benchmarks.size(); i++) {
+        stream << "    \"" << benchmarks[i].name << "\": [";
+        for (size_t phase = 0; phase < phCount; phase++) {
+            stream << (phase > 0 ? ", " : "") << summarize(benchmarks[i].times[phase]).median * 1000;
+        }
+        stream << "]" << (i + 1 < benchmarks.size() ? "," : "") << "\n";
+    }
+    stream << "  }\n}\n";
+    return (bool)stream;
+}
+
+int main(int argc, char **argv)
+{
+    std::string directory, baseline_path, save_path;
+    size_t runs = 5;
+    double threshold = 10.0;
+
+    for (int i = 1; i < argc; i++) {
+        std::string current = argv[i];
+        if (current == "--runs" && i + 1 < argc) {
+            runs = std::max(1ul, strtoul(argv[++i], NULL, 10));
+        } else if (current == "--baseline" && i + 1 < argc) {
+            baseline_path = argv[++i];
+        } else if (current == "--save" && i + 1 < argc) {
+            save_path = argv[++i];
+        } else if (current == "--threshold" && i + 1 < argc) {
+            threshold = atof(argv[++i]);
+        } else if (directory == "") {
+            directory = current;
+        } else {
+            directory = "";
+            break;
+        }
+    }
+    if (directory == "") {
+        std::cout << "Usage:" << std::endl;
+        std::cout << "benchmark [--runs N] [--baseline FILE] [--save FILE] [--threshold PERCENT] DIR" << std::endl;
+        std::cout << "Runs every DIR/NAME.prog (with DIR/NAME.in as stdin, if present) and a " \
+            "generated huge program N times (5 by default), reporting the median and spread of " \
+            "the lex, parse and execute phases. With --baseline, medians slower than the " \
+            "baseline by more than PERCENT (10 by default) are flagged and the exit code is 1; " \
+            "--save writes the medians in the baseline format. Timings only compare on the same " \
+            "machine, so save the baseline from the base revision before measuring a change." << std::endl;
+        return 2;
+    }
+
+    std::vector<Benchmark> benchmarks;
+    if (!load_benchmarks(directory, benchmarks)) {
+        std::cout << "Error: could not read benchmarks from " << directory << "." << std::endl;
+        return 2;
+    }
+    Baseline baseline;
+    if (baseline_path != "" && !load_baseline(baseline_path, baseline)) {
+        std::cout << "Error: could not read baseline " << baseline_path << "." << std::endl;
+        return 2;
+    }
+
+    bool failed = false, regressed = false;
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << std::left << std::setw(20) << "benchmark" << std::setw(10) << "phase" << std::right
+              << std::setw(12) << "median ms" << std::setw(10) << "spread";
+    if (!baseline.empty()) {
+        std::cout << std::setw(14) << "baseline ms" << std::setw(10) << "change";
+    }
+    std::cout << std::endl;
+    for (size_t i = 0; i < benchmarks.size(); i++) {
+        run_benchmark(benchmarks[i], runs);
+        if (benchmarks[i].error != "") {
+            std::cout << std::left << std::setw(20) << benchmarks[i].name << "failed: "
+                      << benchmarks[i].error << std::right << std::endl;
+            failed = true;
+            continue;
+        }
+        Baseline::const_iterator base = baseline.find(benchmarks[i].name);
+        for (size_t phase = 0; phase < phCount; phase++) {
+            Summary summary = summarize(benchmarks[i].times[phase]);
+            double median = summary.median * 1000;
+            std::cout << std::left << std::setw(20) << (phase == 0 ? benchmarks[i].name : "")
+                      << std::setw(10) << phase_names[phase] << std::right
+                      << std::setw(12) << median << std::setw(9) << summary.spread << "%";
+            if (base != baseline.end()) {
+                double before = base->second[phase];
+                double change = before > 0 ? (median - before) / before * 100 : 0.0;
+                std::cout << std::setw(14) << before << std::setw(9) << change << "%";
+                // phases well under a millisecond are mostly timer noise
+                if (change > threshold && median - before > 0.05) {
+                    std::cout << "  REGRESSION";
+                    regressed = true;
+                }
+            }
+            std::cout << std::endl;
+        }
+    }
+
+    if (save_path != "" && !save_results(save_path, benchmarks)) {
+        std::cout << "Error: could not write " << save_path << "." << std::endl;
+        failed = true;
+    }
+    if (failed) {
+        return 2;
+    }
+    return regressed ? 1 : 0;
+}
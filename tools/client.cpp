@@ -0,0 +1,128 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include "../source/protocol.h"
+
+static bool read_file(const char *path, std::string &data)
+{
+    std::ifstream stream(path, std::ios::binary);
+    if (!stream.is_open()) {
+        return false;
+    }
+    std::ostringstream buffer;
+    buffer << stream.rdbuf();
+    data = buffer.str();
+    return true;
+}
+
+// copies console input to the session and session output to console until the server
+// closes the connection
+static int run_session(Connection &connection, const std::string &hash)
+{
+    std::string line, unread;
+    if (!connection.write("SESSION " + hash + "\n") || !connection.read_line(line)) {
+        std::cout << "Error: connection closed." << std::endl;
+        return 1;
+    }
+    if (line != "OK") {
+        std::cout << line.substr(line.compare(0, 6, "ERROR ") == 0 ? 6 : 0) << std::endl;
+        return 1;
+    }
+    int fd = connection.release(unread);
+    std::cout << unread << std::flush;
+
+    char buffer[4096];
+    pollfd fds[2] = { { fd, POLLIN, 0 }, { STDIN_FILENO, POLLIN, 0 } };
+    nfds_t count = 2;
+    while (poll(fds, count, -1) >= 0) {
+        if (fds[0].revents != 0) {
+            ssize_t size = read(fd, buffer, sizeof(buffer));
+            if (size <= 0) {
+                break;
+            }
+            std::cout.write(buffer, size).flush();
+        }
+        if (count > 1 && fds[1].revents != 0) {
+            ssize_t size = read(STDIN_FILENO, buffer, sizeof(buffer));
+            if (size <= 0) {
+                shutdown(fd, SHUT_WR);
+                count = 1;
+            } else {
+                for (ssize_t sent = 0, part; sent < size; sent += part) {
+                    if ((part = write(fd, buffer + sent, size - sent)) <= 0) {
+                        break;
+                    }
+                }
+            }
+        }
+    }
+    close(fd);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 3) {
+        std::cout << "Usage:" << std::endl;
+        std::cout << "client socket program [input]" << std::endl;
+        std::cout << "client socket program --session" << std::endl;
+        std::cout << "Runs the program on the server listening on socket. Input is " \
+            "read from the input file or, if omitted, from console until end of file. " \
+            "With --session the program runs interactively, reading console input " \
+            "as it is typed." << std::endl;
+        return 1;
+    }
+
+    std::string source, input, line, error;
+    bool session = argc > 3 && std::string(argv[3]) == "--session";
+    if (!read_file(argv[2], source)) {
+        std::cout << "Error: could not open file." << std::endl;
+        return 1;
+    }
+    if (session) {
+        // input is sent as it arrives
+    } else if (argc > 3) {
+        if (!read_file(argv[3], input)) {
+            std::cout << "Error: could not open input file." << std::endl;
+            return 1;
+        }
+    } else {
+        std::ostringstream buffer;
+        buffer << std::cin.rdbuf();
+        input = buffer.str();
+    }
+
+    Connection connection(Connection::connect_to(argv[1]));
+    if (!connection.is_open()) {
+        std::cout << "Error: could not connect to " << argv[1] << "." << std::endl;
+        return 1;
+    }
+
+    std::ostringstream request;
+    request << "LOAD " << source.size() << "\n" << source;
+    if (!connection.write(request.str()) || !connection.read_line(line)) {
+        std::cout << "Error: connection closed." << std::endl;
+        return 1;
+    }
+    if (line.compare(0, 3, "OK ") != 0) {
+        std::cout << line.substr(line.compare(0, 6, "ERROR ") == 0 ? 6 : 0) << std::endl;
+        return 1;
+    }
+
+    if (session) {
+        return run_session(connection, line.substr(3));
+    }
+
+    request.str("");
+    request << "RUN " << line.substr(3) << " " << input.size() << "\n" << input;
+    connection.write(request.str());
+    if (!read_response(connection, std::cout, error)) {
+        std::cout << error << std::endl;
+        return 1;
+    }
+    return 0;
+}
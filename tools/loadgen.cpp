@@ -0,0 +1,119 @@
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include <cstdlib>
+#include "../source/protocol.h"
+
+typedef std::chrono::steady_clock Clock;
+
+static bool read_file(const char *path, std::string &data)
+{
+    std::ifstream stream(path, std::ios::binary);
+    if (!stream.is_open()) {
+        return false;
+    }
+    std::ostringstream buffer;
+    buffer << stream.rdbuf();
+    data = buffer.str();
+    return true;
+}
+
+static void worker(const std::string &socket_path, const std::string &request,
+                   size_t requests, std::vector<double> &latencies, size_t &failures)
+{
+    Connection connection(Connection::connect_to(socket_path));
+    std::ostringstream sink;
+    std::string error;
+    for (size_t i = 0; i < requests; i++) {
+        Clock::time_point start = Clock::now();
+        if (!connection.is_open() || !connection.write(request)) {
+            failures += requests - i;
+            return;
+        }
+        sink.str("");
+        if (!read_response(connection, sink, error)) {
+            failures++;
+            if (error == "Connection closed.") {
+                failures += requests - i - 1;
+                return;
+            }
+        }
+        latencies.push_back(std::chrono::duration<double>(Clock::now() - start).count());
+    }
+}
+
+static double percentile(const std::vector<double> &sorted, size_t percent)
+{
+    return sorted[(sorted.size() - 1) * percent / 100] * 1000;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 4) {
+        std::cout << "Usage:" << std::endl;
+        std::cout << "loadgen socket program input [requests] [connections]" << std::endl;
+        std::cout << "Loads the program into the server once and then sends requests " \
+            "RUN requests (1000 by default) over connections parallel connections " \
+            "(4 by default), reporting latency percentiles and throughput." << std::endl;
+        return 1;
+    }
+    size_t requests = argc > 4 ? strtoul(argv[4], NULL, 10) : 1000;
+    size_t connections = argc > 5 ? strtoul(argv[5], NULL, 10) : 4;
+    if (connections == 0) {
+        connections = 1;
+    }
+
+    std::string source, input, line;
+    if (!read_file(argv[2], source) || !read_file(argv[3], input)) {
+        std::cout << "Error: could not open file." << std::endl;
+        return 1;
+    }
+    {
+        Connection connection(Connection::connect_to(argv[1]));
+        std::ostringstream request;
+        request << "LOAD " << source.size() << "\n" << source;
+        if (!connection.write(request.str()) || !connection.read_line(line) ||
+            line.compare(0, 3, "OK ") != 0) {
+            std::cout << "Error: could not load program: " << line << std::endl;
+            return 1;
+        }
+    }
+    std::ostringstream request;
+    request << "RUN " << line.substr(3) << " " << input.size() << "\n" << input;
+
+    std::vector<std::vector<double> > latencies(connections);
+    std::vector<size_t> failures(connections, 0);
+    std::vector<std::thread> threads;
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < connections; i++) {
+        size_t share = requests / connections + (i < requests % connections ? 1 : 0);
+        threads.push_back(std::thread(worker, std::string(argv[1]), request.str(), share,
+                                      std::ref(latencies[i]), std::ref(failures[i])));
+    }
+    for (size_t i = 0; i < threads.size(); i++) {
+        threads[i].join();
+    }
+    double wall_time = std::chrono::duration<double>(Clock::now() - start).count();
+
+    std::vector<double> all;
+    size_t failed = 0;
+    for (size_t i = 0; i < connections; i++) {
+        all.insert(all.end(), latencies[i].begin(), latencies[i].end());
+        failed += failures[i];
+    }
+    std::sort(all.begin(), all.end());
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << "Requests: " << all.size() << ", failed: " << failed
+              << ", connections: " << connections << std::endl;
+    if (!all.empty()) {
+        std::cout << "Latency (ms): p50 " << percentile(all, 50) << ", p90 " << percentile(all, 90)
+                  << ", p99 " << percentile(all, 99) << ", max " << all.back() * 1000 << std::endl;
+    }
+    std::cout << "Throughput: " << all.size() / wall_time << " requests/s" << std::endl;
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,419 @@
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "../source/lexical.h"
+#include "../source/labels.h"
+#include "../source/memory.h"
+#include "../source/operations.h"
+#include "../source/syntax.h"
+#include "../source/variables.h"
+
+typedef std::chrono::steady_clock Clock;
+
+// every allocation of this binary goes through here, so allocations/op are exact
+static size_t allocations = 0;
+// the same, by the subsystem set with AllocationScope
+static size_t subsystem_allocations[msCount];
+
+// both kept out of line, otherwise gcc pairs the inlined malloc() and free() and warns
+__attribute__((noinline)) void *operator new(size_t size)
+{
+    allocations++;
+    subsystem_allocations[allocation_tag.subsystem]++;
+    void *result = malloc(size > 0 ? size : 1);
+    if (result == NULL) {
+        throw std::bad_alloc();
+    }
+    return result;
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+__attribute__((noinline)) void operator delete(void *pointer) noexcept
+{
+    free(pointer);
+}
+
+void operator delete[](void *pointer) noexcept
+{
+    operator delete(pointer);
+}
+
+void operator delete(void *pointer, size_t) noexcept
+{
+    operator delete(pointer);
+}
+
+void operator delete[](void *pointer, size_t) noexcept
+{
+    operator delete(pointer);
+}
+
+static std::string filter = "";
+static double min_time = 0.1;
+
+// measures only the code between its construction and report()
+class Stopwatch {
+private:
+    Clock::time_point start;
+    size_t start_allocations;
+    double elapsed;
+    size_t allocated;
+public:
+    Stopwatch(): elapsed(0), allocated(0) {}
+
+    void resume()
+    {
+        start_allocations = allocations;
+        start = Clock::now();
+    }
+
+    void pause()
+    {
+        elapsed += std::chrono::duration<double>(Clock::now() - start).count();
+        allocated += allocations - start_allocations;
+    }
+
+    double seconds() const
+    {
+        return elapsed;
+    }
+
+    void report(const std::string &name, size_t operations) const
+    {
+        std::cout << std::left << std::setw(44) << name << std::right << std::fixed
+                  << std::setprecision(2) << std::setw(12) << elapsed * 1e9 / operations
+                  << std::setw(12) << (double)allocated / operations << std::endl;
+    }
+};
+
+static bool selected(const std::string &name)
+{
+    return filter == "" || name.find(filter) != std::string::npos;
+}
+
+// runs body(count) with growing counts until it takes min_time, then reports per operation
+template <typename Body>
+static void benchmark(const std::string &name, Body body)
+{
+    if (!selected(name)) {
+        return;
+    }
+    for (size_t count = 1; ; count *= 2) {
+        Stopwatch stopwatch;
+        size_t operations = body(count, stopwatch);
+        if (stopwatch.seconds() >= min_time || count >= ((size_t)1 << 40)) {
+            stopwatch.report(name, operations);
+            return;
+        }
+    }
+}
+
+static Value *make_operand(Operation op, bool right)
+{
+    if (op >= opStrPlus && op <= opStrNotEq) {
+        return new StringValue(right ? "world" : "hello");
+    } else if (op >= opBoolPlusUn && op <= opBoolOr) {
+        return new BooleanValue(right);
+    } else if (op >= opRealPlus) {
+        return new RealValue(right ? 1.5 : 3.25);
+    }
+    return new IntegerValue(right ? 17 : 12345);
+}
+
+static void benchmark_operations()
+{
+    for (size_t i = opIntPlus; i <= opRealNotEq; i++) {
+        Operation op = (Operation)i;
+        benchmark(std::string("operation_execute/") + operation_name(op), [op](size_t count, Stopwatch &stopwatch) {
+            Value *left = make_operand(op, false), *right = make_operand(op, true);
+            RuntimeStatus status = rsOk;
+            bool unary = operation_is_unary(op);
+            stopwatch.resume();
+            for (size_t j = 0; j < count; j++) {
+                Value *result = unary ? operation_execute(op, left, status) :
+                                        operation_execute(op, left, right, status);
+                delete result;
+            }
+            stopwatch.pause();
+            delete left;
+            delete right;
+            return count;
+        });
+    }
+}
+
+static void benchmark_values()
+{
+    const char *names[] = { "Integer", "String", "Boolean", "Real" };
+    Value *values[] = { new IntegerValue(1234567), new StringValue("some string value"),
+                        new BooleanValue(true), new RealValue(3.14159) };
+    // a numeric string, so that to_integer does real work
+    Value *number = new StringValue("1234567");
+    for (size_t i = 0; i < 4; i++) {
+        Value *value = values[i];
+        benchmark(std::string("Value::clone/") + names[i], [value](size_t count, Stopwatch &stopwatch) {
+            stopwatch.resume();
+            for (size_t j = 0; j < count; j++) {
+                delete value->clone();
+            }
+            stopwatch.pause();
+            return count;
+        });
+        benchmark(std::string("Value::to_string/") + names[i], [value](size_t count, Stopwatch &stopwatch) {
+            volatile size_t length = 0;
+            stopwatch.resume();
+            for (size_t j = 0; j < count; j++) {
+                length = length + value->to_string().size();
+            }
+            stopwatch.pause();
+            return count;
+        });
+        Value *source = i == 1 ? number : value;
+        benchmark(std::string("Value::to_integer/") + names[i], [source](size_t count, Stopwatch &stopwatch) {
+            volatile Integer sum = 0;
+            stopwatch.resume();
+            for (size_t j = 0; j < count; j++) {
+                sum = sum + source->to_integer();
+            }
+            stopwatch.pause();
+            return count;
+        });
+    }
+    for (size_t i = 0; i < 4; i++) {
+        delete values[i];
+    }
+    delete number;
+}
+
+static void benchmark_lexer()
+{
+    const size_t tokens = 10000;
+    const char *mixes[][2] = {
+        { "identifiers", "alpha beta_1 while gamma if delta write epsilon " },
+        { "numbers", "1 23 456 7.89 -10 1234567 0.5 42 " },
+        { "strings", "\"a\" \"hello world\" \"\" \"escaped string here\" " },
+        { "operators", "+ - * / % < > <= >= == != = ( ) { } ; , " },
+        { "mixed", "if (x1 >= 10 and y != \"s\") { z = z + 1.5 * -w; } /* note */ " }
+    };
+    for (size_t i = 0; i < sizeof(mixes) / sizeof(mixes[0]); i++) {
+        // repeat the mix until it holds roughly the requested number of tokens
+        std::istringstream words(mixes[i][1]);
+        size_t per_mix = 0;
+        for (std::string word; words >> word; ) {
+            per_mix++;
+        }
+        std::string source;
+        for (size_t j = 0; j < tokens / per_mix; j++) {
+            source += mixes[i][1];
+            source += "\n";
+        }
+        benchmark(std::string("LexicalAnalyzer::parse_string/") + mixes[i][0],
+                  [&source](size_t count, Stopwatch &stopwatch) {
+            size_t lexemes = 0;
+            for (size_t j = 0; j < count; j++) {
+                LexicalAnalyzer lexical;
+                stopwatch.resume();
+                lexical.parse_string(source);
+                stopwatch.pause();
+                lexemes += lexical.get_lexemes().size();
+            }
+            return lexemes;
+        });
+    }
+}
+
+// names and numbers are short, so no lexeme owns heap memory
+static std::string generate_program(size_t statements)
+{
+    std::string source = "program {\n int i, sum = 0;\n";
+    for (size_t j = 0; j < statements; j++) {
+        source += " i = " + std::to_string(j) + "; while (i < 10) { sum = sum + i * 2; i = i + 1; }"
+                  " if (sum > 5) sum = sum - 1; else sum = sum + 1;\n";
+    }
+    source += " write(sum);\n}\n";
+    return source;
+}
+
+static void benchmark_parser()
+{
+    const size_t sizes[] = { 100, 1000, 10000 };
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        std::string source = generate_program(sizes[i]);
+        LexicalAnalyzer lexical;
+        lexical.parse_string(source);
+        const LexemeArray &lexemes = lexical.get_lexemes();
+        size_t statements = sizes[i];
+        // allocations per statement are the values owned by the nodes, whatever the size
+        benchmark("SyntaxAnalyzer::parse/" + std::to_string(statements),
+                  [&lexemes, statements](size_t count, Stopwatch &stopwatch) {
+            for (size_t j = 0; j < count; j++) {
+                SyntaxAnalyzer syntax;
+                stopwatch.resume();
+                Program *program = syntax.parse(lexemes);
+                stopwatch.pause();
+                delete program;
+            }
+            return count * statements;
+        });
+    }
+}
+
+static void benchmark_variables()
+{
+    const size_t sizes[] = { 10, 100, 1000, 10000 };
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        size_t size = sizes[i];
+        VariablesTable table;
+        std::vector<std::string> names;
+        for (size_t j = 0; j < size; j++) {
+            names.push_back("variable" + std::to_string(j));
+            table.register_name(names.back(), vtInteger);
+        }
+        benchmark("VariablesTable::get_number/" + std::to_string(size),
+                  [&table, &names](size_t count, Stopwatch &stopwatch) {
+            volatile VariableID sum = 0;
+            stopwatch.resume();
+            for (size_t j = 0; j < count; j++) {
+                sum = sum + table.get_number(names[j % names.size()]);
+            }
+            stopwatch.pause();
+            return count;
+        });
+    }
+}
+
+static void benchmark_labels()
+{
+    const size_t sizes[] = { 1000, 10000, 100000 };
+    const size_t uses = 4;
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        size_t labels_count = sizes[i];
+        benchmark("LabelsTable::propagate/" + std::to_string(labels_count) + "x" + std::to_string(uses),
+                  [labels_count](size_t count, Stopwatch &stopwatch) {
+            for (size_t j = 0; j < count; j++) {
+                LabelsTable labels;
+                ProgramNodes program(labels_count * uses);
+                for (size_t label = 0; label < labels_count; label++) {
+                    labels.new_label();
+                    labels.set_address(label, label);
+                    for (size_t use = 0; use < uses; use++) {
+                        program[label * uses + use].type = ntValue;
+                        labels.add_node(label, label * uses + use);
+                    }
+                }
+                stopwatch.resume();
+                labels.propagate(program);
+                stopwatch.pause();
+                for (size_t node = 0; node < program.size(); node++) {
+                    delete program[node].data.value;
+                }
+            }
+            return count * labels_count * uses;
+        });
+    }
+}
+
+enum CheckedPhase {
+    cpLex,
+    cpParse,
+    cpLabels,
+    cpCount
+};
+
+static const char *checked_phase_names[cpCount] = { "lex", "parse", "labels" };
+
+// allocations of every compile phase apart from the values owned by the nodes:
+// one per value node, of which the jump addresses are created by the labels
+static void count_compile_allocations(size_t statements, size_t extra[cpCount])
+{
+    std::string source = generate_program(statements);
+    LexicalAnalyzer lexical;
+    SyntaxAnalyzer syntax;
+    for (size_t i = 0; i < msCount; i++) {
+        subsystem_allocations[i] = 0;
+    }
+    lexical.parse_string(source);
+    Program *program = syntax.parse(lexical.get_lexemes());
+    size_t values = 0, jumps = 0;
+    const ProgramNodes &nodes = program->get_nodes();
+    for (size_t i = 0; i < nodes.size(); i++) {
+        if (nodes[i].type == ntValue) {
+            values++;
+        } else if (nodes[i].data.operation == opJump) {
+            jumps++;
+        }
+    }
+    extra[cpLex] = subsystem_allocations[msLexer];
+    extra[cpParse] = subsystem_allocations[msParser] - (values - jumps);
+    extra[cpLabels] = subsystem_allocations[msLabels] - jumps;
+    delete program;
+}
+
+// fails if the allocations of a compile phase, apart from the owned values,
+// grow with the size of the program; the lexeme array grows by doubling, so
+// a tenfold input may reallocate it log2(10) more times
+static bool check_allocations()
+{
+    const size_t small = 1000, large = 10000, allowance = 4;
+    size_t small_extra[cpCount], large_extra[cpCount];
+    count_compile_allocations(small, small_extra);
+    count_compile_allocations(large, large_extra);
+    bool passed = true;
+    std::cout << std::left << std::setw(10) << "phase" << std::right
+              << std::setw(12) << small << std::setw(12) << large << std::endl;
+    for (size_t i = 0; i < cpCount; i++) {
+        bool grows = large_extra[i] > small_extra[i] + allowance;
+        std::cout << std::left << std::setw(10) << checked_phase_names[i] << std::right
+                  << std::setw(12) << small_extra[i] << std::setw(12) << large_extra[i]
+                  << (grows ? "  GROWS" : "") << std::endl;
+        passed = passed && !grows;
+    }
+    return passed;
+}
+
+int main(int argc, char **argv)
+{
+    bool check = false;
+    for (int i = 1; i < argc; i++) {
+        std::string current = argv[i];
+        if (current == "--filter" && i + 1 < argc) {
+            filter = argv[++i];
+        } else if (current == "--min-time" && i + 1 < argc) {
+            min_time = atof(argv[++i]) / 1000;
+        } else if (current == "--check-allocations") {
+            check = true;
+        } else {
+            std::cout << "Usage:" << std::endl;
+            std::cout << "micro [--filter SUBSTRING] [--min-time MS]" << std::endl;
+            std::cout << "micro --check-allocations" << std::endl;
+            std::cout << "Runs the microbenchmarks whose names contain SUBSTRING, each for at " \
+                "least MS milliseconds (100 by default), and reports nanoseconds and heap " \
+                "allocations per operation. With --check-allocations, compiles programs of " \
+                "1000 and 10000 statements instead and exits with 1 if the allocations of the " \
+                "lex, parse or labels phase, apart from the values owned by the nodes, grow " \
+                "with the program." << std::endl;
+            return 2;
+        }
+    }
+    if (check) {
+        return check_allocations() ? 0 : 1;
+    }
+    std::cout << std::left << std::setw(44) << "benchmark" << std::right
+              << std::setw(12) << "ns/op" << std::setw(12) << "allocs/op" << std::endl;
+    benchmark_operations();
+    benchmark_values();
+    benchmark_lexer();
+    benchmark_parser();
+    benchmark_variables();
+    benchmark_labels();
+    return 0;
+}
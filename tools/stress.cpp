@@ -0,0 +1,531 @@
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <malloc.h>
+#include "../source/exceptions.h"
+#include "../source/lexical.h"
+#include "../source/syntax.h"
+#include "../source/context.h"
+#include "../source/memory.h"
+
+enum Phase {
+    phLex,
+    phParse,
+    phExecute,
+    phCount
+};
+
+static const char *phase_names[phCount] = { "lex", "parse", "execute" };
+
+enum Metric {
+    mtTime,
+    mtMemory,
+    mtCount
+};
+
+static const char *metric_names[mtCount] = { "time", "memory" };
+
+// doublings past the ladder allowed for the phases of a workload to reach --min-time
+static const size_t max_growth = 6;
+
+struct Workload {
+    const char *name;
+    // the program of size n, every one runs in about linear time
+    std::string (*generate)(size_t n);
+    // the smallest size of the ladder
+    size_t base;
+    // bit per Phase the program is built for: the ladder grows until their times are measurable
+    unsigned phases;
+};
+
+struct Measurement {
+    size_t size;
+    // fastest of the runs, in seconds, and the heap peak, in bytes
+    double seconds[phCount];
+    size_t bytes[phCount];
+};
+
+// reseeded for every generated program, so a size and a seed always give the same program
+static std::mt19937 random_engine;
+
+static size_t random_below(size_t bound)
+{
+    return std::uniform_int_distribution<size_t>(0, bound - 1)(random_engine);
+}
+
+// random lengths, so that the names share neither a length nor a prefix
+static std::string random_name(size_t index)
+{
+    std::string result(1 + random_below(12), 'a');
+    for (size_t i = 0; i < result.size(); i++) {
+        result[i] = 'a' + random_below(26);
+    }
+    return result + "_" + std::to_string(index);
+}
+
+// VariablesTable: every name is declared once and looked up on every use
+static std::string generate_variables(size_t n)
+{
+    std::vector<std::string> names;
+    for (size_t i = 0; i < n; i++) {
+        names.push_back(random_name(i));
+    }
+    std::ostringstream source;
+    source << "program {\n";
+    for (size_t i = 0; i < n; ) {
+        size_t count = std::min(n - i, 1 + random_below(4));
+        source << "    int ";
+        for (size_t j = 0; j < count; j++, i++) {
+            source << (j > 0 ? ", " : "") << names[i] << " = " << i;
+        }
+        source << ";\n";
+    }
+    for (size_t i = 1; i < n; i++) {
+        source << "    " << names[i] << " = " << names[i - 1] << " + " << names[random_below(n)] << " % 7;\n";
+    }
+    source << "    write(" << names[n - 1] << ");\n}\n";
+    return source.str();
+}
+
+// the else branches nest, and every condition is tested before the last one matches
+static std::string generate_else_if(size_t n)
+{
+    std::ostringstream source;
+    source << "program {\n    int i = " << n - 1 << ", j = 0;\n    ";
+    for (size_t i = 0; i < n; i++) {
+        source << "if (" << (random_below(2) ? "i == " + std::to_string(i) : std::to_string(i) + " == i") << ") ";
+        if (random_below(2)) {
+            source << "{ j = " << i << "; }";
+        } else {
+            source << "j = " << i << ";";
+        }
+        source << "\n    else ";
+    }
+    source << "j = -1;\n    write(j);\n}\n";
+    return source.str();
+}
+
+// blocks, ifs, whiles and do-whiles nested n deep, every loop runs once
+static std::string generate_nesting(size_t n)
+{
+    std::string opening, closing;
+    std::vector<std::string> closers;
+    size_t loops = 0;
+    for (size_t i = 0; i < n; i++) {
+        switch (random_below(4)) {
+        case 0:
+            opening += "{ ";
+            closers.push_back("} ");
+            break;
+        case 1:
+            opening += "if (i >= 0) ";
+            closers.push_back(random_below(2) ? "else i = 0; " : "");
+            break;
+        case 2:
+            opening += "while (j < " + std::to_string(++loops) + ") { j = j + 1; ";
+            closers.push_back("} ");
+            break;
+        default:
+            opening += "do { ";
+            closers.push_back("} while (false); ");
+            break;
+        }
+    }
+    for (size_t i = closers.size(); i > 0; i--) {
+        closing += closers[i - 1];
+    }
+    return "program {\n    int i = 0, j = 0;\n    " + opening + "i = i + 1; " + closing +
+           "\n    write(i, \" \", j);\n}\n";
+}
+
+// one literal of n characters with escapes in it
+static std::string generate_strings(size_t n)
+{
+    std::string literal;
+    for (size_t i = 0; i < n; i++) {
+        switch (random_below(32)) {
+        case 0:
+            literal += "\\\"";
+            break;
+        case 1:
+            literal += "\\\\";
+            break;
+        case 2:
+            literal += "\\n";
+            break;
+        default:
+            literal += (char)('a' + random_below(26));
+            break;
+        }
+    }
+    return "program {\n    string s = \"" + literal + "\";\n    s = s + \"" + literal +
+           "\";\n    write(s);\n}\n";
+}
+
+// comment text with runs of '*', which never close it
+static std::string comment_text(size_t length)
+{
+    std::string result;
+    for (size_t i = 0; i < length; i++) {
+        size_t kind = random_below(8);
+        if (kind == 0) {
+            result += '*';
+        } else if (kind == 1 && (result.empty() || result.back() != '*')) {
+            result += random_below(2) ? '/' : '\n';
+        } else {
+            result += (char)('a' + random_below(26));
+        }
+    }
+    return result;
+}
+
+// one long comment, and short ones both where an operand and where an operator is expected
+static std::string generate_comments(size_t n)
+{
+    std::ostringstream source;
+    source << "program {\n    int i = 0;\n    /*" << comment_text(n / 2) << "*/\n";
+    for (size_t written = 0; written < n / 2; written += 64) {
+        source << "    i = /*" << comment_text(32) << "*/ i /*" << comment_text(32) << "*/ + 1;\n";
+    }
+    source << "    write(i);\n}\n";
+    return source.str();
+}
+
+// a single chain of n comparisons, every one of them true
+static std::string generate_comparisons(size_t n)
+{
+    std::ostringstream source;
+    source << "program {\n    boolean b;\n    int i = 0;\n    b = i";
+    for (size_t i = 1; i <= n; i++) {
+        source << (random_below(2) ? " < " : " <= ") << i;
+    }
+    source << ";\n    write(b);\n}\n";
+    return source.str();
+}
+
+// LabelsTable: loops with break and continue, if-else and lazy 'or' and 'and'
+static std::string generate_labels(size_t n)
+{
+    std::ostringstream source;
+    source << "program {\n    int i, j = 0;\n";
+    for (size_t k = 0; k < n; k++) {
+        switch (random_below(3)) {
+        case 0:
+            source << "    i = 0; while (i < 2) { i = i + 1; if (i == 1) continue; break; }\n";
+            break;
+        case 1:
+            source << "    if (j > " << k << " or j < 0 and j != 1) j = j - 1; else j = j + 1;\n";
+            break;
+        default:
+            source << "    i = 0; do { i = i + 1; if (i > 1) break; } while (true);\n";
+            break;
+        }
+    }
+    source << "    write(i, \" \", j);\n}\n";
+    return source.str();
+}
+
+// a flat sum of n terms and n nested brackets
+static std::string generate_expressions(size_t n)
+{
+    std::ostringstream source;
+    source << "program {\n    int i = 1;\n    i = i";
+    for (size_t k = 0; k < n; k++) {
+        source << (random_below(2) ? " + " : " - ") << random_below(10);
+    }
+    source << ";\n    i = " << std::string(n, '(') << "i";
+    for (size_t k = 0; k < n; k++) {
+        source << (random_below(3) ? " + " : " * ") << random_below(2) << ")";
+    }
+    source << ";\n    write(i);\n}\n";
+    return source.str();
+}
+
+static const Workload workloads[] = {
+    { "variables", generate_variables, 1000, 1 << phParse },
+    { "else_if", generate_else_if, 1000, 1 << phParse | 1 << phExecute },
+    { "nesting", generate_nesting, 2000, 1 << phParse | 1 << phExecute },
+    { "strings", generate_strings, 100000, 1 << phLex | 1 << phExecute },
+    { "comments", generate_comments, 100000, 1 << phLex },
+    { "comparisons", generate_comparisons, 1000, 1 << phLex | 1 << phParse | 1 << phExecute },
+    { "labels", generate_labels, 1000, 1 << phParse | 1 << phExecute },
+    { "expressions", generate_expressions, 2000, 1 << phParse | 1 << phExecute }
+};
+
+// CPU time of the calling thread: on a busy machine wall time also counts the
+// slices of other processes, which shows up as growth where there is none
+static double thread_seconds()
+{
+    timespec now;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+static bool measure(const std::string &source, size_t runs, Measurement &result, std::string &error)
+{
+    std::ofstream null("/dev/null");
+    for (size_t phase = 0; phase < phCount; phase++) {
+        result.seconds[phase] = HUGE_VAL;
+        result.bytes[phase] = 0;
+    }
+    for (size_t run = 0; run < runs; run++) {
+        LexicalAnalyzer lexical;
+        SyntaxAnalyzer syntax(true, true);
+        Program *program = NULL;
+        std::istringstream input;
+        double seconds[phCount];
+        size_t bytes[phCount];
+        double start;
+        try {
+            heap_tracking_start();
+            start = thread_seconds();
+            lexical.parse_string(source);
+            seconds[phLex] = thread_seconds() - start;
+            bytes[phLex] = heap_counters().peak;
+
+            heap_tracking_start();
+            start = thread_seconds();
+            program = syntax.parse(lexical.get_lexemes());
+            seconds[phParse] = thread_seconds() - start;
+            bytes[phParse] = heap_counters().peak;
+
+            heap_tracking_start();
+            start = thread_seconds();
+            ExecutionContext context(*program, input, null);
+            context.execute();
+            seconds[phExecute] = thread_seconds() - start;
+            bytes[phExecute] = heap_counters().peak;
+            heap_tracking_stop();
+        } catch (const Exception &e) {
+            heap_tracking_stop();
+            error = e.what();
+            delete program;
+            return false;
+        }
+        delete program;
+        for (size_t phase = 0; phase < phCount; phase++) {
+            result.seconds[phase] = std::min(result.seconds[phase], seconds[phase]);
+            result.bytes[phase] = std::max(result.bytes[phase], bytes[phase]);
+        }
+    }
+    return true;
+}
+
+// median of the slopes of log(value) against log(size) over all pairs of sizes
+// (Theil-Sen), so value grows as size^slope; unlike least squares, one run
+// slowed down by the scheduler does not move it
+static double fit_exponent(const std::vector<double> &sizes, const std::vector<double> &values)
+{
+    std::vector<double> slopes;
+    for (size_t i = 0; i < sizes.size(); i++) {
+        for (size_t j = i + 1; j < sizes.size(); j++) {
+            slopes.push_back(log(std::max(values[j], 1e-12) / std::max(values[i], 1e-12)) /
+                             log(sizes[j] / sizes[i]));
+        }
+    }
+    if (slopes.empty()) {
+        return 0.0;
+    }
+    std::sort(slopes.begin(), slopes.end());
+    size_t middle = slopes.size() / 2;
+    return slopes.size() % 2 ? slopes[middle] : (slopes[middle - 1] + slopes[middle]) / 2;
+}
+
+// the class whose own exponent over the same sizes is the nearest
+static const char *complexity_class(const std::vector<double> &sizes, double exponent)
+{
+    static const char *names[] = { "O(1)", "O(log n)", "O(n)", "O(n log n)", "O(n^2)", "O(n^3)" };
+    size_t best = 0;
+    double best_distance = HUGE_VAL;
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        std::vector<double> model;
+        for (size_t j = 0; j < sizes.size(); j++) {
+            double n = sizes[j];
+            double values[] = { 1.0, log(n), n, n * log(n), n * n, n * n * n };
+            model.push_back(values[i]);
+        }
+        double distance = fabs(fit_exponent(sizes, model) - exponent);
+        if (distance < best_distance) {
+            best = i;
+            best_distance = distance;
+        }
+    }
+    return names[best];
+}
+
+static void print_measurements(const std::vector<Measurement> &measurements)
+{
+    std::cout << std::right << std::setw(12) << "n";
+    for (size_t phase = 0; phase < phCount; phase++) {
+        std::cout << std::setw(12) << std::string(phase_names[phase]) + " ms";
+    }
+    for (size_t phase = 0; phase < phCount; phase++) {
+        std::cout << std::setw(12) << std::string(phase_names[phase]) + " KiB";
+    }
+    std::cout << std::endl;
+    for (size_t i = 0; i < measurements.size(); i++) {
+        std::cout << std::setw(12) << measurements[i].size;
+        for (size_t phase = 0; phase < phCount; phase++) {
+            std::cout << std::setw(12) << measurements[i].seconds[phase] * 1000;
+        }
+        for (size_t phase = 0; phase < phCount; phase++) {
+            std::cout << std::setw(12) << measurements[i].bytes[phase] / 1024.0;
+        }
+        std::cout << std::endl;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    std::string filter;
+    size_t runs = 5, steps = 5;
+    unsigned seed = 1;
+    double scale = 1.0, tolerance = 0.25, min_time = 0.02;
+    size_t min_bytes = 64 * 1024;
+    bool verbose = false, usage = false;
+
+    for (int i = 1; i < argc; i++) {
+        std::string current = argv[i];
+        if (current == "--filter" && i + 1 < argc) {
+            filter = argv[++i];
+        } else if (current == "--runs" && i + 1 < argc) {
+            runs = std::max(1ul, strtoul(argv[++i], NULL, 10));
+        } else if (current == "--steps" && i + 1 < argc) {
+            steps = std::max(3ul, strtoul(argv[++i], NULL, 10));
+        } else if (current == "--scale" && i + 1 < argc) {
+            scale = std::max(0.001, atof(argv[++i]));
+        } else if (current == "--seed" && i + 1 < argc) {
+            seed = strtoul(argv[++i], NULL, 10);
+        } else if (current == "--tolerance" && i + 1 < argc) {
+            tolerance = atof(argv[++i]);
+        } else if (current == "--min-time" && i + 1 < argc) {
+            min_time = atof(argv[++i]) / 1000;
+        } else if (current == "--verbose") {
+            verbose = true;
+        } else {
+            usage = true;
+        }
+    }
+    if (usage) {
+        std::cout << "Usage:" << std::endl;
+        std::cout << "stress [--filter SUBSTRING] [--runs N] [--steps N] [--scale FACTOR] [--seed N] " \
+            "[--tolerance EXPONENT] [--min-time MS] [--verbose]" << std::endl;
+        std::cout << "Generates adversarial programs of doubling sizes (STEPS sizes, 5 by default, " \
+            "starting at the base size of every workload times FACTOR) and measures the CPU time " \
+            "(fastest of N runs, 5 by default) and the heap peak of the lex, parse and execute " \
+            "phases. The exponent of every phase is the median slope on a log-log scale; the exit " \
+            "code is 1 if one exceeds that of n log n by more than EXPONENT (0.25 by default). " \
+            "While a phase the workload is built for takes less than MS milliseconds (20 by " \
+            "default) at the largest size, the ladder moves one doubling up, at most 6 times; " \
+            "such a phase still faster makes the exit code 2, other phases that fast and heap " \
+            "peaks under 64 KiB are not fitted. " \
+            "The generators are random, SEED picks the programs." << std::endl;
+        return 2;
+    }
+
+    // freed memory stays in the heap, so the fastest run of every size pays no page
+    // faults; otherwise only sizes past what earlier runs freed do, and look superlinear
+    mallopt(M_MMAP_MAX, 0);
+    mallopt(M_TRIM_THRESHOLD, INT_MAX);
+
+    bool failed = false, superlinear = false;
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << std::left << std::setw(14) << "workload" << std::setw(10) << "phase" << std::setw(8)
+              << "metric" << std::right << std::setw(14) << "largest" << std::setw(10) << "exponent"
+              << std::setw(12) << "class" << std::endl;
+    for (size_t w = 0; w < sizeof(workloads) / sizeof(workloads[0]); w++) {
+        const Workload &workload = workloads[w];
+        if (filter != "" && std::string(workload.name).find(filter) == std::string::npos) {
+            continue;
+        }
+        // the ladder moves up, keeping the last STEPS sizes, until every phase the workload
+        // is built for takes min_time at the largest one, so a fast machine does not skip it
+        std::vector<Measurement> measurements;
+        std::string error;
+        for (size_t step = 0; step < steps + max_growth; step++) {
+            if (measurements.size() == steps) {
+                bool measurable = true;
+                for (size_t phase = 0; phase < phCount; phase++) {
+                    measurable = measurable && (!(workload.phases & 1 << phase) ||
+                                                measurements.back().seconds[phase] >= min_time);
+                }
+                if (measurable) {
+                    break;
+                }
+                measurements.erase(measurements.begin());
+            }
+            Measurement measurement;
+            measurement.size = std::max((size_t)1, (size_t)(workload.base * scale)) << step;
+            random_engine.seed(seed + measurement.size);
+            if (!measure(workload.generate(measurement.size), runs, measurement, error)) {
+                break;
+            }
+            measurements.push_back(measurement);
+        }
+        std::vector<double> sizes;
+        for (size_t i = 0; i < measurements.size(); i++) {
+            sizes.push_back(measurements[i].size);
+        }
+        if (error != "") {
+            std::cout << std::left << std::setw(14) << workload.name << "failed: " << error
+                      << std::right << std::endl;
+            failed = true;
+            continue;
+        }
+        if (verbose) {
+            print_measurements(measurements);
+        }
+
+        for (size_t phase = 0; phase < phCount; phase++) {
+            for (size_t metric = 0; metric < mtCount; metric++) {
+                std::vector<double> values;
+                for (size_t i = 0; i < measurements.size(); i++) {
+                    values.push_back(metric == mtTime ? measurements[i].seconds[phase] : measurements[i].bytes[phase]);
+                }
+                std::cout << std::left << std::setw(14) << (phase == 0 && metric == 0 ? workload.name : "")
+                          << std::setw(10) << (metric == 0 ? phase_names[phase] : "") << std::setw(8)
+                          << metric_names[metric] << std::right;
+                if (metric == mtTime) {
+                    std::cout << std::setw(12) << values.back() * 1000 << "ms";
+                } else {
+                    std::cout << std::setw(11) << values.back() / 1024 << "KiB";
+                }
+                // too small to tell growth from noise and fixed costs; the ladder has grown
+                // for the phases of the workload, so one of them still that fast is a failure
+                if (metric == mtTime ? values.back() < min_time : values.back() < min_bytes) {
+                    std::cout << std::setw(10) << "-";
+                    if (metric == mtTime && workload.phases & 1 << phase) {
+                        std::cout << "  UNMEASURED";
+                        failed = true;
+                    }
+                    std::cout << std::endl;
+                    continue;
+                }
+                double exponent = fit_exponent(sizes, values);
+                std::vector<double> limit;
+                for (size_t i = 0; i < sizes.size(); i++) {
+                    limit.push_back(sizes[i] * log(sizes[i]));
+                }
+                std::cout << std::setw(10) << exponent << std::setw(12) << complexity_class(sizes, exponent);
+                if (exponent > fit_exponent(sizes, limit) + tolerance) {
+                    std::cout << "  SUPERLINEAR";
+                    superlinear = true;
+                }
+                std::cout << std::endl;
+            }
+        }
+    }
+    if (failed) {
+        return 2;
+    }
+    return superlinear ? 1 : 0;
+}
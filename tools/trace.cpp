@@ -0,0 +1,248 @@
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+#include "../source/trace.h"
+
+// a maximal run of sequentially executed nodes
+struct Block {
+    uint64_t start;
+    uint64_t end;
+
+    bool operator<(const Block &other) const
+    {
+        return start < other.start || (start == other.start && end < other.end);
+    }
+
+    bool operator==(const Block &other) const
+    {
+        return start == other.start && end == other.end;
+    }
+};
+
+// iterations of the loops closed by one backward jump, per entry
+struct Loop {
+    uint64_t start;
+    uint64_t end;
+    bool active;
+    uint64_t current;
+    std::vector<uint64_t> trips;
+};
+
+struct Analysis {
+    uint64_t runs;
+    uint64_t instructions;
+    uint64_t jumps;
+    uint64_t duration;
+    // consecutive repeats of a block are merged into one entry
+    std::vector<std::pair<Block, uint64_t> > sequence;
+    std::map<Block, uint64_t> blocks;
+    std::map<std::pair<uint64_t, uint64_t>, Loop> loops;
+    std::vector<uint64_t> reads;
+    std::vector<uint64_t> writes;
+};
+
+// a loop is left once a block starts outside of it
+static void leave_loops(Analysis &analysis, uint64_t start)
+{
+    for (auto i = analysis.loops.begin(); i != analysis.loops.end(); i++) {
+        Loop &loop = i->second;
+        if (loop.active && (start < loop.start || start > loop.end)) {
+            loop.trips.push_back(loop.current);
+            loop.active = false;
+        }
+    }
+}
+
+static void add_block(Analysis &analysis, uint64_t start, uint64_t end)
+{
+    if (end < start) {
+        return;
+    }
+    Block block = { start, end };
+    analysis.instructions += end - start + 1;
+    analysis.blocks[block]++;
+    if (!analysis.sequence.empty() && analysis.sequence.back().first == block) {
+        analysis.sequence.back().second++;
+    } else {
+        analysis.sequence.push_back(std::make_pair(block, (uint64_t)1));
+    }
+    leave_loops(analysis, start);
+}
+
+static void take_jump(Analysis &analysis, uint64_t from, uint64_t to)
+{
+    analysis.jumps++;
+    if (to > from) {
+        return;
+    }
+    Loop &loop = analysis.loops[std::make_pair(to, from)];
+    loop.start = to;
+    loop.end = from;
+    if (!loop.active) {
+        loop.active = true;
+        loop.current = 0;
+    }
+    loop.current++;
+}
+
+static bool analyze(TraceReader &reader, Analysis &analysis)
+{
+    TraceEvent event;
+    uint64_t block_start = 0, run_start = 0;
+    bool running = false;
+    while (reader.next(event)) {
+        switch (event.kind) {
+        case teStart:
+            analysis.runs++;
+            block_start = event.pos;
+            run_start = event.time;
+            running = true;
+            break;
+        case teJump:
+            add_block(analysis, block_start, event.pos);
+            take_jump(analysis, event.pos, event.target);
+            block_start = event.target;
+            break;
+        case teRead:
+            analysis.reads.push_back(event.duration);
+            break;
+        case teWrite:
+            analysis.writes.push_back(event.duration);
+            break;
+        case teEnd:
+            // the run stopped before the node at event.pos
+            if (running && event.pos > block_start) {
+                add_block(analysis, block_start, event.pos - 1);
+            }
+            leave_loops(analysis, (uint64_t)-1);
+            analysis.duration += event.time - run_start;
+            running = false;
+            break;
+        }
+    }
+    return !reader.error();
+}
+
+static uint64_t percentile(const std::vector<uint64_t> &sorted, double fraction)
+{
+    return sorted[std::min(sorted.size() - 1, (size_t)(fraction * sorted.size()))];
+}
+
+static void print_latencies(const char *title, std::vector<uint64_t> latencies)
+{
+    if (latencies.empty()) {
+        return;
+    }
+    std::sort(latencies.begin(), latencies.end());
+    uint64_t total = 0;
+    for (size_t i = 0; i < latencies.size(); i++) {
+        total += latencies[i];
+    }
+    std::cout << std::fixed << std::setprecision(1) << title << ": " << latencies.size()
+              << ", total " << total / 1000.0 << " us, min " << latencies.front() / 1000.0
+              << ", mean " << (double)total / latencies.size() / 1000.0
+              << ", p50 " << percentile(latencies, 0.5) / 1000.0
+              << ", p99 " << percentile(latencies, 0.99) / 1000.0
+              << ", max " << latencies.back() / 1000.0 << " us" << std::endl;
+}
+
+static void print_analysis(const Analysis &analysis, size_t limit)
+{
+    std::cout << "Runs: " << analysis.runs << ", instructions: " << analysis.instructions
+              << ", taken jumps: " << analysis.jumps << ", execution time: " << std::fixed
+              << std::setprecision(3) << analysis.duration / 1e6 << " ms" << std::endl;
+
+    std::cout << "Block sequence (" << analysis.sequence.size() << " entries):" << std::endl;
+    for (size_t i = 0; i < analysis.sequence.size() && i < limit; i++) {
+        const Block &block = analysis.sequence[i].first;
+        std::cout << "  [" << block.start << ".." << block.end << "]";
+        if (analysis.sequence[i].second > 1) {
+            std::cout << " x" << analysis.sequence[i].second;
+        }
+        std::cout << std::endl;
+    }
+    if (analysis.sequence.size() > limit) {
+        std::cout << "  ..." << std::endl;
+    }
+
+    std::vector<std::pair<uint64_t, Block> > hot;
+    for (auto i = analysis.blocks.begin(); i != analysis.blocks.end(); i++) {
+        hot.push_back(std::make_pair(i->second * (i->first.end - i->first.start + 1), i->first));
+    }
+    std::sort(hot.rbegin(), hot.rend());
+    std::cout << "Hottest blocks:" << std::endl;
+    std::cout << std::setw(16) << "instructions" << std::setw(14) << "executions" << "  block" << std::endl;
+    for (size_t i = 0; i < hot.size() && i < limit; i++) {
+        const Block &block = hot[i].second;
+        std::cout << std::setw(16) << hot[i].first << std::setw(14) << analysis.blocks.at(block)
+                  << "  [" << block.start << ".." << block.end << "]" << std::endl;
+    }
+
+    std::cout << "Loops:" << std::endl;
+    std::cout << std::setw(16) << "range" << std::setw(10) << "entries" << std::setw(14) << "iterations"
+              << std::setw(10) << "min" << std::setw(12) << "mean" << std::setw(10) << "max" << std::endl;
+    for (auto i = analysis.loops.begin(); i != analysis.loops.end(); i++) {
+        // loops still active belong to a trace without its end event
+        std::vector<uint64_t> trips = i->second.trips;
+        if (i->second.active) {
+            trips.push_back(i->second.current);
+        }
+        uint64_t total = 0;
+        for (size_t j = 0; j < trips.size(); j++) {
+            total += trips[j];
+        }
+        std::string range = std::to_string(i->second.start) + ".." + std::to_string(i->second.end);
+        std::cout << std::setw(16) << range << std::setw(10) << trips.size() << std::setw(14) << total
+                  << std::setw(10) << *std::min_element(trips.begin(), trips.end())
+                  << std::setw(12) << std::setprecision(1) << (double)total / trips.size()
+                  << std::setw(10) << *std::max_element(trips.begin(), trips.end()) << std::endl;
+    }
+
+    print_latencies("Reads", analysis.reads);
+    print_latencies("Writes", analysis.writes);
+}
+
+int main(int argc, char **argv)
+{
+    std::string path;
+    size_t limit = 20;
+    for (int i = 1; i < argc; i++) {
+        std::string current = argv[i];
+        if (current == "--limit" && i + 1 < argc) {
+            limit = strtoul(argv[++i], NULL, 10);
+        } else if (path == "") {
+            path = current;
+        } else {
+            path = "";
+            break;
+        }
+    }
+    if (path == "") {
+        std::cout << "Usage:" << std::endl;
+        std::cout << "trace [--limit N] FILE" << std::endl;
+        std::cout << "Reconstructs the execution recorded by interpreter --trace FILE: the " \
+            "sequence of executed basic blocks and the hottest ones (first N, 20 by default), " \
+            "the trip counts of every loop and the latency of reads and writes." << std::endl;
+        return 2;
+    }
+
+    std::ifstream file(path, std::ios::binary);
+    TraceReader reader;
+    if (!file.is_open() || !reader.open(file)) {
+        std::cout << "Error: could not read trace " << path << "." << std::endl;
+        return 2;
+    }
+    Analysis analysis = { 0, 0, 0, 0 };
+    bool complete = analyze(reader, analysis);
+    print_analysis(analysis, limit);
+    if (!complete) {
+        std::cout << "Error: the trace is truncated." << std::endl;
+        return 1;
+    }
+    return 0;
+}